@@ -0,0 +1,381 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+// Microbenchmarks of the single sort primitives: one launch of every bitonic and merge kernel, the host <-> device
+// transfers and the CPU sorts, each timed on its own. The throughputs are compared against a stored baseline, a drop
+// beyond the tolerance fails (used by ctest). A baseline of another device, size or build type is not compared, and
+// baselines are only recorded from optimized builds. Runs from the Code folder, where Sort.cl is.
+//
+// SortBenchmark [--size <keys>] [--reps <n>] [--baseline <json>] [--tolerance <fraction>] [--write-baseline <json>]
+
+#include "../CSortTask.h"
+#include "../../Common/CLUtil.h"
+#include "../../Common/CTimer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// exit code for ctest (SKIP_RETURN_CODE): the baseline is empty or was measured on another device, size or build
+#define BENCHMARK_SKIPPED 77
+
+// the CMake build type, numbers of unoptimized builds say nothing about the kernels or the CPU sorts
+#ifndef SORT_BUILD_TYPE
+#define SORT_BUILD_TYPE ""
+#endif
+#if defined(__OPTIMIZE__) || (defined(_MSC_VER) && defined(NDEBUG))
+#define BENCHMARK_OPTIMIZED true
+#else
+#define BENCHMARK_OPTIMIZED false
+#endif
+
+class CSortBenchmark : public CSortTask
+{
+public:
+	CSortBenchmark(size_t ArraySize, size_t LocWorkSize[3]) : CSortTask(ArraySize, LocWorkSize) {}
+
+	//! Every primitive Reps times, the best run counts. Throughputs in Melem/s
+	bool Run(cl_command_queue CommandQueue, unsigned int Reps, vector<pair<string, double> >& Results);
+
+protected:
+	//! Device time of a finished command in ms
+	double EventMilliseconds(cl_event Event);
+
+	//! Best of Reps launches of Kernel over the whole array, the arguments are set already
+	bool TimeKernel(cl_command_queue CommandQueue, cl_kernel Kernel, size_t GlobalWorkSize, size_t LocalWorkSize, unsigned int Reps, double& Ms);
+
+	bool Upload(cl_command_queue CommandQueue);
+};
+
+double CSortBenchmark::EventMilliseconds(cl_event Event)
+{
+	cl_ulong start = 0, end = 0;
+	clGetEventProfilingInfo(Event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+	clGetEventProfilingInfo(Event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+	return 1.0e-6 * (double)(end - start);
+}
+
+bool CSortBenchmark::TimeKernel(cl_command_queue CommandQueue, cl_kernel Kernel, size_t GlobalWorkSize, size_t LocalWorkSize, unsigned int Reps, double& Ms)
+{
+	Ms = 0;
+	for (unsigned int r = 0; r < Reps; r++) {
+		cl_event event;
+		V_RETURN_FALSE_CL(clEnqueueNDRangeKernel(CommandQueue, Kernel, 1, NULL, &GlobalWorkSize, &LocalWorkSize, 0, NULL, &event), "Error executing kernel!");
+		V_RETURN_FALSE_CL(clWaitForEvents(1, &event), "Error waiting for kernel!");
+		double ms = EventMilliseconds(event);
+		clReleaseEvent(event);
+		Ms = (r == 0) ? ms : min(Ms, ms);
+	}
+	return true;
+}
+
+bool CSortBenchmark::Upload(cl_command_queue CommandQueue)
+{
+	V_RETURN_FALSE_CL(clEnqueueWriteBuffer(CommandQueue, m_dPingArray, CL_TRUE, 0, m_N_padded * sizeof(cl_uint), m_hInput, 0, NULL, NULL), "Error copying data to device!");
+	return true;
+}
+
+bool CSortBenchmark::Run(cl_command_queue CommandQueue, unsigned int Reps, vector<pair<string, double> >& Results)
+{
+	cl_int clError;
+	double ms;
+	size_t lws = LocalWorkSize[0];
+	size_t gws = CLUtil::GetGlobalWorkSize(m_N_padded / 2, lws);
+	size_t limit = 2 * lws;
+	double melems = 1.0e-3 * (double)m_N_padded;
+
+	// transfers
+	double writeMs = 0, readMs = 0;
+	for (unsigned int r = 0; r < Reps; r++) {
+		cl_event event;
+		V_RETURN_FALSE_CL(clEnqueueWriteBuffer(CommandQueue, m_dPingArray, CL_TRUE, 0, m_N_padded * sizeof(cl_uint), m_hInput, 0, NULL, &event), "Error copying data to device!");
+		ms = EventMilliseconds(event);
+		clReleaseEvent(event);
+		writeMs = (r == 0) ? ms : min(writeMs, ms);
+		V_RETURN_FALSE_CL(clEnqueueReadBuffer(CommandQueue, m_dPingArray, CL_TRUE, 0, m_N_padded * sizeof(cl_uint), m_resultCPU, 0, NULL, &event), "Error reading data from device!");
+		ms = EventMilliseconds(event);
+		clReleaseEvent(event);
+		readMs = (r == 0) ? ms : min(readMs, ms);
+	}
+	Results.push_back(make_pair(string("transfer_write"), melems / writeMs));
+	Results.push_back(make_pair(string("transfer_read"), melems / readMs));
+
+	// bitonic mergesort: the start kernel sorts all tiles, the local and global kernels run the first strides above the tile
+	if (!Upload(CommandQueue))
+		return false;
+	clError = clSetKernelArg(m_BitonicStartKernel, 0, sizeof(cl_mem), (void*)&m_dPingArray);
+	clError |= clSetKernelArg(m_BitonicStartKernel, 1, sizeof(cl_mem), (void*)&m_dPongArray);
+	V_RETURN_FALSE_CL(clError, "Failed to set kernel args: BitonicStartKernel");
+	if (!TimeKernel(CommandQueue, m_BitonicStartKernel, gws, lws, Reps, ms))
+		return false;
+	Results.push_back(make_pair(string("bitonic_start"), melems / ms));
+
+	clError = clSetKernelArg(m_BitonicLocalKernel, 0, sizeof(cl_mem), (void*)&m_dPongArray);
+	clError |= SetIndexArg(m_BitonicLocalKernel, 1, m_N_padded);
+	clError |= SetIndexArg(m_BitonicLocalKernel, 2, 2 * limit);
+	clError |= SetIndexArg(m_BitonicLocalKernel, 3, limit / 2);
+	V_RETURN_FALSE_CL(clError, "Failed to set kernel args: BitonicLocalKernel");
+	if (!TimeKernel(CommandQueue, m_BitonicLocalKernel, gws, lws, Reps, ms))
+		return false;
+	Results.push_back(make_pair(string("bitonic_local"), melems / ms));
+
+	clError = clSetKernelArg(m_BitonicGlobalKernel, 0, sizeof(cl_mem), (void*)&m_dPongArray);
+	clError |= SetIndexArg(m_BitonicGlobalKernel, 1, m_N_padded);
+	clError |= SetIndexArg(m_BitonicGlobalKernel, 2, m_N_padded);
+	clError |= SetIndexArg(m_BitonicGlobalKernel, 3, m_N_padded / 2);
+	V_RETURN_FALSE_CL(clError, "Failed to set kernel args: BitonicGlobalKernel");
+	if (!TimeKernel(CommandQueue, m_BitonicGlobalKernel, gws, lws, Reps, ms))
+		return false;
+	Results.push_back(make_pair(string("bitonic_global"), melems / ms));
+
+	// mergesort: the start kernel, and both global merge kernels on the first stride above the tile
+	if (!Upload(CommandQueue))
+		return false;
+	clError = clSetKernelArg(m_MergesortStartKernel, 0, sizeof(cl_mem), (void*)&m_dPingArray);
+	clError |= clSetKernelArg(m_MergesortStartKernel, 1, sizeof(cl_mem), (void*)&m_dPongArray);
+	V_RETURN_FALSE_CL(clError, "Failed to set kernel args: MergeSortStart");
+	if (!TimeKernel(CommandQueue, m_MergesortStartKernel, gws, lws, Reps, ms))
+		return false;
+	Results.push_back(make_pair(string("mergesort_start"), melems / ms));
+
+	cl_uint stride = (cl_uint)(2 * limit), size = (cl_uint)m_N_padded;
+	size_t mergeWorkers = m_N_padded / stride;
+	size_t mergeLws = min(lws, mergeWorkers);
+	cl_kernel mergeKernels[2] = { m_MergesortGlobalSmallKernel, m_MergesortGlobalBigKernel };
+	const char* mergeNames[2] = { "mergesort_global_small", "mergesort_global_big" };
+	for (int k = 0; k < 2; k++) {
+		clError = clSetKernelArg(mergeKernels[k], 0, sizeof(cl_mem), (void*)&m_dPongArray);
+		clError |= clSetKernelArg(mergeKernels[k], 1, sizeof(cl_mem), (void*)&m_dPingArray);
+		clError |= clSetKernelArg(mergeKernels[k], 2, sizeof(cl_uint), (void*)&stride);
+		clError |= clSetKernelArg(mergeKernels[k], 3, sizeof(cl_uint), (void*)&size);
+		V_RETURN_FALSE_CL(clError, "Failed to set kernel args: MergeSortGlobal");
+		if (!TimeKernel(CommandQueue, mergeKernels[k], CLUtil::GetGlobalWorkSize(mergeWorkers, mergeLws), mergeLws, Reps, ms))
+			return false;
+		Results.push_back(make_pair(string(mergeNames[k]), melems / ms));
+	}
+
+	// CPU: both mergesorts, and a single 16-way merge pass over sorted runs
+	CTimer timer;
+	double cpuMs[3] = { 0, 0, 0 };
+	unsigned int* runs = m_HostPool.AllocateArray<unsigned int>(m_N_padded);
+	size_t runSize = (m_N_padded + 15) / 16;
+	for (size_t i = 0; i < m_N_padded; i++)
+		runs[i] = OrderCode(m_hInput[i]);
+	for (size_t i = 0; i < m_N_padded; i += runSize)
+		sort(runs + i, runs + min(i + runSize, m_N_padded));
+	for (unsigned int r = 0; r < Reps; r++) {
+		timer.Start();
+		Mergesort(m_hInput, m_resultCPU, m_N_padded);
+		timer.Stop();
+		cpuMs[0] = (r == 0) ? timer.GetElapsedMilliseconds() : min(cpuMs[0], timer.GetElapsedMilliseconds());
+
+		timer.Start();
+		MergesortBlocked(m_hInput, m_resultCPU, m_N_padded);
+		timer.Stop();
+		cpuMs[1] = (r == 0) ? timer.GetElapsedMilliseconds() : min(cpuMs[1], timer.GetElapsedMilliseconds());
+
+		timer.Start();
+		MergeMultiway(runs, m_resultCPU, m_N_padded, runSize, false);
+		timer.Stop();
+		cpuMs[2] = (r == 0) ? timer.GetElapsedMilliseconds() : min(cpuMs[2], timer.GetElapsedMilliseconds());
+	}
+	m_HostPool.Free(runs);
+	Results.push_back(make_pair(string("cpu_mergesort"), melems / cpuMs[0]));
+	Results.push_back(make_pair(string("cpu_mergesort_blocked"), melems / cpuMs[1]));
+	Results.push_back(make_pair(string("cpu_merge_multiway"), melems / cpuMs[2]));
+	return true;
+}
+
+// the baseline is a flat JSON object: device name, build type, array size and the throughputs under "results"
+static bool ReadBaseline(const string& Path, string& Device, string& Build, double& Size, map<string, double>& Results)
+{
+	ifstream file(Path.c_str());
+	if (!file)
+		return false;
+	stringstream content;
+	content << file.rdbuf();
+	string json = content.str();
+
+	smatch match;
+	if (regex_search(json, match, regex("\"device\"\\s*:\\s*\"([^\"]*)\"")))
+		Device = match[1];
+	if (regex_search(json, match, regex("\"build\"\\s*:\\s*\"([^\"]*)\"")))
+		Build = match[1];
+	regex number("\"([A-Za-z0-9_]+)\"\\s*:\\s*([-+0-9.eE]+)");
+	for (sregex_iterator it(json.begin(), json.end(), number), end; it != end; ++it) {
+		if ((*it)[1] == "size")
+			Size = atof((*it)[2].str().c_str());
+		else
+			Results[(*it)[1]] = atof((*it)[2].str().c_str());
+	}
+	return true;
+}
+
+static bool WriteBaseline(const string& Path, const string& Device, const string& Build, size_t Size, const vector<pair<string, double> >& Results)
+{
+	ofstream file(Path.c_str());
+	if (!file)
+		return false;
+	file << "{" << endl << "\t\"device\": \"" << Device << "\"," << endl << "\t\"build\": \"" << Build << "\"," << endl;
+	file << "\t\"size\": " << Size << "," << endl << "\t\"results\": {" << endl;
+	for (size_t i = 0; i < Results.size(); i++)
+		file << "\t\t\"" << Results[i].first << "\": " << Results[i].second << (i + 1 < Results.size() ? "," : "") << endl;
+	file << "\t}" << endl << "}" << endl;
+	return true;
+}
+
+// the CPU runtime if there is one, so the kernels are measured without a GPU in the machine, otherwise the first device
+static bool CreateContext(cl_device_id& Device, cl_context& Context, cl_command_queue& Queue, string& DeviceName)
+{
+	cl_platform_id platforms[16];
+	cl_uint numPlatforms = 0;
+	V_RETURN_FALSE_CL(clGetPlatformIDs(16, platforms, &numPlatforms), "Failed to get CL platform ID");
+	bool found = false;
+	cl_device_type types[2] = { CL_DEVICE_TYPE_CPU, CL_DEVICE_TYPE_ALL };
+	for (int t = 0; t < 2 && !found; t++) {
+		for (cl_uint p = 0; p < numPlatforms && !found; p++) {
+			cl_uint numDevices = 0;
+			found = clGetDeviceIDs(platforms[p], types[t], 1, &Device, &numDevices) == CL_SUCCESS && numDevices > 0;
+		}
+	}
+	if (!found) {
+		cerr << "Error: no OpenCL device found" << endl;
+		return false;
+	}
+
+	char name[1024];
+	clGetDeviceInfo(Device, CL_DEVICE_NAME, sizeof(name), name, NULL);
+	name[sizeof(name) - 1] = '\0';
+	DeviceName = name;
+
+	cl_int clError;
+	Context = clCreateContext(NULL, 1, &Device, NULL, NULL, &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create OpenCL context.");
+	Queue = clCreateCommandQueue(Context, Device, CL_QUEUE_PROFILING_ENABLE, &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create the command queue in the context");
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	size_t size = 1024 * 1024;
+	unsigned int reps = 5;
+	double tolerance = 0.25;
+	string baselinePath, writePath;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--size" && hasValue)
+			size = strtoull(argv[++i], NULL, 0);
+		else if (arg == "--reps" && hasValue)
+			reps = max(1, atoi(argv[++i]));
+		else if (arg == "--tolerance" && hasValue)
+			tolerance = atof(argv[++i]);
+		else if (arg == "--baseline" && hasValue)
+			baselinePath = argv[++i];
+		else if (arg == "--write-baseline" && hasValue)
+			writePath = argv[++i];
+		else {
+			cerr << "Usage: " << argv[0] << " [--size <keys>] [--reps <n>] [--baseline <json>] [--tolerance <fraction>] [--write-baseline <json>]" << endl;
+			return 1;
+		}
+	}
+
+	// the merge kernels start above two tiles of 2 * 256 keys
+	if (size < 16 * 1024) {
+		cerr << "Error: the benchmark needs at least 16K keys" << endl;
+		return 1;
+	}
+
+	// numbers of a build without optimizations would never let a regression show
+	if (!writePath.empty() && !BENCHMARK_OPTIMIZED) {
+		cerr << "Error: baselines are recorded from optimized builds only (CMAKE_BUILD_TYPE Release)" << endl;
+		return 1;
+	}
+
+	// read first, so a missing baseline fails before the benchmark runs
+	string baselineDevice, baselineBuild;
+	double baselineSize = 0;
+	map<string, double> baseline;
+	if (!baselinePath.empty() && !ReadBaseline(baselinePath, baselineDevice, baselineBuild, baselineSize, baseline)) {
+		cerr << "Error: cannot read the baseline " << baselinePath << endl;
+		return 1;
+	}
+
+	cl_device_id device;
+	cl_context context = NULL;
+	cl_command_queue queue = NULL;
+	string deviceName;
+	if (!CreateContext(device, context, queue, deviceName))
+		return 1;
+	cout << "Benchmarking " << size << " keys on " << deviceName << ", best of " << reps << endl;
+
+	vector<pair<string, double> > results;
+	bool success;
+	{
+		size_t localWorkSize[3] = { 256, 1, 1 };
+		CSortBenchmark benchmark(size, localWorkSize);
+		benchmark.SetDeviceValidation(true);
+		success = benchmark.InitResources(device, context) && benchmark.Run(queue, reps, results);
+		benchmark.ReleaseResources();
+	}
+	clReleaseCommandQueue(queue);
+	clReleaseContext(context);
+	if (!success)
+		return 1;
+
+	// throughputs only compare on the same device, size and build, anything else would fail on a slower machine and
+	// never on a faster one
+	string build = SORT_BUILD_TYPE;
+	bool comparable = !baseline.empty() && baselineDevice == deviceName && (size_t)baselineSize == size && baselineBuild == build;
+
+	int regressions = 0;
+	for (size_t i = 0; i < results.size(); i++) {
+		cout << "  " << results[i].first << ": " << results[i].second << " Melem/s";
+		map<string, double>::const_iterator base = baseline.find(results[i].first);
+		if (comparable && base != baseline.end() && base->second > 0) {
+			double change = results[i].second / base->second - 1.0;
+			cout << " (baseline " << base->second << ", " << (change >= 0 ? "+" : "") << 100.0 * change << "%)";
+			if (change < -tolerance) {
+				cout << " REGRESSION";
+				regressions++;
+			}
+		}
+		cout << endl;
+	}
+
+	if (!writePath.empty()) {
+		if (!WriteBaseline(writePath, deviceName, build, size, results)) {
+			cerr << "Error: cannot write the baseline " << writePath << endl;
+			return 1;
+		}
+		cout << "Baseline written to " << writePath << endl;
+	}
+	if (regressions > 0) {
+		cout << regressions << " primitive(s) slower than the baseline by more than " << 100.0 * tolerance << "%" << endl;
+		return 1;
+	}
+	if (!baselinePath.empty() && baseline.empty()) {
+		cout << "WARNING: the baseline " << baselinePath << " has no results, NOTHING WAS COMPARED. Record it on the reference machine" << endl;
+		cout << "with an optimized build: SortBenchmark --size " << size << " --reps " << reps << " --write-baseline " << baselinePath << endl;
+		return BENCHMARK_SKIPPED;
+	}
+	if (!baselinePath.empty() && !comparable) {
+		cout << "WARNING: the baseline is for " << (size_t)baselineSize << " keys on " << baselineDevice << " (" << baselineBuild << " build), not ";
+		cout << size << " keys on " << deviceName << " (" << build << " build), NOTHING WAS COMPARED" << endl;
+		return BENCHMARK_SKIPPED;
+	}
+	return 0;
+}
@@ -0,0 +1,413 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CSortService.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// requests up to this many keys are coalesced, at most this many of them in one launch sequence
+#define SERVICE_BATCH_LIMIT 64 * 1024
+#define SERVICE_MAX_BATCH 256
+// print the statistics after this many requests
+#define SERVICE_STATS_INTERVAL 1000
+
+#ifndef _WIN32
+// a request on the wire, the shared memory descriptor comes along as SCM_RIGHTS ancillary data. The reply is one
+// int32_t, 1 if the keys were sorted
+struct CSortRequestMessage
+{
+	uint64_t	Size;
+	uint32_t	Stop;
+};
+
+static volatile sig_atomic_t g_ServiceSignal = 0;
+
+static void ServiceSignalHandler(int)
+{
+	g_ServiceSignal = 1;
+}
+
+static int ConnectService(const string& SocketPath)
+{
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (SocketPath.size() >= sizeof(address.sun_path)) {
+		cerr << "Error: socket path " << SocketPath << " is too long" << endl;
+		return -1;
+	}
+	strcpy(address.sun_path, SocketPath.c_str());
+
+	int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (connection < 0 || connect(connection, (sockaddr*)&address, sizeof(address)) != 0) {
+		cerr << "Error: cannot connect to the sort service at " << SocketPath << endl;
+		if (connection >= 0) close(connection);
+		return -1;
+	}
+	return connection;
+}
+
+static bool SendRequest(int Connection, const CSortRequestMessage& Message, int SharedMemory)
+{
+	iovec data = { (void*)&Message, sizeof(Message) };
+	msghdr header;
+	memset(&header, 0, sizeof(header));
+	header.msg_iov = &data;
+	header.msg_iovlen = 1;
+
+	char control[CMSG_SPACE(sizeof(int))];
+	if (SharedMemory >= 0) {
+		memset(control, 0, sizeof(control));
+		header.msg_control = control;
+		header.msg_controllen = sizeof(control);
+		cmsghdr* descriptor = CMSG_FIRSTHDR(&header);
+		descriptor->cmsg_level = SOL_SOCKET;
+		descriptor->cmsg_type = SCM_RIGHTS;
+		descriptor->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(descriptor), &SharedMemory, sizeof(int));
+	}
+	return sendmsg(Connection, &header, MSG_NOSIGNAL) == (ssize_t)sizeof(Message);
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// CSortService
+
+CSortService::CSortService(CSortTask& Task, cl_context Context, cl_command_queue CommandQueue)
+	: m_Task(Task), m_Context(Context), m_CommandQueue(CommandQueue), m_Socket(-1), m_Stop(false),
+	m_Requests(0), m_Batches(0), m_Rounds(0), m_QueueDepthSum(0), m_MaxQueueDepth(0)
+{
+}
+
+CSortService::~CSortService()
+{
+#ifndef _WIN32
+	for (size_t i = 0; i < m_Clients.size(); i++)
+		close(m_Clients[i]);
+	if (m_Socket >= 0)
+		close(m_Socket);
+#endif
+}
+
+bool CSortService::Run(const string& SocketPath)
+{
+#ifndef _WIN32
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (SocketPath.size() >= sizeof(address.sun_path)) {
+		cerr << "Error: socket path " << SocketPath << " is too long" << endl;
+		return false;
+	}
+	strcpy(address.sun_path, SocketPath.c_str());
+
+	//a socket left behind by a service that did not shut down cleanly is replaced
+	unlink(SocketPath.c_str());
+	m_Socket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (m_Socket < 0 || bind(m_Socket, (sockaddr*)&address, sizeof(address)) != 0 || listen(m_Socket, SOMAXCONN) != 0) {
+		cerr << "Error: cannot listen on " << SocketPath << endl;
+		return false;
+	}
+
+	fcntl(m_Socket, F_SETFL, O_NONBLOCK);
+
+	signal(SIGINT, ServiceSignalHandler);
+	signal(SIGTERM, ServiceSignalHandler);
+	signal(SIGPIPE, SIG_IGN);
+	cout << "Sort service listening on " << SocketPath << endl;
+
+	//every round collects the requests of all clients that are ready, so concurrent ones end up in the same batch
+	while (!m_Stop && !g_ServiceSignal) {
+		vector<pollfd> ready(1 + m_Clients.size());
+		ready[0].fd = m_Socket;
+		ready[0].events = POLLIN;
+		for (size_t i = 0; i < m_Clients.size(); i++) {
+			ready[i + 1].fd = m_Clients[i];
+			ready[i + 1].events = POLLIN;
+		}
+		int count = poll(&ready[0], ready.size(), 500);
+		if (count < 0 && errno != EINTR) {
+			cerr << "Error: poll failed" << endl;
+			break;
+		}
+		if (count <= 0)
+			continue;
+
+		vector<int> clients;
+		for (size_t i = 1; i < ready.size(); i++) {
+			if (ready[i].revents == 0 || Receive(ready[i].fd))
+				clients.push_back(ready[i].fd);
+			else
+				close(ready[i].fd);
+		}
+		m_Clients.swap(clients);
+		if (ready[0].revents & POLLIN)
+			Accept();
+
+		if (!m_Pending.empty())
+			ProcessPending();
+	}
+
+	PrintStatistics();
+	close(m_Socket);
+	m_Socket = -1;
+	unlink(SocketPath.c_str());
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	return true;
+#else
+	cerr << "Error: the sort service needs Unix domain sockets, which are not available on this platform" << endl;
+	return false;
+#endif
+}
+
+void CSortService::Accept()
+{
+#ifndef _WIN32
+	//all waiting connections, the listening socket does not block
+	for (int client = accept(m_Socket, NULL, NULL); client >= 0; client = accept(m_Socket, NULL, NULL))
+		m_Clients.push_back(client);
+#endif
+}
+
+bool CSortService::Receive(int Client)
+{
+#ifndef _WIN32
+	CSortRequestMessage message;
+	iovec data = { &message, sizeof(message) };
+	char control[CMSG_SPACE(sizeof(int))];
+	msghdr header;
+	memset(&header, 0, sizeof(header));
+	header.msg_iov = &data;
+	header.msg_iovlen = 1;
+	header.msg_control = control;
+	header.msg_controllen = sizeof(control);
+
+	//a closed connection or a malformed request ends the client. The read never waits, so a client that sends half
+	//a request is dropped instead of stalling everyone else
+	ssize_t received = recvmsg(Client, &header, MSG_DONTWAIT);
+	if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return true;
+	int sharedMemory = -1;
+	cmsghdr* descriptor = received > 0 ? CMSG_FIRSTHDR(&header) : NULL;
+	if (descriptor && descriptor->cmsg_level == SOL_SOCKET && descriptor->cmsg_type == SCM_RIGHTS)
+		memcpy(&sharedMemory, CMSG_DATA(descriptor), sizeof(int));
+	if (received != (ssize_t)sizeof(message)) {
+		if (sharedMemory >= 0) close(sharedMemory);
+		return false;
+	}
+
+	if (message.Stop) {
+		m_Stop = true;
+		return true;
+	}
+
+	CRequest request;
+	request.Client = Client;
+	request.Keys = NULL;
+	request.Size = (size_t)message.Size;
+	request.Latency.Start();
+	//the object has to hold every key the client announced, touching pages past its end would raise SIGBUS
+	struct stat info;
+	bool fits = sharedMemory >= 0 && message.Size <= (uint64_t)(SIZE_MAX / sizeof(unsigned int)) &&
+		fstat(sharedMemory, &info) == 0 && info.st_size >= 0 && (uint64_t)info.st_size >= message.Size * sizeof(unsigned int);
+	if (fits && request.Size > 0) {
+		void* mapping = mmap(NULL, request.Size * sizeof(unsigned int), PROT_READ | PROT_WRITE, MAP_SHARED, sharedMemory, 0);
+		if (mapping != MAP_FAILED)
+			request.Keys = (unsigned int*)mapping;
+	}
+	if (sharedMemory >= 0)
+		close(sharedMemory);
+
+	//nothing to sort, or nothing we can map
+	if (request.Size == 0 || request.Keys == NULL)
+		Reply(request, request.Size == 0);
+	else
+		m_Pending.push_back(request);
+	return true;
+#else
+	return false;
+#endif
+}
+
+void CSortService::ProcessPending()
+{
+	m_Rounds++;
+	m_QueueDepthSum += m_Pending.size();
+	m_MaxQueueDepth = max(m_MaxQueueDepth, m_Pending.size());
+
+	//big requests are sorted on their own, small ones are collected into batches
+	vector<unsigned int*> arrays;
+	vector<size_t> sizes;
+	vector<size_t> members;
+	for (size_t i = 0; i <= m_Pending.size(); i++) {
+		bool last = i == m_Pending.size();
+		if (!last && m_Pending[i].Size > SERVICE_BATCH_LIMIT) {
+			vector<unsigned int*> single(1, m_Pending[i].Keys);
+			vector<size_t> singleSize(1, m_Pending[i].Size);
+			m_Batches++;
+			Reply(m_Pending[i], m_Task.SortBatch(m_Context, m_CommandQueue, single, singleSize));
+			continue;
+		}
+		if (!last) {
+			arrays.push_back(m_Pending[i].Keys);
+			sizes.push_back(m_Pending[i].Size);
+			members.push_back(i);
+		}
+		if (!arrays.empty() && (last || arrays.size() == SERVICE_MAX_BATCH)) {
+			m_Batches++;
+			bool sorted = m_Task.SortBatch(m_Context, m_CommandQueue, arrays, sizes);
+			for (size_t j = 0; j < members.size(); j++)
+				Reply(m_Pending[members[j]], sorted);
+			arrays.clear();
+			sizes.clear();
+			members.clear();
+		}
+	}
+	m_Pending.clear();
+
+	if (m_Requests >= SERVICE_STATS_INTERVAL)
+		PrintStatistics();
+}
+
+void CSortService::Reply(CRequest& Request, bool Success)
+{
+#ifndef _WIN32
+	if (Request.Keys)
+		munmap(Request.Keys, Request.Size * sizeof(unsigned int));
+	Request.Keys = NULL;
+
+	//a client that went away in the meantime is noticed on its next poll
+	int32_t status = Success ? 1 : 0;
+	send(Request.Client, &status, sizeof(status), MSG_NOSIGNAL);
+
+	Request.Latency.Stop();
+	m_Latencies.push_back(Request.Latency.GetElapsedMilliseconds());
+	m_Requests++;
+#endif
+}
+
+void CSortService::PrintStatistics()
+{
+	if (m_Requests == 0)
+		return;
+
+	sort(m_Latencies.begin(), m_Latencies.end());
+	size_t n = m_Latencies.size();
+	cout << "Served " << m_Requests << " requests in " << m_Batches << " launches (" << (double)m_Requests / max<size_t>(m_Batches, 1) << " per launch)";
+	cout << ", queue depth avg " << (double)m_QueueDepthSum / max<size_t>(m_Rounds, 1) << " max " << m_MaxQueueDepth << endl;
+	cout << "  latency p50: " << m_Latencies[n / 2] << " ms, p90: " << m_Latencies[n * 9 / 10] << " ms, p99: " << m_Latencies[n * 99 / 100];
+	cout << " ms, max: " << m_Latencies[n - 1] << " ms" << endl;
+
+	m_Requests = m_Batches = m_Rounds = m_QueueDepthSum = m_MaxQueueDepth = 0;
+	m_Latencies.clear();
+}
+
+bool CSortService::Submit(const string& SocketPath, int SharedMemory, size_t Size)
+{
+#ifndef _WIN32
+	int connection = ConnectService(SocketPath);
+	if (connection < 0)
+		return false;
+
+	CSortRequestMessage message = { (uint64_t)Size, 0 };
+	int32_t status = 0;
+	bool sorted = SendRequest(connection, message, SharedMemory) &&
+		recv(connection, &status, sizeof(status), MSG_WAITALL) == (ssize_t)sizeof(status) && status == 1;
+	close(connection);
+	return sorted;
+#else
+	return false;
+#endif
+}
+
+bool CSortService::SortFile(const string& SocketPath, const string& InputFile, const string& OutputFile)
+{
+#ifndef _WIN32
+	ifstream input(InputFile.c_str(), ios::binary | ios::ate);
+	streamoff bytes = input ? (streamoff)input.tellg() : -1;
+	if (bytes <= 0 || bytes % sizeof(unsigned int) != 0) {
+		cerr << "Error: " << InputFile << " is missing, empty or not made of 32-bit keys" << endl;
+		return false;
+	}
+	input.seekg(0);
+
+	//an anonymous shared memory object, the name is gone as soon as it is opened
+	ostringstream name;
+	name << "/sort_client_" << getpid();
+	int sharedMemory = shm_open(name.str().c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (sharedMemory < 0) {
+		cerr << "Error: cannot create shared memory" << endl;
+		return false;
+	}
+	shm_unlink(name.str().c_str());
+	void* mapping = MAP_FAILED;
+	if (ftruncate(sharedMemory, bytes) == 0)
+		mapping = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, sharedMemory, 0);
+	if (mapping == MAP_FAILED) {
+		cerr << "Error: cannot map shared memory" << endl;
+		close(sharedMemory);
+		return false;
+	}
+
+	CTimer timer;
+	timer.Start();
+	input.read((char*)mapping, bytes);
+	bool sorted = input && Submit(SocketPath, sharedMemory, (size_t)bytes / sizeof(unsigned int));
+	if (sorted) {
+		ofstream output((OutputFile.empty() ? InputFile : OutputFile).c_str(), ios::binary | ios::trunc);
+		sorted = (bool)output.write((const char*)mapping, bytes);
+	}
+	timer.Stop();
+
+	munmap(mapping, bytes);
+	close(sharedMemory);
+	if (sorted)
+		cout << "Sorted " << bytes / sizeof(unsigned int) << " keys with the service in " << timer.GetElapsedMilliseconds() << " ms" << endl;
+	else
+		cerr << "Error: the sort service could not sort " << InputFile << endl;
+	return sorted;
+#else
+	cerr << "Error: the sort service needs Unix domain sockets, which are not available on this platform" << endl;
+	return false;
+#endif
+}
+
+bool CSortService::Stop(const string& SocketPath)
+{
+#ifndef _WIN32
+	int connection = ConnectService(SocketPath);
+	if (connection < 0)
+		return false;
+
+	CSortRequestMessage message = { 0, 1 };
+	bool sent = SendRequest(connection, message, -1);
+	close(connection);
+	return sent;
+#else
+	return false;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,90 @@
+/******************************************************************************
+						 .88888.   888888ba  dP     dP
+						 d8'   `88  88    `8b 88     88
+						 88        a88aaaa8P' 88     88
+						 88   YP88  88        88     88
+						 Y8.   .88  88        Y8.   .8P
+						 `88888'   dP        `Y88888P'
+
+						 a88888b.                                         dP   oo
+						 d8'   `88                                         88
+						 88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b.
+						 88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88
+						 Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88
+						 Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88
+						 88                                        .88
+						 dP                                    d8888P
+						 ******************************************************************************/
+
+#ifndef _CSORT_SERVICE_H
+#define _CSORT_SERVICE_H
+
+#include "CSortTask.h"
+
+#include "../Common/CTimer.h"
+
+#include <string>
+#include <vector>
+
+//! Long-running local sort daemon
+/*!
+	Owns the OpenCL context, the compiled kernels and the device buffers of a CSortTask, so clients do not pay for
+	context creation and the program build. Clients connect to a Unix domain socket and send the file descriptor of a
+	shared memory object (shm_open or memfd) holding the keys, which are sorted in place before the reply.
+
+	Small requests waiting at the same time are coalesced into one batched launch sequence (CSortTask::SortBatch),
+	bigger ones are sorted on their own. Queue depth and latency percentiles are reported periodically.
+*/
+class CSortService
+{
+public:
+	CSortService(CSortTask& Task, cl_context Context, cl_command_queue CommandQueue);
+
+	virtual ~CSortService();
+
+	//! Serve requests until a client asks to stop or the process gets SIGINT or SIGTERM
+	bool Run(const std::string& SocketPath);
+
+	//! Client side: sort the Size keys in the shared memory object SharedMemory, blocks until they are sorted
+	static bool Submit(const std::string& SocketPath, int SharedMemory, size_t Size);
+
+	//! Client side: sort the 32-bit keys of a file with the service, into the output file or in place if it is empty
+	static bool SortFile(const std::string& SocketPath, const std::string& InputFile, const std::string& OutputFile);
+
+	//! Client side: ask the service to shut down
+	static bool Stop(const std::string& SocketPath);
+
+protected:
+	struct CRequest
+	{
+		int				Client;
+		unsigned int*	Keys;
+		size_t			Size;
+		CTimer			Latency;
+	};
+
+	void Accept();
+	bool Receive(int Client);
+	void ProcessPending();
+	void Reply(CRequest& Request, bool Success);
+	void PrintStatistics();
+
+	CSortTask&				m_Task;
+	cl_context				m_Context;
+	cl_command_queue		m_CommandQueue;
+
+	int						m_Socket;
+	std::vector<int>		m_Clients;
+	std::vector<CRequest>	m_Pending;
+	bool					m_Stop;
+
+	// statistics since the last report: latencies in ms and the queue depth every round started with
+	size_t					m_Requests;
+	size_t					m_Batches;
+	size_t					m_Rounds;
+	std::vector<double>		m_Latencies;
+	size_t					m_QueueDepthSum;
+	size_t					m_MaxQueueDepth;
+};
+
+#endif // _CSORT_SERVICE_H
@@ -11,39 +11,101 @@ GPU Computing / GPGPU Praktikum source code.
 #include <math.h>
 #include <sstream>
 #include <cstring>
+#include <cstdio>
 #include <climits>
+#include <atomic>
+#include <future>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
 
 
 #define MERGESORT_SMALL_STRIDE 1024 * 64
-#define SSN_LIMIT 1024 * 512
 #define MERGE_LIMIT 1024 * 1024 * 2
+#define SAMPLESORT_MAX_BUCKETS 64
+#define SAMPLESORT_ELEMENTS_PER_ITEM 8
+#define RADIX_BITS 4
+#define RADIX_ELEMENTS_PER_ITEM 4
+#define BITONIC_KEYS_PER_ITEM 8
+#define VALIDATE_MAX_GROUPS 256
+#define EXTERNAL_MIN_BLOCK 64 * 1024
+#define POST_ELEMENTS_PER_ITEM 16
+#define COUNTING_MAX_RANGE 1024 * 1024
+#define COUNTING_LOCAL_BINS 2048
+#define CPU_BLOCK_KEYS (32 * 1024)
+#define CPU_INSERTION_KEYS 16
+#define CPU_MERGE_WAYS 16
+#define CPU_DEVICE_RUN_KEYS 16
+#define CPU_DEVICE_CHUNK_KEYS (4 * 1024)
+#define CPU_DEVICE_MERGE_KEYS (4 * 1024)
 
 ///////////////////////////////////////////////////////////////////////////////
 // CSortTask
 
-string g_kernelNames[4] = {
+string g_kernelNames[NUM_SORT_TASKS] = {
 	"Mergesort",
-	"SimpleSortingNetwork",
+	"OddEvenMergesort",
 	"BitonicMergesort",
+	"SampleSort",
+	"RadixSort",
+	"BitonicBlocked",
 };
 
 CSortTask::CSortTask(size_t ArraySize, size_t LocWorkSize[3])
-	: m_N(ArraySize), LocalWorkSize(),
-	m_hInput(NULL),
+	: m_N(ArraySize), m_WideIndex(false), LocalWorkSize(), m_StableMode(false), m_DeviceValidation(false), m_DeviceScheduling(false), m_InPlace(false),
+	m_Descending(false), m_KeyLo(0), m_KeyHi(32), m_Sentinel(UINT_MAX), m_hOutput(NULL), m_ExternalSize(0), m_ExternalCPU(false),
+	m_BlockedReference(false), m_PerfCounters(false), m_PerfTotal(m_Perf), m_PerfSort(m_Perf), m_PerfBlocks(m_Perf), m_PerfMerges(m_Perf), m_BandwidthReport(false), m_ProfileLaunches(false),
+	m_hInput(NULL), m_resultCPU(NULL), m_resultCPUPermutation(NULL), m_resultGPUPermutation(NULL),
 	m_dPingArray(NULL),
-	m_dPongArray(NULL),
+	m_dPongArray(NULL), m_SubgroupShuffle(0), m_CpuDevice(false), m_CpuVectorWidth(1), m_DeviceQueue(NULL), m_PersistentGroups(0), m_dBarrierCounters(NULL),
+	m_NumAsyncQueues(0), m_NextAsyncQueue(0), m_AsyncValid(true), m_dBatchBuffer(NULL), m_BatchCapacity(0),
+	m_PostSort(false), m_dPostRuns(NULL), m_dPostKeys(NULL), m_dPostValues(NULL), m_PostSortValid(true),
+	m_ResidentCapacity(0), m_ResidentSize(0), m_IncrementalBatches(0), m_IncrementalValid(true),
+	m_StringCount(0), m_dStringBytes(NULL), m_dStringOffsets(NULL), m_dStringPermutation(NULL), m_dStringSegments(NULL),
+	m_dStringCounters(NULL), m_StringCapacity(0), m_StringByteCapacity(0), m_StringRounds(0), m_StringResorted(0), m_StringsValid(true),
+	m_ColumnRows(0), m_dColumnCounters(NULL), m_dColumnRange(NULL), m_ColumnCapacity(0), m_ColumnsValid(true),
+	m_dSampleSortBucketIds(NULL), m_dSampleSortSegments(NULL), m_dSampleSortTiles(NULL), m_dSampleSortSplitters(NULL),
+	m_dSampleSortCounters(NULL), m_dSampleSortBucketStarts(NULL), m_dSampleSortSmallBuckets(NULL),
+	m_RangeDetection(false), m_dKeyRange(NULL), m_dCountingCounts(NULL),
+	m_dRadixCounters(NULL), m_ValidationSeed(0), m_dValidationInput(NULL), m_ScanCapacity(0),
 	m_Program(NULL),
-	m_MergesortStartKernel(NULL), m_MergesortGlobalSmallKernel(NULL), m_MergesortGlobalBigKernel(NULL),
-	m_SimpleSortingNetworkKernel(NULL), m_SimpleSortingNetworkLocalKernel(NULL),
-	m_BitonicGlobalKernel(NULL), m_BitonicLocalKernel(NULL), m_BitonicStartKernel(NULL)
+	m_MergesortStartKernel(NULL), m_MergesortGlobalSmallKernel(NULL), m_MergesortGlobalBigKernel(NULL), m_MergesortFlipKernel(NULL),
+	m_OddEvenStartKernel(NULL), m_OddEvenGlobalKernel(NULL),
+	m_BitonicStartKernel(NULL), m_BitonicGlobalKernel(NULL), m_BitonicLocalKernel(NULL),
+	m_BitonicSchedulerKernel(NULL), m_BitonicPersistentKernel(NULL),
+	m_BitonicShuffleStartKernel(NULL), m_BitonicShuffleMergeKernel(NULL),
+	m_BitonicBlockedStartKernel(NULL), m_BitonicBlockedMergeKernel(NULL), m_CpuChunksKernel(NULL), m_CpuMergeKernel(NULL),
+	m_SampleSortSplittersKernel(NULL), m_SampleSortClassifyKernel(NULL), m_SampleSortScatterKernel(NULL), m_SampleSortLocalKernel(NULL),
+	m_RangeMinMaxKernel(NULL), m_CountingHistogramKernel(NULL), m_CountingWriteKernel(NULL),
+	m_RadixInitValuesKernel(NULL), m_RadixHistogramKernel(NULL), m_RadixScatterKernel(NULL),
+	m_StringKeysKernel(NULL), m_StringTiesKernel(NULL), m_StringCompactKernel(NULL), m_ColumnsPackKernel(NULL),
+	m_ValidateFingerprintKernel(NULL), m_ValidateStablePermutationKernel(NULL),
+	m_MergeInsertKernel(NULL), m_PostRunHeadsKernel(NULL), m_PostCompactKernel(NULL), m_PostRunLengthsKernel(NULL), m_PostReduceKernel(NULL),
+	m_ScanLocalKernel(NULL), m_ScanAddKernel(NULL), m_BandwidthCopyKernel(NULL)
 {
 	m_N_padded = getPaddedSize(m_N);
+	m_WideIndex = m_N_padded > UINT_MAX;
 	LocalWorkSize[0] = LocWorkSize[0];
 	LocalWorkSize[1] = LocWorkSize[1];
 	LocalWorkSize[2] = LocWorkSize[2];
+	m_SampleSortBuckets = (unsigned int)min<size_t>(SAMPLESORT_MAX_BUCKETS, LocalWorkSize[0]);
+	for (int i = 0; i < NUM_SORT_TASKS; i++) {
+		m_resultGPU[i] = NULL;
+		m_deviceValid[i] = false;
+	}
+	m_hRunBuffers[0] = m_hRunBuffers[1] = NULL;
+	m_dRadixValues[0] = m_dRadixValues[1] = NULL;
+	m_dResident[0] = m_dResident[1] = NULL;
+	for (int i = 0; i < 2; i++)
+		m_dStringKeys[i] = m_dStringItems[i] = m_dStringPositions[i] = m_dStringFlags[i] = m_dColumnKeys[i] = m_dColumnItems[i] = NULL;
+	m_dValidationResults[0] = m_dValidationResults[1] = NULL;
 }
 
 CSortTask::~CSortTask()
@@ -53,34 +115,223 @@ CSortTask::~CSortTask()
 
 bool CSortTask::InitResources(cl_device_id Device, cl_context Context)
 {
-	//CPU resources
-	m_hInput = new unsigned int[m_N_padded];
-	m_resultCPU = new unsigned int[m_N_padded];
-
 	srand((unsigned int)time(NULL)); // To get each "time" another seed for rand()
-	//fill the array with some values
-	for (unsigned int i = 0; i < m_N; i++)
-		//m_hInput[i] = m_N - i;			// Use this for debugging. Use 1 or i or similar
-		m_hInput[i] = rand();
 
-	//pad the array with max value so we can sort arbitrarily long arrays, not only power of 2
-	for (size_t i = m_N; i < m_N_padded; i++)
-		m_hInput[i] = UINT_MAX;
+	//file mode: the keys come from the mapped file and are padded on the device, there is no CPU reference
+	if (!m_InputFile.empty()) {
+		if (m_ExternalSize > 0) {
+			//the runs are merged on the host
+			if (!m_Comparator.empty()) {
+				cerr << "Error: the external sort cannot merge with a custom comparator" << endl;
+				return false;
+			}
+			m_hRunBuffers[0] = m_HostPool.AllocateArray<unsigned int>(m_N);
+			m_hRunBuffers[1] = m_HostPool.AllocateArray<unsigned int>(m_N);
+		}
+		else if (!MapFiles())
+			return false;
+		if (!m_DeviceValidation) {
+			cout << "File mode: validating on the device" << endl;
+			m_DeviceValidation = true;
+		}
+	}
+	else {
+		//CPU resources
+		m_hInput = m_HostPool.AllocateArray<unsigned int>(m_N_padded);
+		m_resultCPU = m_HostPool.AllocateArray<unsigned int>(m_N_padded);
+		m_resultCPUPermutation = m_HostPool.AllocateArray<unsigned int>(m_N_padded);
+
+		//fill the array with some values
+		for (size_t i = 0; i < m_N; i++)
+			//m_hInput[i] = m_N - i;			// Use this for debugging. Use 1 or i or similar
+			m_hInput[i] = rand();
+
+		//pad the array with a value ordered last so we can sort arbitrarily long arrays, not only power of 2
+		for (size_t i = m_N; i < m_N_padded; i++)
+			m_hInput[i] = Sentinel();
+	}
+	m_ValidationSeed = rand();
+
+	//the CPU reference cannot evaluate custom comparators
+	if (!m_Comparator.empty() && !m_DeviceValidation) {
+		cout << "Custom comparator: validating on the device" << endl;
+		m_DeviceValidation = true;
+	}
 
 	//device resources
 	cl_int clError, clError2;
 	m_dPingArray = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N_padded, NULL, &clError2);
 	clError = clError2;
-	m_dPongArray = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N_padded, NULL, &clError2);
-	clError |= clError2;
+	if (m_InPlace) {
+		// the start kernels read and write the same tile, all other passes except the mergesort merges work in place
+		m_dPongArray = m_dPingArray;
+		clError |= clRetainMemObject(m_dPongArray);
+	}
+	else {
+		m_dPongArray = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N_padded, NULL, &clError2);
+		clError |= clError2;
+	}
 	V_RETURN_FALSE_CL(clError, "Error allocating device arrays");
 
+	//sample sort helper arrays, sized for the worst case: every open segment holds more than 2 * LocalWorkSize keys
+	size_t allBuckets = 2 * m_SampleSortBuckets - 1;
+	size_t maxSegments = m_N / (2 * LocalWorkSize[0]) + 1;
+	size_t maxTiles = m_N / (SAMPLESORT_ELEMENTS_PER_ITEM * LocalWorkSize[0]) + maxSegments;
+	size_t radixTiles = (m_N + RADIX_ELEMENTS_PER_ITEM * LocalWorkSize[0] - 1) / (RADIX_ELEMENTS_PER_ITEM * LocalWorkSize[0]);
+
+	//sample sort and radix sort need a second buffer and 32-bit indices, so they are skipped in the in-place mode and
+	//for 2^32 keys and more
+	if (!m_InPlace && !m_WideIndex) {
+		m_dSampleSortBucketIds = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uchar) * m_N, NULL, &clError2);
+		clError = clError2;
+		m_dSampleSortSegments = clCreateBuffer(Context, CL_MEM_READ_ONLY, sizeof(cl_uint4) * maxSegments, NULL, &clError2);
+		clError |= clError2;
+		m_dSampleSortTiles = clCreateBuffer(Context, CL_MEM_READ_ONLY, sizeof(cl_uint4) * maxTiles, NULL, &clError2);
+		clError |= clError2;
+		m_dSampleSortSplitters = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_SampleSortBuckets * maxSegments, NULL, &clError2);
+		clError |= clError2;
+		m_dSampleSortCounters = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * allBuckets * maxTiles, NULL, &clError2);
+		clError |= clError2;
+		m_dSampleSortBucketStarts = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * allBuckets * maxSegments, NULL, &clError2);
+		clError |= clError2;
+		m_dSampleSortSmallBuckets = clCreateBuffer(Context, CL_MEM_READ_ONLY, sizeof(cl_uint2) * allBuckets * maxSegments, NULL, &clError2);
+		clError |= clError2;
+		V_RETURN_FALSE_CL(clError, "Error allocating sample sort arrays");
+
+		//radix sort values and counters
+		m_dRadixValues[0] = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N, NULL, &clError2);
+		clError = clError2;
+		m_dRadixValues[1] = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N, NULL, &clError2);
+		clError |= clError2;
+		m_dRadixCounters = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * (1 << RADIX_BITS) * radixTiles, NULL, &clError2);
+		clError |= clError2;
+		V_RETURN_FALSE_CL(clError, "Error allocating radix sort arrays");
+	}
+
+	//key range and counting sort counters, the counting sort only pays off for ranges up to the array size
+	if (m_RangeDetection && !m_WideIndex) {
+		m_dKeyRange = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * 2, NULL, &clError2);
+		clError = clError2;
+		m_dCountingCounts = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * min<size_t>(COUNTING_MAX_RANGE, m_N), NULL, &clError2);
+		clError |= clError2;
+		V_RETURN_FALSE_CL(clError, "Error allocating counting sort arrays");
+	}
+
+	//device validation results, the input copy is only needed to check the stable permutation
+	m_dValidationResults[0] = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * 3, NULL, &clError2);
+	clError = clError2;
+	m_dValidationResults[1] = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * 3, NULL, &clError2);
+	clError |= clError2;
+	if (m_DeviceValidation && m_StableMode && !m_InPlace && !m_WideIndex) {
+		m_dValidationInput = clCreateBuffer(Context, CL_MEM_READ_ONLY, sizeof(cl_uint) * m_N, NULL, &clError2);
+		clError |= clError2;
+	}
+	V_RETURN_FALSE_CL(clError, "Error allocating validation arrays");
+
+	//block sums of every scan level (sample sort, radix sort and the run heads of the post-sort primitives)
+	if (!m_WideIndex && !ReserveScan(Context, max(max(allBuckets * maxTiles, (size_t)(1 << RADIX_BITS) * radixTiles), m_N + 1)))
+		return false;
+
 	//load and compile kernels with compileoptions
 	string programCode;
 
 	stringstream compileOptions;
 	compileOptions << "-cl-fast-relaxed-math" << " -D MAX_LOCAL_SIZE=" << LocalWorkSize[0];
+	compileOptions << " -D SAMPLESORT_BUCKETS=" << m_SampleSortBuckets;
+	compileOptions << " -D RADIX_BITS=" << RADIX_BITS << " -D RADIX_ELEMENTS_PER_ITEM=" << RADIX_ELEMENTS_PER_ITEM;
+	compileOptions << " -D BITONIC_KEYS_PER_ITEM=" << BITONIC_KEYS_PER_ITEM;
+	compileOptions << " -D POST_ELEMENTS_PER_ITEM=" << POST_ELEMENTS_PER_ITEM;
+	compileOptions << " -D COUNTING_LOCAL_BINS=" << COUNTING_LOCAL_BINS;
+	compileOptions << " -D CPU_DEVICE_RUN_KEYS=" << CPU_DEVICE_RUN_KEYS;
+
+	//64-bit indices only where they are needed, they cost registers and integer throughput
+	if (m_WideIndex) {
+		cout << "Using 64-bit indices for " << m_N_padded << " keys" << endl;
+		compileOptions << " -D WIDE_INDEX";
+	}
+
+	//CPU devices get the mergesort without local memory and barriers in the bitonic mergesort slot, with work-groups of
+	//the SIMD width the runtime vectorizes across
+	cl_device_type deviceType = CL_DEVICE_TYPE_GPU;
+	V_RETURN_FALSE_CL(clGetDeviceInfo(Device, CL_DEVICE_TYPE, sizeof(deviceType), &deviceType, NULL), "Error reading device type");
+	m_CpuDevice = (deviceType & CL_DEVICE_TYPE_CPU) != 0;
+	if (m_CpuDevice) {
+		cl_uint vectorWidth = 1;
+		V_RETURN_FALSE_CL(clGetDeviceInfo(Device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_INT, sizeof(vectorWidth), &vectorWidth, NULL), "Error reading vector width");
+		m_CpuVectorWidth = max<size_t>(1, vectorWidth);
+		if (!m_InPlace)
+			cout << "Using the CPU mergesort for bitonic mergesort (work-groups of " << m_CpuVectorWidth << ")" << endl;
+	}
+
+	//use subgroup shuffles for the small bitonic strides if the device supports them
+	size_t extensionsSize = 0;
+	V_RETURN_FALSE_CL(clGetDeviceInfo(Device, CL_DEVICE_EXTENSIONS, 0, NULL, &extensionsSize), "Error reading device extensions");
+	string extensions(extensionsSize, '\0');
+	V_RETURN_FALSE_CL(clGetDeviceInfo(Device, CL_DEVICE_EXTENSIONS, extensionsSize, &extensions[0], NULL), "Error reading device extensions");
+	if (m_WideIndex)
+		m_SubgroupShuffle = 0; // 32-bit indices only
+	else if (m_CpuDevice)
+		m_SubgroupShuffle = 0; // replaced by the CPU mergesort
+	else if (extensions.find("cl_khr_subgroup_shuffle") != string::npos && extensions.find("cl_khr_subgroups") != string::npos)
+		m_SubgroupShuffle = 1;
+	else if (extensions.find("cl_intel_subgroups") != string::npos)
+		m_SubgroupShuffle = 2;
+	if (m_SubgroupShuffle) {
+		cout << "Using subgroup shuffles for bitonic mergesort" << endl;
+		compileOptions << " -D SUBGROUP_SHUFFLE=" << m_SubgroupShuffle;
+	}
+
+	//single host call for the bitonic mergesort: device-side enqueue needs OpenCL 2.0 (optional again since 3.0),
+	//otherwise a persistent kernel with one work-group per compute unit so all of them are resident at the same time
+	if (m_DeviceScheduling) {
+		char version[128] = "";
+		int major = 1, minor = 2;
+		V_RETURN_FALSE_CL(clGetDeviceInfo(Device, CL_DEVICE_VERSION, sizeof(version), version, NULL), "Error reading device version");
+		sscanf(version, "OpenCL %d.%d", &major, &minor);
+#ifdef CL_VERSION_2_0
+		bool deviceEnqueue = major == 2;
+#ifdef CL_VERSION_3_0
+		if (major >= 3) {
+			cl_device_device_enqueue_capabilities capabilities = 0;
+			clGetDeviceInfo(Device, CL_DEVICE_DEVICE_ENQUEUE_CAPABILITIES, sizeof(capabilities), &capabilities, NULL);
+			deviceEnqueue = (capabilities & CL_DEVICE_QUEUE_SUPPORTED) != 0;
+		}
+#endif
+		if (deviceEnqueue) {
+			cl_queue_properties properties[] = {
+				CL_QUEUE_PROPERTIES, CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE | CL_QUEUE_ON_DEVICE | CL_QUEUE_ON_DEVICE_DEFAULT, 0 };
+			m_DeviceQueue = clCreateCommandQueueWithProperties(Context, Device, properties, &clError);
+			V_RETURN_FALSE_CL(clError, "Error creating the device queue");
+			cout << "Using device-side enqueue for bitonic mergesort" << endl;
+			compileOptions << (major >= 3 ? " -cl-std=CL3.0" : " -cl-std=CL2.0") << " -D DEVICE_ENQUEUE";
+		}
+#endif
+		if (!m_DeviceQueue) {
+			cl_uint computeUnits = 1;
+			V_RETURN_FALSE_CL(clGetDeviceInfo(Device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL), "Error reading compute units");
+			m_PersistentGroups = max<size_t>(1, min<size_t>(computeUnits, m_N_padded / (2 * LocalWorkSize[0])));
+			cl_uint counters[2] = { 0, 0 };
+			m_dBarrierCounters = clCreateBuffer(Context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(counters), counters, &clError);
+			V_RETURN_FALSE_CL(clError, "Error allocating barrier counters");
+			cout << "Using a persistent kernel for bitonic mergesort (" << m_PersistentGroups << " work-groups)" << endl;
+		}
+	}
+	//in-order queues of their own, so independent sorts overlap on the device
+	for (unsigned int i = 0; i < m_NumAsyncQueues; i++) {
+		cl_command_queue queue = clCreateCommandQueue(Context, Device, 0, &clError);
+		V_RETURN_FALSE_CL(clError, "Error creating command queue for asynchronous sorts");
+		m_AsyncQueues.push_back(queue);
+	}
+	if (m_Descending)
+		compileOptions << " -D SORT_DESCENDING";
+	if (m_KeyLo != 0 || m_KeyHi != 32)
+		compileOptions << " -D KEY_LO=" << m_KeyLo << " -D KEY_HI=" << m_KeyHi;
 	CLUtil::LoadProgramSourceToMemory("Sort.cl", programCode);
+	if (!m_Comparator.empty()) {
+		//the comparator is an expression, so it is put in front of the source instead of passing it as an option
+		programCode = "#define SORT_COMPARATOR(a, b) (" + m_Comparator + ")\n" + programCode;
+		compileOptions << " -D SORT_SENTINEL=" << m_Sentinel << "u";
+	}
 	m_Program = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode, compileOptions.str());
 	if (m_Program == nullptr) return false;
 
@@ -91,12 +342,14 @@ bool CSortTask::InitResources(cl_device_id Device, cl_context Context)
 	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_MergesortGlobalBig.");
 	m_MergesortStartKernel = clCreateKernel(m_Program, "Sort_MergesortStart", &clError); //local variant to start with
 	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_MergesortStart.");
+	m_MergesortFlipKernel = clCreateKernel(m_Program, "Sort_MergesortFlip", &clError); //in-place merge
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_MergesortFlip.");
 
 	//create kernels for simple sorting network
-	m_SimpleSortingNetworkKernel = clCreateKernel(m_Program, "Sort_SimpleSortingNetwork", &clError);
-	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_SimpleSortingNetwork.");
-	m_SimpleSortingNetworkLocalKernel = clCreateKernel(m_Program, "Sort_SimpleSortingNetworkLocal", &clError);
-	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_SimpleSortingNetworkLocal.");
+	m_OddEvenStartKernel = clCreateKernel(m_Program, "Sort_OddEvenMergesortStart", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_OddEvenMergesortStart.");
+	m_OddEvenGlobalKernel = clCreateKernel(m_Program, "Sort_OddEvenMergesortGlobal", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_OddEvenMergesortGlobal.");
 
 	//create kernels for bitonic sort
 	m_BitonicStartKernel = clCreateKernel(m_Program, "Sort_BitonicMergesortStart", &clError);
@@ -105,6 +358,91 @@ bool CSortTask::InitResources(cl_device_id Device, cl_context Context)
 	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_BitonicMergesortGlobal.");
 	m_BitonicLocalKernel = clCreateKernel(m_Program, "Sort_BitonicMergesortLocal", &clError);
 	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_BitonicMergesortLocal.");
+	if (m_DeviceQueue) {
+		m_BitonicSchedulerKernel = clCreateKernel(m_Program, "Sort_BitonicScheduler", &clError);
+		V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_BitonicScheduler.");
+	}
+	m_BitonicPersistentKernel = clCreateKernel(m_Program, "Sort_BitonicPersistent", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_BitonicPersistent.");
+	if (m_SubgroupShuffle) {
+		m_BitonicShuffleStartKernel = clCreateKernel(m_Program, "Sort_BitonicShuffleStart", &clError);
+		V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_BitonicShuffleStart.");
+		m_BitonicShuffleMergeKernel = clCreateKernel(m_Program, "Sort_BitonicShuffleMerge", &clError);
+		V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_BitonicShuffleMerge.");
+	}
+	m_BitonicBlockedStartKernel = clCreateKernel(m_Program, "Sort_BitonicBlockedStart", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_BitonicBlockedStart.");
+	m_BitonicBlockedMergeKernel = clCreateKernel(m_Program, "Sort_BitonicBlockedMerge", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_BitonicBlockedMerge.");
+	m_CpuChunksKernel = clCreateKernel(m_Program, "Sort_CpuChunks", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_CpuChunks.");
+	m_CpuMergeKernel = clCreateKernel(m_Program, "Sort_CpuMerge", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_CpuMerge.");
+
+	//create kernels for sample sort
+	m_SampleSortSplittersKernel = clCreateKernel(m_Program, "Sort_SampleSortSplitters", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_SampleSortSplitters.");
+	m_SampleSortClassifyKernel = clCreateKernel(m_Program, "Sort_SampleSortClassify", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_SampleSortClassify.");
+	m_SampleSortScatterKernel = clCreateKernel(m_Program, "Sort_SampleSortScatter", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_SampleSortScatter.");
+	m_SampleSortLocalKernel = clCreateKernel(m_Program, "Sort_SampleSortLocal", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_SampleSortLocal.");
+
+	//create kernels for radix sort
+	m_RangeMinMaxKernel = clCreateKernel(m_Program, "Range_MinMax", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Range_MinMax.");
+	m_CountingHistogramKernel = clCreateKernel(m_Program, "Sort_CountingHistogram", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_CountingHistogram.");
+	m_CountingWriteKernel = clCreateKernel(m_Program, "Sort_CountingWrite", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_CountingWrite.");
+	m_RadixInitValuesKernel = clCreateKernel(m_Program, "Sort_RadixInitValues", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_RadixInitValues.");
+	m_RadixHistogramKernel = clCreateKernel(m_Program, "Sort_RadixHistogram", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_RadixHistogram.");
+	m_RadixScatterKernel = clCreateKernel(m_Program, "Sort_RadixScatter", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_RadixScatter.");
+
+	//create kernels for the string sort
+	m_StringKeysKernel = clCreateKernel(m_Program, "String_Keys", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: String_Keys.");
+	m_StringTiesKernel = clCreateKernel(m_Program, "String_Ties", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: String_Ties.");
+	m_StringCompactKernel = clCreateKernel(m_Program, "String_Compact", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: String_Compact.");
+
+	//create kernel for the multi-column sort
+	m_ColumnsPackKernel = clCreateKernel(m_Program, "Columns_Pack", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Columns_Pack.");
+
+	//create kernels for the device validation
+	m_ValidateFingerprintKernel = clCreateKernel(m_Program, "Validate_Fingerprint", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Validate_Fingerprint.");
+	m_ValidateStablePermutationKernel = clCreateKernel(m_Program, "Validate_StablePermutation", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Validate_StablePermutation.");
+
+	//create kernel for the incremental insert
+	m_MergeInsertKernel = clCreateKernel(m_Program, "Sort_MergeInsert", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Sort_MergeInsert.");
+
+	//create kernels for the post-sort primitives
+	m_PostRunHeadsKernel = clCreateKernel(m_Program, "Post_RunHeads", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Post_RunHeads.");
+	m_PostCompactKernel = clCreateKernel(m_Program, "Post_Compact", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Post_Compact.");
+	m_PostRunLengthsKernel = clCreateKernel(m_Program, "Post_RunLengths", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Post_RunLengths.");
+	m_PostReduceKernel = clCreateKernel(m_Program, "Post_ReduceByKey", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Post_ReduceByKey.");
+
+	//create kernels for the prefix sum
+	m_ScanLocalKernel = clCreateKernel(m_Program, "Scan_ExclusiveLocal", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Scan_ExclusiveLocal.");
+	m_ScanAddKernel = clCreateKernel(m_Program, "Scan_AddBlockSums", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Scan_AddBlockSums.");
+
+	m_BandwidthCopyKernel = clCreateKernel(m_Program, "Bandwidth_Copy", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Bandwidth_Copy.");
 
 	return true;
 }
@@ -112,44 +450,265 @@ bool CSortTask::InitResources(cl_device_id Device, cl_context Context)
 void CSortTask::ReleaseResources()
 {
 	// host resources
-	SAFE_DELETE_ARRAY(m_hInput);
-	SAFE_DELETE_ARRAY(m_resultCPU);
-	for (int i = 0; i < 3; i++)
-		SAFE_DELETE_ARRAY(m_resultGPU[i]);
+	if (!m_InputFile.empty())
+		UnmapFiles();
+	else
+		SAFE_POOL_FREE(m_HostPool, m_hInput);
+	SAFE_POOL_FREE(m_HostPool, m_hRunBuffers[0]);
+	SAFE_POOL_FREE(m_HostPool, m_hRunBuffers[1]);
+	SAFE_POOL_FREE(m_HostPool, m_resultCPU);
+	m_Perf.Close();
+	SAFE_POOL_FREE(m_HostPool, m_resultCPUPermutation);
+	SAFE_POOL_FREE(m_HostPool, m_resultGPUPermutation);
+	for (int i = 0; i < NUM_SORT_TASKS; i++)
+		SAFE_POOL_FREE(m_HostPool, m_resultGPU[i]);
 
 	// device resources
 	SAFE_RELEASE_MEMOBJECT(m_dPingArray);
 	SAFE_RELEASE_MEMOBJECT(m_dPongArray);
+	SAFE_RELEASE_MEMOBJECT(m_dSampleSortBucketIds);
+	SAFE_RELEASE_MEMOBJECT(m_dSampleSortSegments);
+	SAFE_RELEASE_MEMOBJECT(m_dSampleSortTiles);
+	SAFE_RELEASE_MEMOBJECT(m_dSampleSortSplitters);
+	SAFE_RELEASE_MEMOBJECT(m_dSampleSortCounters);
+	SAFE_RELEASE_MEMOBJECT(m_dSampleSortBucketStarts);
+	SAFE_RELEASE_MEMOBJECT(m_dSampleSortSmallBuckets);
+	SAFE_RELEASE_MEMOBJECT(m_dRadixValues[0]);
+	SAFE_RELEASE_MEMOBJECT(m_dRadixValues[1]);
+	SAFE_RELEASE_MEMOBJECT(m_dRadixCounters);
+	SAFE_RELEASE_MEMOBJECT(m_dValidationResults[0]);
+	SAFE_RELEASE_MEMOBJECT(m_dValidationResults[1]);
+	SAFE_RELEASE_MEMOBJECT(m_dValidationInput);
+	SAFE_RELEASE_MEMOBJECT(m_dBarrierCounters);
+	SAFE_RELEASE_MEMOBJECT(m_dBatchBuffer);
+	m_BatchCapacity = 0;
+	SAFE_RELEASE_MEMOBJECT(m_dKeyRange);
+	SAFE_RELEASE_MEMOBJECT(m_dCountingCounts);
+	SAFE_RELEASE_MEMOBJECT(m_dResident[0]);
+	SAFE_RELEASE_MEMOBJECT(m_dResident[1]);
+	m_ResidentCapacity = m_ResidentSize = 0;
+	SAFE_RELEASE_MEMOBJECT(m_dStringBytes);
+	SAFE_RELEASE_MEMOBJECT(m_dStringOffsets);
+	SAFE_RELEASE_MEMOBJECT(m_dStringPermutation);
+	SAFE_RELEASE_MEMOBJECT(m_dStringSegments);
+	SAFE_RELEASE_MEMOBJECT(m_dStringCounters);
+	for (int i = 0; i < 2; i++) {
+		SAFE_RELEASE_MEMOBJECT(m_dStringKeys[i]);
+		SAFE_RELEASE_MEMOBJECT(m_dStringItems[i]);
+		SAFE_RELEASE_MEMOBJECT(m_dStringPositions[i]);
+		SAFE_RELEASE_MEMOBJECT(m_dStringFlags[i]);
+	}
+	m_StringCapacity = m_StringByteCapacity = 0;
+	for (size_t i = 0; i < m_dColumns.size(); i++)
+		SAFE_RELEASE_MEMOBJECT(m_dColumns[i]);
+	m_dColumns.clear();
+	SAFE_RELEASE_MEMOBJECT(m_dColumnKeys[0]);
+	SAFE_RELEASE_MEMOBJECT(m_dColumnKeys[1]);
+	SAFE_RELEASE_MEMOBJECT(m_dColumnItems[0]);
+	SAFE_RELEASE_MEMOBJECT(m_dColumnItems[1]);
+	SAFE_RELEASE_MEMOBJECT(m_dColumnCounters);
+	SAFE_RELEASE_MEMOBJECT(m_dColumnRange);
+	m_ColumnCapacity = 0;
+	SAFE_RELEASE_MEMOBJECT(m_dPostRuns);
+	SAFE_RELEASE_MEMOBJECT(m_dPostKeys);
+	SAFE_RELEASE_MEMOBJECT(m_dPostValues);
+	if (m_DeviceQueue) {
+		clReleaseCommandQueue(m_DeviceQueue);
+		m_DeviceQueue = NULL;
+	}
+	for (size_t i = 0; i < m_AsyncQueues.size(); i++) {
+		clFinish(m_AsyncQueues[i]);
+		clReleaseCommandQueue(m_AsyncQueues[i]);
+	}
+	m_AsyncQueues.clear();
+	for (size_t i = 0; i < m_dScanBlockSums.size(); i++)
+		SAFE_RELEASE_MEMOBJECT(m_dScanBlockSums[i]);
+	m_dScanBlockSums.clear();
+	m_ScanCapacity = 0;
 
 	SAFE_RELEASE_KERNEL(m_MergesortGlobalBigKernel);
 	SAFE_RELEASE_KERNEL(m_MergesortGlobalSmallKernel);
 	SAFE_RELEASE_KERNEL(m_MergesortStartKernel);
-	SAFE_RELEASE_KERNEL(m_SimpleSortingNetworkKernel);
-	SAFE_RELEASE_KERNEL(m_SimpleSortingNetworkLocalKernel);
+	SAFE_RELEASE_KERNEL(m_MergesortFlipKernel);
+	SAFE_RELEASE_KERNEL(m_OddEvenStartKernel);
+	SAFE_RELEASE_KERNEL(m_OddEvenGlobalKernel);
 	SAFE_RELEASE_KERNEL(m_BitonicStartKernel);
 	SAFE_RELEASE_KERNEL(m_BitonicGlobalKernel);
 	SAFE_RELEASE_KERNEL(m_BitonicLocalKernel);
+	SAFE_RELEASE_KERNEL(m_BitonicSchedulerKernel);
+	SAFE_RELEASE_KERNEL(m_BitonicPersistentKernel);
+	SAFE_RELEASE_KERNEL(m_BitonicShuffleStartKernel);
+	SAFE_RELEASE_KERNEL(m_BitonicShuffleMergeKernel);
+	SAFE_RELEASE_KERNEL(m_BitonicBlockedStartKernel);
+	SAFE_RELEASE_KERNEL(m_BitonicBlockedMergeKernel);
+	SAFE_RELEASE_KERNEL(m_CpuChunksKernel);
+	SAFE_RELEASE_KERNEL(m_CpuMergeKernel);
+	SAFE_RELEASE_KERNEL(m_SampleSortSplittersKernel);
+	SAFE_RELEASE_KERNEL(m_SampleSortClassifyKernel);
+	SAFE_RELEASE_KERNEL(m_SampleSortScatterKernel);
+	SAFE_RELEASE_KERNEL(m_SampleSortLocalKernel);
+	SAFE_RELEASE_KERNEL(m_RangeMinMaxKernel);
+	SAFE_RELEASE_KERNEL(m_CountingHistogramKernel);
+	SAFE_RELEASE_KERNEL(m_CountingWriteKernel);
+	SAFE_RELEASE_KERNEL(m_RadixInitValuesKernel);
+	SAFE_RELEASE_KERNEL(m_RadixHistogramKernel);
+	SAFE_RELEASE_KERNEL(m_RadixScatterKernel);
+	SAFE_RELEASE_KERNEL(m_StringKeysKernel);
+	SAFE_RELEASE_KERNEL(m_StringTiesKernel);
+	SAFE_RELEASE_KERNEL(m_StringCompactKernel);
+	SAFE_RELEASE_KERNEL(m_ColumnsPackKernel);
+	SAFE_RELEASE_KERNEL(m_ValidateFingerprintKernel);
+	SAFE_RELEASE_KERNEL(m_ValidateStablePermutationKernel);
+	SAFE_RELEASE_KERNEL(m_MergeInsertKernel);
+	SAFE_RELEASE_KERNEL(m_PostRunHeadsKernel);
+	SAFE_RELEASE_KERNEL(m_PostCompactKernel);
+	SAFE_RELEASE_KERNEL(m_PostRunLengthsKernel);
+	SAFE_RELEASE_KERNEL(m_PostReduceKernel);
+	SAFE_RELEASE_KERNEL(m_ScanLocalKernel);
+	SAFE_RELEASE_KERNEL(m_ScanAddKernel);
+	SAFE_RELEASE_KERNEL(m_BandwidthCopyKernel);
 
 	SAFE_RELEASE_PROGRAM(m_Program);
 }
 
 size_t CSortTask::getPaddedSize(size_t n)
 {
-	unsigned int log2val = (unsigned int)ceil(log((float)n) / log(2.f));
-	return (size_t)pow(2, log2val);
+	// next power of two, in integers so it stays exact beyond 2^24 (float) and 2^32
+	size_t padded = 1;
+	while (padded < n)
+		padded <<= 1;
+	return padded;
+}
+
+cl_int CSortTask::SetIndexArg(cl_kernel Kernel, cl_uint Index, size_t Value)
+{
+	if (m_WideIndex) {
+		cl_ulong value = Value;
+		return clSetKernelArg(Kernel, Index, sizeof(cl_ulong), (void *)&value);
+	}
+	cl_uint value = (cl_uint)Value;
+	return clSetKernelArg(Kernel, Index, sizeof(cl_uint), (void *)&value);
+}
+
+cl_int CSortTask::EnqueueSortKernel(cl_command_queue CommandQueue, cl_kernel Kernel, const size_t* GlobalWorkSize, const size_t* LocalWorkSize,
+	size_t Keys, bool GlobalStage)
+{
+	if (!m_ProfileLaunches)
+		return clEnqueueNDRangeKernel(CommandQueue, Kernel, 1, NULL, GlobalWorkSize, LocalWorkSize, 0, NULL, NULL);
+
+	// one key read and written per key
+	CKernelLaunch launch = { Kernel, NULL, 2 * Keys * sizeof(cl_uint), GlobalStage };
+	cl_int clError = clEnqueueNDRangeKernel(CommandQueue, Kernel, 1, NULL, GlobalWorkSize, LocalWorkSize, 0, NULL, &launch.Event);
+	if (clError == CL_SUCCESS)
+		m_KernelLaunches.push_back(launch);
+	return clError;
+}
+
+bool CSortTask::MapFiles()
+{
+#ifndef _WIN32
+	size_t bytes = m_N * sizeof(cl_uint);
+	bool inPlace = m_OutputFile.empty();
+
+	// the keys are read once front to back when they are copied to the device, and written back the same way
+	int input = open(m_InputFile.c_str(), inPlace ? O_RDWR : O_RDONLY);
+	if (input < 0) {
+		cerr << "Error: cannot open " << m_InputFile << endl;
+		return false;
+	}
+	void* mapping = mmap(NULL, bytes, inPlace ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, input, 0);
+	close(input);
+	if (mapping == MAP_FAILED) {
+		cerr << "Error: cannot map " << m_InputFile << endl;
+		return false;
+	}
+	madvise(mapping, bytes, MADV_SEQUENTIAL);
+	m_hInput = (unsigned int*)mapping;
+
+	if (inPlace) {
+		m_hOutput = m_hInput;
+		return true;
+	}
+
+	int output = open(m_OutputFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (output < 0 || ftruncate(output, bytes) != 0) {
+		cerr << "Error: cannot create " << m_OutputFile << endl;
+		if (output >= 0) close(output);
+		return false;
+	}
+	mapping = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, output, 0);
+	close(output);
+	if (mapping == MAP_FAILED) {
+		cerr << "Error: cannot map " << m_OutputFile << endl;
+		return false;
+	}
+	madvise(mapping, bytes, MADV_SEQUENTIAL);
+	m_hOutput = (unsigned int*)mapping;
+	return true;
+#else
+	cerr << "Error: sorting files needs mmap, which is not available on this platform" << endl;
+	return false;
+#endif
+}
+
+void CSortTask::UnmapFiles()
+{
+#ifndef _WIN32
+	size_t bytes = m_N * sizeof(cl_uint);
+	if (m_hOutput && m_hOutput != m_hInput)
+		munmap(m_hOutput, bytes);
+	if (m_hInput)
+		munmap(m_hInput, bytes);
+#endif
+	m_hInput = m_hOutput = NULL;
 }
 
 void CSortTask::ComputeGPU(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
 {
+	// only the recommended sort in file mode
+	if (!m_InputFile.empty()) {
+		SortFile(Context, CommandQueue, LocalWorkSize);
+		return;
+	}
+
 	// Execute Tasks
 	ExecuteTask(Context, CommandQueue, LocalWorkSize, 0);
 	ExecuteTask(Context, CommandQueue, LocalWorkSize, 1);
 	ExecuteTask(Context, CommandQueue, LocalWorkSize, 2);
+	ExecuteTask(Context, CommandQueue, LocalWorkSize, 3);
+	ExecuteTask(Context, CommandQueue, LocalWorkSize, 4);
+	// post-sort primitives on the keys and the permutation of the radix sort, if it ran
+	if (m_PostSort && m_resultGPUPermutation != NULL)
+		TestPostSort(Context, CommandQueue);
+	ExecuteTask(Context, CommandQueue, LocalWorkSize, 5);
 
 	// Test Performance
 	TestPerformance(Context, CommandQueue, LocalWorkSize, 0);
 	TestPerformance(Context, CommandQueue, LocalWorkSize, 1);
 	TestPerformance(Context, CommandQueue, LocalWorkSize, 2);
+	TestPerformance(Context, CommandQueue, LocalWorkSize, 3);
+	TestPerformance(Context, CommandQueue, LocalWorkSize, 4);
+	TestPerformance(Context, CommandQueue, LocalWorkSize, 5);
+
+	// how close the bitonic and mergesort kernels get to the peak bandwidth
+	if (m_BandwidthReport)
+		ReportBandwidth(Context, CommandQueue, LocalWorkSize);
+
+	// independent sorts in flight at once
+	if (!m_AsyncQueues.empty())
+		TestAsync(Context);
+
+	// batches merged into a resident set, compared to the result of the bitonic mergesort
+	if (m_IncrementalBatches > 0 && !m_WideIndex)
+		TestIncremental(Context, CommandQueue);
+
+	// random strings, compared to a stable sort on the host (whole keys only)
+	if (m_StringCount > 0 && m_Comparator.empty() && m_KeyHi - m_KeyLo == 32)
+		TestStrings(Context, CommandQueue);
+
+	// random table, compared to a stable sort on the host (whole keys only)
+	if (m_ColumnRows > 0 && m_Comparator.empty() && m_KeyHi - m_KeyLo == 32)
+		TestColumns(Context, CommandQueue);
 }
 
 void CSortTask::ComputeCPU()
@@ -157,6 +716,18 @@ void CSortTask::ComputeCPU()
 	unsigned int nIterations = 1;
 	double ms;
 
+	// the results are checked on the device, no reference sort needed
+	if (m_DeviceValidation) {
+		cout << " skipped, validating on the device " << endl;
+		return;
+	}
+
+	// hardware counters count the calling thread, so they are opened here
+	if (m_PerfCounters && !m_Perf.IsOpen() && !m_Perf.Open())
+		cout << " hardware counters unavailable: " << m_Perf.GetError() << endl;
+	m_PerfTotal.Reset();
+	m_PerfTotal.Start();
+
 	//CTimer timer;
 	//copy(m_hInput, m_hInput + m_N_padded, m_resultCPU); // if we want to compare to a std lib sorting implementation
 	//cout << endl << " std:sort " << endl;
@@ -172,15 +743,83 @@ void CSortTask::ComputeCPU()
 
 	CTimer timer2;
 	cout << " own mergesort " << endl;
+	m_PerfSort.Reset();
+	m_PerfSort.Start();
 	timer2.Start();
 	for (unsigned int j = 0; j < nIterations; j++) {
 		Mergesort();
 	}
 
 	timer2.Stop();
+	m_PerfSort.Stop();
 
 	ms = timer2.GetElapsedMilliseconds() / double(nIterations);
 	cout << "  average time: " << ms << " ms, throughput: " << 1.0e-3 * (double)m_N / ms << " Melem/s" << endl;
+	if (m_PerfSort.IsOpen()) {
+		cout << "  ";
+		m_PerfSort.Print(cout, m_N * nIterations);
+	}
+
+	// blocks sorted in cache and merged 16 ways per pass, checked against the plain mergesort. A second full sort,
+	// so only on request
+	if (m_BlockedReference) {
+		unsigned int* blocked = m_HostPool.AllocateArray<unsigned int>(m_N_padded);
+		CTimer timer4;
+		cout << " own cache-blocked mergesort " << endl;
+		m_PerfBlocks.Reset();
+		m_PerfMerges.Reset();
+		m_PerfSort.Reset();
+		m_PerfSort.Start();
+		timer4.Start();
+		for (unsigned int j = 0; j < nIterations; j++) {
+			MergesortBlocked(m_hInput, blocked, m_N_padded);
+		}
+
+		timer4.Stop();
+		m_PerfSort.Stop();
+
+		ms = timer4.GetElapsedMilliseconds() / double(nIterations);
+		cout << "  average time: " << ms << " ms, throughput: " << 1.0e-3 * (double)m_N / ms << " Melem/s" << endl;
+		if (m_PerfSort.IsOpen()) {
+			cout << "  ";
+			m_PerfSort.Print(cout, m_N * nIterations);
+			cout << "   blocks, ";
+			m_PerfBlocks.Print(cout, m_N * nIterations);
+			cout << "   merge passes, ";
+			m_PerfMerges.Print(cout, m_N * nIterations);
+		}
+		if (memcmp(blocked, m_resultCPU, m_N_padded * sizeof(unsigned int)) != 0)
+			cout << "Cache-blocked mergesort differs from the mergesort! INVALID ORDER!" << endl;
+		m_HostPool.Free(blocked);
+	}
+
+	// the stable variant also moves the original index of every key along
+	if (m_StableMode) {
+		CTimer timer3;
+		cout << " own stable mergesort (key + index)" << endl;
+		m_PerfSort.Reset();
+		m_PerfSort.Start();
+		timer3.Start();
+		for (unsigned int j = 0; j < nIterations; j++) {
+			MergesortStable();
+		}
+
+		timer3.Stop();
+		m_PerfSort.Stop();
+
+		ms = timer3.GetElapsedMilliseconds() / double(nIterations);
+		cout << "  average time: " << ms << " ms, throughput: " << 1.0e-3 * (double)m_N / ms << " Melem/s" << endl;
+		if (m_PerfSort.IsOpen()) {
+			cout << "  ";
+			m_PerfSort.Print(cout, m_N * nIterations);
+		}
+	}
+
+	m_PerfTotal.Stop();
+	if (m_PerfTotal.IsOpen()) {
+		cout << " all CPU sorts, ";
+		m_PerfTotal.Print(cout, m_N);
+	}
 
 	// Check CPU implementation
 	// ValidateCPU();
@@ -188,40 +827,200 @@ void CSortTask::ComputeCPU()
 
 void CSortTask::Mergesort()
 {
-	//temporary buffer as an helper array
-	unsigned int* tmpBuffer = new unsigned int[m_N_padded];
-	memcpy(tmpBuffer, m_hInput, m_N_padded * sizeof(unsigned int));
-	for (unsigned int stride = 2; stride <= m_N_padded; stride *= 2) {
-		for (unsigned int i = 0; i < m_N_padded; i += stride) {
-			unsigned int middle = i + (stride / 2);
-			unsigned int left = i, right = middle;
-			unsigned int rightBoundary = min(i + stride, (unsigned int)m_N_padded);
-			for (unsigned int j = i; j < rightBoundary; j++) {
+	Mergesort(m_hInput, m_resultCPU, m_N_padded);
+}
+
+void CSortTask::Mergesort(const unsigned int* Input, unsigned int* Result, size_t Size)
+{
+	//temporary buffer as an helper array, Input and Result may be the same array
+	unsigned int* tmpBuffer = m_HostPool.AllocateArray<unsigned int>(Size);
+	unsigned int* output = Result;
+	memcpy(tmpBuffer, Input, Size * sizeof(unsigned int));
+	for (size_t stride = 2; stride / 2 < Size; stride *= 2) {
+		for (size_t i = 0; i < Size; i += stride) {
+			size_t middle = min(i + (stride / 2), Size);
+			size_t left = i, right = middle;
+			size_t rightBoundary = min(i + stride, Size);
+			for (size_t j = i; j < rightBoundary; j++) {
+				if (left < middle &&
+					(right == rightBoundary || !SortLess(tmpBuffer[right], tmpBuffer[left]))) {
+					output[j] = tmpBuffer[left];
+					left++;
+				}
+				else {
+					output[j] = tmpBuffer[right];
+					right++;
+				}
+			}
+		}
+		swap(output, tmpBuffer);
+	}
+	// the last pass wrote to tmpBuffer (swapped), copy it over if that is not the result array
+	if (tmpBuffer != Result) {
+		memcpy(Result, tmpBuffer, Size * sizeof(unsigned int));
+		swap(output, tmpBuffer);
+	}
+
+	// back to the pool for the next call
+	m_HostPool.Free(output);
+}
+
+void CSortTask::MergesortBlocked(const unsigned int* Input, unsigned int* Result, size_t Size)
+{
+	//merge passes needed after sorting the blocks, the blocks go to the scratch array if their number is odd, so the
+	//last pass ends in Result without a copy. Input and Result may be the same array
+	size_t passes = 0;
+	for (size_t runs = (Size + CPU_BLOCK_KEYS - 1) / CPU_BLOCK_KEYS; runs > 1; runs = (runs + CPU_MERGE_WAYS - 1) / CPU_MERGE_WAYS)
+		passes++;
+	unsigned int* mergeScratch = passes > 0 ? m_HostPool.AllocateArray<unsigned int>(Size) : NULL;
+	unsigned int* blockScratch = m_HostPool.AllocateArray<unsigned int>(CPU_BLOCK_KEYS);
+	unsigned int* src = (passes % 2 == 1) ? mergeScratch : Result;
+	unsigned int* dst = (passes % 2 == 1) ? Result : mergeScratch;
+
+	//the keys are sorted as their OrderCode, so all comparisons are plain unsigned ones. Every block is sorted while it
+	//is in the cache
+	m_PerfBlocks.Start();
+	for (size_t i = 0; i < Size; i++)
+		src[i] = OrderCode(Input[i]);
+	for (size_t i = 0; i < Size; i += CPU_BLOCK_KEYS)
+		SortBlock(src + i, blockScratch, min<size_t>(CPU_BLOCK_KEYS, Size - i));
+	m_PerfBlocks.Stop();
+
+	//every pass merges CPU_MERGE_WAYS runs into one, streaming the whole array through memory once. The last one decodes
+	m_PerfMerges.Start();
+	for (size_t runSize = CPU_BLOCK_KEYS; runSize < Size; runSize *= CPU_MERGE_WAYS) {
+		MergeMultiway(src, dst, Size, runSize, runSize * CPU_MERGE_WAYS >= Size);
+		swap(src, dst);
+	}
+	m_PerfMerges.Stop();
+	if (passes == 0)
+		for (size_t i = 0; i < Size; i++)
+			Result[i] = OrderDecode(Result[i]);
+	m_HostPool.Free(mergeScratch);
+	m_HostPool.Free(blockScratch);
+}
+
+void CSortTask::SortBlock(unsigned int* Data, unsigned int* Scratch, size_t Size)
+{
+	//insertion sort of short runs, then branchless two-way merges between Data and Scratch
+	for (size_t begin = 0; begin < Size; begin += CPU_INSERTION_KEYS) {
+		size_t end = min<size_t>(begin + CPU_INSERTION_KEYS, Size);
+		for (size_t i = begin + 1; i < end; i++) {
+			unsigned int key = Data[i];
+			size_t j = i;
+			for (; j > begin && key < Data[j - 1]; j--)
+				Data[j] = Data[j - 1];
+			Data[j] = key;
+		}
+	}
+
+	unsigned int* src = Data;
+	unsigned int* dst = Scratch;
+	for (size_t stride = CPU_INSERTION_KEYS; stride < Size; stride *= 2) {
+		for (size_t i = 0; i < Size; i += 2 * stride) {
+			size_t middle = min(i + stride, Size), end = min(i + 2 * stride, Size);
+			size_t left = i, right = middle, j = i;
+			while (left < middle && right < end) {
+				unsigned int a = src[left], b = src[right];
+				bool takeRight = b < a;
+				dst[j++] = takeRight ? b : a;
+				right += takeRight;
+				left += !takeRight;
+			}
+			memcpy(dst + j, src + left, (middle - left) * sizeof(unsigned int));
+			memcpy(dst + j + middle - left, src + right, (end - right) * sizeof(unsigned int));
+		}
+		swap(src, dst);
+	}
+	if (src != Data)
+		memcpy(Data, src, Size * sizeof(unsigned int));
+}
+
+void CSortTask::MergeMultiway(const unsigned int* Input, unsigned int* Output, size_t Size, size_t RunSize, bool Decode)
+{
+	//loser tree over CPU_MERGE_WAYS runs. Every entry packs the key above its run, so replaying a path is a min and a max
+	//per node without branches or indirection. Missing and exhausted runs get a key beyond 32 bits
+	const unsigned int runBits = 8;
+	const unsigned long long exhausted = 1ull << (32 + runBits);
+	for (size_t group = 0; group < Size; group += RunSize * CPU_MERGE_WAYS) {
+		size_t pos[CPU_MERGE_WAYS], end[CPU_MERGE_WAYS];
+		unsigned long long tree[CPU_MERGE_WAYS], winners[2 * CPU_MERGE_WAYS];
+		for (size_t i = 0; i < CPU_MERGE_WAYS; i++) {
+			pos[i] = min(group + i * RunSize, Size);
+			end[i] = min(pos[i] + RunSize, Size);
+			winners[CPU_MERGE_WAYS + i] = (pos[i] < end[i] ? (unsigned long long)Input[pos[i]] << runBits : exhausted) | i;
+		}
+
+		//build bottom-up: the winners move up, the losers stay in the nodes
+		for (size_t node = CPU_MERGE_WAYS - 1; node > 0; node--) {
+			winners[node] = min(winners[2 * node], winners[2 * node + 1]);
+			tree[node] = max(winners[2 * node], winners[2 * node + 1]);
+		}
+		unsigned long long winner = winners[1];
+
+		size_t groupEnd = min(group + RunSize * CPU_MERGE_WAYS, Size);
+		for (size_t j = group; j < groupEnd; j++) {
+			size_t run = winner & ((1u << runBits) - 1);
+			unsigned int key = (unsigned int)(winner >> runBits);
+			Output[j] = Decode ? OrderDecode(key) : key;
+			winner = (++pos[run] < end[run] ? (unsigned long long)Input[pos[run]] << runBits : exhausted) | run;
+
+			//replay the path from the leaf of the run to the root
+			for (size_t node = (run + CPU_MERGE_WAYS) / 2; node > 0; node /= 2) {
+				unsigned long long loser = tree[node];
+				tree[node] = max(loser, winner);
+				winner = min(loser, winner);
+			}
+		}
+	}
+}
+
+void CSortTask::MergesortStable()
+{
+	//same as Mergesort, but the values (original indices) are moved along with the keys. Taking the left
+	//element on equal keys keeps the sort stable. Only the permutation is kept, m_resultCPU stays untouched.
+	unsigned int* keys = m_HostPool.AllocateArray<unsigned int>(m_N_padded);
+	unsigned int* tmpKeys = m_HostPool.AllocateArray<unsigned int>(m_N_padded);
+	unsigned int* tmpValues = m_HostPool.AllocateArray<unsigned int>(m_N_padded);
+	memcpy(tmpKeys, m_hInput, m_N_padded * sizeof(unsigned int));
+	for (size_t i = 0; i < m_N_padded; i++)
+		tmpValues[i] = (unsigned int)i;
+	for (size_t stride = 2; stride <= m_N_padded; stride *= 2) {
+		for (size_t i = 0; i < m_N_padded; i += stride) {
+			size_t middle = i + (stride / 2);
+			size_t left = i, right = middle;
+			size_t rightBoundary = min(i + stride, m_N_padded);
+			for (size_t j = i; j < rightBoundary; j++) {
 				if (left < middle &&
-					(right == rightBoundary || tmpBuffer[left] <= tmpBuffer[right])) {
-					m_resultCPU[j] = tmpBuffer[left];
+					(right == rightBoundary || !KeyLess(tmpKeys[right], tmpKeys[left]))) {
+					keys[j] = tmpKeys[left];
+					m_resultCPUPermutation[j] = tmpValues[left];
 					left++;
 				}
 				else {
-					m_resultCPU[j] = tmpBuffer[right];
+					keys[j] = tmpKeys[right];
+					m_resultCPUPermutation[j] = tmpValues[right];
 					right++;
 				}
 			}
 		}
-		swap(m_resultCPU, tmpBuffer);
+		swap(keys, tmpKeys);
+		swap(m_resultCPUPermutation, tmpValues);
 	}
 	// final swap to have the result in the correct array
-	swap(m_resultCPU, tmpBuffer);
+	swap(m_resultCPUPermutation, tmpValues);
 
-	// delete helper array
-	SAFE_DELETE_ARRAY(tmpBuffer);
+	// helper arrays back to the pool
+	m_HostPool.Free(keys);
+	m_HostPool.Free(tmpKeys);
+	m_HostPool.Free(tmpValues);
 }
 
 void CSortTask::ValidateCPU()
 {
 	bool sorted = true;
-	for (int i = 1; i < m_N; i++) {
-		if (m_resultCPU[i - 1] > m_resultCPU[i]) {
+	for (size_t i = 1; i < m_N; i++) {
+		if (SortLess(m_resultCPU[i], m_resultCPU[i - 1])) {
 			sorted = false;
 			break;
 		}
@@ -233,18 +1032,76 @@ bool CSortTask::ValidateResults()
 {
 	bool success = true;
 
-	for (int i = 0; i < 3; i++)
-		if (memcmp(m_resultGPU[i], m_resultCPU, m_N) != 0)
+	if (!m_AsyncValid) {
+		cout << "Validation of the concurrent sorts failed." << endl;
+		success = false;
+	}
+
+	if (!m_IncrementalValid) {
+		cout << "Validation of the incremental inserts failed." << endl;
+		success = false;
+	}
+
+	if (!m_ColumnsValid) {
+		cout << "Validation of the multi-column sort failed." << endl;
+		success = false;
+	}
+
+	if (!m_StringsValid) {
+		cout << "Validation of the string sort failed." << endl;
+		success = false;
+	}
+
+	if (!m_PostSortValid) {
+		cout << "Validation of the post-sort primitives failed." << endl;
+		success = false;
+	}
+
+	if (m_DeviceValidation) {
+		for (int i = 0; i < NUM_SORT_TASKS; i++)
+			if (!m_deviceValid[i] && (m_InputFile.empty() || i == 2))
+			{
+				cout << "Device validation of sorting kernel " << g_kernelNames[i] << " failed." << endl;
+				success = false;
+			}
+		return success;
+	}
+
+	for (int i = 0; i < NUM_SORT_TASKS; i++) {
+		bool equal;
+		if (i == 4 && m_KeyHi - m_KeyLo < 32) {
+			// the stable radix sort does not break ties by the value, so only the keys have to match
+			equal = true;
+			for (size_t j = 0; j < m_N && equal; j++)
+				equal = Key(m_resultGPU[i][j]) == Key(m_resultCPU[j]);
+		}
+		else
+			equal = memcmp(m_resultGPU[i], m_resultCPU, m_N * sizeof(unsigned int)) == 0;
+		if (!equal)
 		{
 			cout << "Validation of sorting kernel " << g_kernelNames[i] << " failed." << endl;
 			success = false;
 		}
+	}
+
+	// the key-value sort must produce exactly the stable permutation
+	if (m_StableMode && m_resultGPUPermutation != NULL &&
+		memcmp(m_resultGPUPermutation, m_resultCPUPermutation, m_N * sizeof(unsigned int)) != 0)
+	{
+		cout << "Validation of stable permutation of sorting kernel " << g_kernelNames[4] << " failed." << endl;
+		success = false;
+	}
 
 	return success;
 }
 
 void CSortTask::Sort_Mergesort(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
 {
+	if (m_InPlace) {
+		Sort_MergesortInPlace(Context, CommandQueue, LocalWorkSize);
+		return;
+	}
+
 	//TODO fix memory problem when many elements. -> CL_OUT_OF_RESOURCES
 	cl_int clError;
 	size_t globalWorkSize[1];
@@ -262,7 +1119,7 @@ void CSortTask::Sort_Mergesort(cl_context Context, cl_command_queue CommandQueue
 		clError |= clSetKernelArg(m_MergesortStartKernel, 1, sizeof(cl_mem), (void*)&m_dPongArray);
 		V_RETURN_CL(clError, "Failed to set kernel args: MergeSortStart");
 
-		clError = clEnqueueNDRangeKernel(CommandQueue, m_MergesortStartKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+		clError = EnqueueSortKernel(CommandQueue, m_MergesortStartKernel, globalWorkSize, localWorkSize, m_N_padded, false);
 		V_RETURN_CL(clError, "Error executing MergeSortStart kernel!");
 
 		swap(m_dPingArray, m_dPongArray);
@@ -291,7 +1148,7 @@ void CSortTask::Sort_Mergesort(cl_context Context, cl_command_queue CommandQueue
 			clError |= clSetKernelArg(m_MergesortGlobalSmallKernel, 2, sizeof(cl_uint), (void*)&stride);
 			V_RETURN_CL(clError, "Failed to set kernel args: MergeSortGlobal");
 
-			clError = clEnqueueNDRangeKernel(CommandQueue, m_MergesortGlobalSmallKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+			clError = EnqueueSortKernel(CommandQueue, m_MergesortGlobalSmallKernel, globalWorkSize, localWorkSize, m_N_padded, true);
 			V_RETURN_CL(clError, "Error executing kernel!");
 
 			swap(m_dPingArray, m_dPongArray);
@@ -314,7 +1171,7 @@ void CSortTask::Sort_Mergesort(cl_context Context, cl_command_queue CommandQueue
 			clError |= clSetKernelArg(m_MergesortGlobalBigKernel, 2, sizeof(cl_uint), (void*)&stride);
 			V_RETURN_CL(clError, "Failed to set kernel args: MergeSortGlobal");
 
-			clError = clEnqueueNDRangeKernel(CommandQueue, m_MergesortGlobalBigKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+			clError = EnqueueSortKernel(CommandQueue, m_MergesortGlobalBigKernel, globalWorkSize, localWorkSize, m_N_padded, true);
 			V_RETURN_CL(clError, "Error executing kernel!");
 
 			if (stride >= 1024 * 1024) V_RETURN_CL(clFinish(CommandQueue), "Failed finish CommandQueue at mergesort for bigger strides.");
@@ -323,199 +1180,1001 @@ void CSortTask::Sort_Mergesort(cl_context Context, cl_command_queue CommandQueue
 	}
 }
 
-void CSortTask::Sort_SimpleSortingNetwork(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+void CSortTask::Sort_MergesortInPlace(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
 {
 	cl_int clError;
 	size_t globalWorkSize[1];
 	size_t localWorkSize[1];
 
-	// "padded" n, so we get an even amount of values
-	unsigned int n = (m_N & 1) ? (m_N + 1) : (m_N);
-
-	localWorkSize[0] = min<unsigned int>(LocalWorkSize[0], n);
-	globalWorkSize[0] = CLUtil::GetGlobalWorkSize(n >> 1, localWorkSize[0]);
-
-	// set general arguments
-	clError = clSetKernelArg(m_SimpleSortingNetworkKernel, 0, sizeof(cl_mem), (void*)&m_dPingArray);
-	clError |= clSetKernelArg(m_SimpleSortingNetworkKernel, 1, sizeof(cl_mem), (void*)&m_dPingArray);
-	clError |= clSetKernelArg(m_SimpleSortingNetworkKernel, 3, sizeof(cl_uint), (void*)&n);
-	V_RETURN_CL(clError, "Failed to set kernel args: SimpleSortingNetwork");
-
-	for (unsigned int i = 0; i < n; i++) {
-		unsigned int offset = i & 1;
+	localWorkSize[0] = LocalWorkSize[0];
+	globalWorkSize[0] = CLUtil::GetGlobalWorkSize(m_N_padded / 2, localWorkSize[0]);
+	cl_uint limit = (cl_uint)(2 * LocalWorkSize[0]);
+
+	// the local mergesort reads and writes the same tile, so it can run on a single buffer
+	clError = clSetKernelArg(m_MergesortStartKernel, 0, sizeof(cl_mem), (void*)&m_dPingArray);
+	clError |= clSetKernelArg(m_MergesortStartKernel, 1, sizeof(cl_mem), (void*)&m_dPingArray);
+	V_RETURN_CL(clError, "Failed to set kernel args: MergeSortStart");
+
+	clError = EnqueueSortKernel(CommandQueue, m_MergesortStartKernel, globalWorkSize, localWorkSize, m_N_padded, false);
+	V_RETURN_CL(clError, "Error executing MergeSortStart kernel!");
+
+	// every merge is a flip followed by the bitonic merge strides, with blocksize = m_N_padded all of them sort ascending
+	for (size_t blocksize = 2 * limit; blocksize <= m_N_padded; blocksize <<= 1) {
+		clError = clSetKernelArg(m_MergesortFlipKernel, 0, sizeof(cl_mem), (void *)&m_dPingArray);
+		clError |= SetIndexArg(m_MergesortFlipKernel, 1, blocksize);
+		V_RETURN_CL(clError, "Failed to set kernel args: MergesortFlipKernel");
+
+		clError = EnqueueSortKernel(CommandQueue, m_MergesortFlipKernel, globalWorkSize, localWorkSize, m_N_padded, true);
+		V_RETURN_CL(clError, "Error executing MergesortFlipKernel!");
+
+		size_t stride = blocksize / 4;
+		for (; stride >= limit; stride >>= 1) {
+			clError = clSetKernelArg(m_BitonicGlobalKernel, 0, sizeof(cl_mem), (void *)&m_dPingArray);
+			clError |= SetIndexArg(m_BitonicGlobalKernel, 1, m_N_padded);
+			clError |= SetIndexArg(m_BitonicGlobalKernel, 2, m_N_padded);
+			clError |= SetIndexArg(m_BitonicGlobalKernel, 3, stride);
+			V_RETURN_CL(clError, "Failed to set kernel args: BitonicGlobalKernel");
+
+			clError = EnqueueSortKernel(CommandQueue, m_BitonicGlobalKernel, globalWorkSize, localWorkSize, m_N_padded, true);
+			V_RETURN_CL(clError, "Error executing BitonicGlobalKernel!");
+		}
 
-		// set arguments
-		clError |= clSetKernelArg(m_SimpleSortingNetworkKernel, 2, sizeof(cl_uint), (void*)&offset);
-		V_RETURN_CL(clError, "Failed to set kernel args: SimpleSortingNetwork");
+		clError = clSetKernelArg(m_BitonicLocalKernel, 0, sizeof(cl_mem), (void *)&m_dPingArray);
+		clError |= SetIndexArg(m_BitonicLocalKernel, 1, m_N_padded);
+		clError |= SetIndexArg(m_BitonicLocalKernel, 2, m_N_padded);
+		clError |= SetIndexArg(m_BitonicLocalKernel, 3, stride);
+		V_RETURN_CL(clError, "Failed to set kernel args: BitonicLocalKernel");
 
-		// start kernel
-		clError = clEnqueueNDRangeKernel(CommandQueue, m_SimpleSortingNetworkKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
-		V_RETURN_CL(clError, "Error executing kernel!");
+		clError = EnqueueSortKernel(CommandQueue, m_BitonicLocalKernel, globalWorkSize, localWorkSize, m_N_padded, false);
+		V_RETURN_CL(clError, "Error executing BitonicLocalKernel!");
 	}
 }
 
-void CSortTask::Sort_SimpleSortingNetworkLocal(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+void CSortTask::Sort_OddEvenMergesort(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
 {
 	cl_int clError;
 	size_t globalWorkSize[1];
 	size_t localWorkSize[1];
-	// "padded" n, so we get an even amount of values
-	unsigned int n = (m_N & 1) ? (m_N + 1) : (m_N);
-
-	localWorkSize[0] = min<unsigned int>(LocalWorkSize[0], n);
-	globalWorkSize[0] = CLUtil::GetGlobalWorkSize(n >> 1, localWorkSize[0]);
-	unsigned int loop_lim = (n / localWorkSize[0]);
-	unsigned int offset = 0;
 
-	for (unsigned int i = 0; i < loop_lim; i++) {
-		offset = (i & 1);
-		clError = clSetKernelArg(m_SimpleSortingNetworkLocalKernel, 0, sizeof(cl_mem), (void*)&m_dPingArray);
-		clError |= clSetKernelArg(m_SimpleSortingNetworkLocalKernel, 1, sizeof(cl_uint), (void*)&n);
-		clError |= clSetKernelArg(m_SimpleSortingNetworkLocalKernel, 2, sizeof(cl_uint), (void*)&offset);
-		V_RETURN_CL(clError, "Failed to set kernel args: SimpleSortingNetworkLocal");
-
-		// start kernel
-		clError = clEnqueueNDRangeKernel(CommandQueue, m_SimpleSortingNetworkLocalKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
-		V_RETURN_CL(clError, "Error executing SimpleSortingNetworkLocal kernel!");
+	localWorkSize[0] = LocalWorkSize[0];
+	globalWorkSize[0] = CLUtil::GetGlobalWorkSize(m_N_padded / 2, localWorkSize[0]);
+	cl_uint limit = (cl_uint)(2 * LocalWorkSize[0]);
+
+	// sort tiles of 2 * LocalWorkSize in local memory
+	clError = clSetKernelArg(m_OddEvenStartKernel, 0, sizeof(cl_mem), (void *)&m_dPingArray);
+	clError |= clSetKernelArg(m_OddEvenStartKernel, 1, sizeof(cl_mem), (void *)&m_dPongArray);
+	V_RETURN_CL(clError, "Failed to set kernel args: OddEvenStartKernel");
+
+	clError = clEnqueueNDRangeKernel(CommandQueue, m_OddEvenStartKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+	V_RETURN_CL(clError, "Error executing OddEvenStartKernel!");
+
+	// the remaining merges need one launch per stride, O(log^2 n) in total
+	for (size_t size = 2 * limit; size <= m_N_padded; size <<= 1) {
+		for (size_t stride = size / 2; stride > 0; stride >>= 1) {
+			clError = clSetKernelArg(m_OddEvenGlobalKernel, 0, sizeof(cl_mem), (void *)&m_dPongArray);
+			clError |= SetIndexArg(m_OddEvenGlobalKernel, 1, size);
+			clError |= SetIndexArg(m_OddEvenGlobalKernel, 2, stride);
+			V_RETURN_CL(clError, "Failed to set kernel args: OddEvenGlobalKernel");
+
+			clError = clEnqueueNDRangeKernel(CommandQueue, m_OddEvenGlobalKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+			V_RETURN_CL(clError, "Error executing OddEvenGlobalKernel!");
+		}
 	}
+	swap(m_dPingArray, m_dPongArray);
 }
 
 void CSortTask::Sort_BitonicMergesort(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
 {
+	// a few linear passes if the keys span a small range
+	if (m_dCountingCounts && Sort_Counting(Context, CommandQueue, LocalWorkSize))
+		return;
+	// a single host call for the whole sort, or the variant with subgroup shuffles if the device supports it
+	if (m_DeviceScheduling) {
+		Sort_BitonicScheduled(Context, CommandQueue, LocalWorkSize);
+		return;
+	}
+	// CPU devices merge without local memory and barriers, in-place mode has no second buffer for that
+	if (m_CpuDevice && !m_InPlace) {
+		Sort_CpuMergesort(Context, CommandQueue);
+		return;
+	}
+	if (m_SubgroupShuffle) {
+		Sort_BitonicShuffle(Context, CommandQueue, LocalWorkSize);
+		return;
+	}
+
+	if (EnqueueBitonicMergesort(CommandQueue, m_dPingArray, m_dPongArray, m_N_padded, m_N_padded, LocalWorkSize))
+		swap(m_dPingArray, m_dPongArray);
+}
+
+bool CSortTask::EnqueueBitonicMergesort(cl_command_queue CommandQueue, cl_mem Input, cl_mem Output, size_t Size, size_t SegmentSize, size_t LocalWorkSize[3])
+{
+	// Input and Output may be the same buffer, the start kernel reads and writes the same tile. With SegmentSize < Size
+	// every segment is sorted on its own: the stages stop at the segment size, and the last one gets blocksize Size so all
+	// segments end up in the same direction
 	cl_int clError;
 	size_t globalWorkSize[1];
 	size_t localWorkSize[1];
 
 	localWorkSize[0] = LocalWorkSize[0];
-	globalWorkSize[0] = CLUtil::GetGlobalWorkSize(m_N_padded / 2, localWorkSize[0]);
+	globalWorkSize[0] = CLUtil::GetGlobalWorkSize(Size / 2, localWorkSize[0]);
 	unsigned int limit = (unsigned int)2 * LocalWorkSize[0]; //limit is double the localWorkSize
 
 	// start with Sort_BitonicMergesortLocalBegin to sort local until we reach the limit
-	clError = clSetKernelArg(m_BitonicStartKernel, 0, sizeof(cl_mem), (void *)&m_dPingArray);
-	clError |= clSetKernelArg(m_BitonicStartKernel, 1, sizeof(cl_mem), (void *)&m_dPongArray);
-	V_RETURN_CL(clError, "Failed to set kernel args: BitonicStartKernel");
+	clError = clSetKernelArg(m_BitonicStartKernel, 0, sizeof(cl_mem), (void *)&Input);
+	clError |= clSetKernelArg(m_BitonicStartKernel, 1, sizeof(cl_mem), (void *)&Output);
+	V_RETURN_FALSE_CL(clError, "Failed to set kernel args: BitonicStartKernel");
 
-	clError = clEnqueueNDRangeKernel(CommandQueue, m_BitonicStartKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
-	V_RETURN_CL(clError, "Error executing BitonicStartKernel!");
+	clError = EnqueueSortKernel(CommandQueue, m_BitonicStartKernel, globalWorkSize, localWorkSize, Size, false);
+	V_RETURN_FALSE_CL(clError, "Error executing BitonicStartKernel!");
 
 	// proceed with global and local kernels
-	for (unsigned int blocksize = limit; blocksize <= m_N_padded; blocksize <<= 1) {
-		for (unsigned int stride = blocksize / 2; stride > 0; stride >>= 1) {
+	for (size_t blocksize = limit; blocksize <= SegmentSize; blocksize <<= 1) {
+		size_t direction = (blocksize == SegmentSize) ? Size : blocksize;
+		for (size_t stride = blocksize / 2; stride > 0; stride >>= 1) {
 			if (stride >= limit) {
 				//Sort_BitonicMergesortGlobal
-				clError = clSetKernelArg(m_BitonicGlobalKernel, 0, sizeof(cl_mem), (void *)&m_dPongArray);
-				clError |= clSetKernelArg(m_BitonicGlobalKernel, 1, sizeof(cl_uint), (void *)&m_N_padded);
-				clError |= clSetKernelArg(m_BitonicGlobalKernel, 2, sizeof(cl_uint), (void *)&blocksize);
-				clError |= clSetKernelArg(m_BitonicGlobalKernel, 3, sizeof(cl_uint), (void *)&stride);
-				V_RETURN_CL(clError, "Failed to set kernel args: BitonicGlobalKernel");
-
-				clError = clEnqueueNDRangeKernel(CommandQueue, m_BitonicGlobalKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
-				V_RETURN_CL(clError, "Error executing BitonicGlobalKernel!");
+				clError = clSetKernelArg(m_BitonicGlobalKernel, 0, sizeof(cl_mem), (void *)&Output);
+				clError |= SetIndexArg(m_BitonicGlobalKernel, 1, Size);
+				clError |= SetIndexArg(m_BitonicGlobalKernel, 2, direction);
+				clError |= SetIndexArg(m_BitonicGlobalKernel, 3, stride);
+				V_RETURN_FALSE_CL(clError, "Failed to set kernel args: BitonicGlobalKernel");
+
+				clError = EnqueueSortKernel(CommandQueue, m_BitonicGlobalKernel, globalWorkSize, localWorkSize, Size, true);
+				V_RETURN_FALSE_CL(clError, "Error executing BitonicGlobalKernel!");
 			}
 			else {
 				//Sort_BitonicMergesortLocal
-				clError = clSetKernelArg(m_BitonicLocalKernel, 0, sizeof(cl_mem), (void *)&m_dPongArray);
-				clError |= clSetKernelArg(m_BitonicLocalKernel, 1, sizeof(cl_uint), (void *)&m_N_padded);
-				clError |= clSetKernelArg(m_BitonicLocalKernel, 2, sizeof(cl_uint), (void *)&blocksize);
-				clError |= clSetKernelArg(m_BitonicLocalKernel, 3, sizeof(cl_uint), (void *)&stride);
-				V_RETURN_CL(clError, "Failed to set kernel args: BitonicLocalKernel");
-
-				clError = clEnqueueNDRangeKernel(CommandQueue, m_BitonicLocalKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
-				V_RETURN_CL(clError, "Error executing BitonicLocalKernel!");
+				clError = clSetKernelArg(m_BitonicLocalKernel, 0, sizeof(cl_mem), (void *)&Output);
+				clError |= SetIndexArg(m_BitonicLocalKernel, 1, Size);
+				clError |= SetIndexArg(m_BitonicLocalKernel, 2, direction);
+				clError |= SetIndexArg(m_BitonicLocalKernel, 3, stride);
+				V_RETURN_FALSE_CL(clError, "Failed to set kernel args: BitonicLocalKernel");
+
+				clError = EnqueueSortKernel(CommandQueue, m_BitonicLocalKernel, globalWorkSize, localWorkSize, Size, false);
+				V_RETURN_FALSE_CL(clError, "Error executing BitonicLocalKernel!");
 			}
 		}
 	}
-	swap(m_dPingArray, m_dPongArray);
+	return true;
 }
 
-void CSortTask::ExecuteTask(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task)
+void CSortTask::Sort_BitonicScheduled(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
 {
-	//write input data to the GPU
-	V_RETURN_CL(clEnqueueWriteBuffer(CommandQueue, m_dPingArray, CL_FALSE, 0, m_N_padded * sizeof(cl_uint), m_hInput, 0, NULL, NULL), "Error copying data from host to device!");
+	cl_int clError;
+	size_t globalWorkSize[1];
+	size_t localWorkSize[1];
 
-	bool skipped = false;
-	//run selected task
-	switch (Task){
-	case 0:
-		if (m_N_padded <= MERGE_LIMIT)
-			Sort_Mergesort(Context, CommandQueue, LocalWorkSize);
-		else {
-			cout << endl << "Skipping Mergesort on GPU!" << endl;
-			skipped = true;
-		}
-		break;
-	case 1:
-		if (m_N_padded <= SSN_LIMIT)
-			//Sort_SimpleSortingNetwork(Context, CommandQueue, LocalWorkSize); //uncomment etc if you want to run slower global variant. then also below
-			Sort_SimpleSortingNetworkLocal(Context, CommandQueue, LocalWorkSize);
-		else {
-			cout << endl << "Skipping SimpleSortingNetwork!" << endl;
-			skipped = true;
-		}
-		break;
-	case 2:
-		Sort_BitonicMergesort(Context, CommandQueue, LocalWorkSize);
-		break;
+	if (m_DeviceQueue) {
+		// a single work-item enqueues all stages on the device queue
+		globalWorkSize[0] = localWorkSize[0] = 1;
+		clError = clSetKernelArg(m_BitonicSchedulerKernel, 0, sizeof(cl_mem), (void *)&m_dPingArray);
+		clError |= clSetKernelArg(m_BitonicSchedulerKernel, 1, sizeof(cl_mem), (void *)&m_dPongArray);
+		clError |= SetIndexArg(m_BitonicSchedulerKernel, 2, m_N_padded);
+		V_RETURN_CL(clError, "Failed to set kernel args: BitonicSchedulerKernel");
+
+		clError = clEnqueueNDRangeKernel(CommandQueue, m_BitonicSchedulerKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+		V_RETURN_CL(clError, "Error executing BitonicSchedulerKernel!");
+	}
+	else {
+		// persistent kernel, the barrier counters are reset by the kernel itself
+		localWorkSize[0] = LocalWorkSize[0];
+		globalWorkSize[0] = m_PersistentGroups * LocalWorkSize[0];
+		clError = clSetKernelArg(m_BitonicPersistentKernel, 0, sizeof(cl_mem), (void *)&m_dPingArray);
+		clError |= clSetKernelArg(m_BitonicPersistentKernel, 1, sizeof(cl_mem), (void *)&m_dPongArray);
+		clError |= clSetKernelArg(m_BitonicPersistentKernel, 2, sizeof(cl_mem), (void *)&m_dBarrierCounters);
+		clError |= SetIndexArg(m_BitonicPersistentKernel, 3, m_N_padded);
+		V_RETURN_CL(clError, "Failed to set kernel args: BitonicPersistentKernel");
+
+		clError = clEnqueueNDRangeKernel(CommandQueue, m_BitonicPersistentKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+		V_RETURN_CL(clError, "Error executing BitonicPersistentKernel!");
 	}
+	swap(m_dPingArray, m_dPongArray);
+}
 
-	//read back the results synchronously.
-	m_resultGPU[Task] = new unsigned int[m_N];
-	if (skipped) memcpy(m_resultGPU[Task], m_resultCPU, m_N);
-	else V_RETURN_CL(clEnqueueReadBuffer(CommandQueue, m_dPingArray, CL_TRUE, 0, m_N * sizeof(cl_uint), m_resultGPU[Task], 0, NULL, NULL), "Error reading data from device!");
+void CSortTask::Sort_BitonicShuffle(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+{
+	cl_int clError;
+	size_t globalWorkSize[1];
+	size_t localWorkSize[1];
 
-	//DEBUG TODO: change Task number or delete
-	if (Task == 012) {
-		cout << endl;
-		cout << "GPU\tCPU\tInput" << endl;
-		for (unsigned int i = 0; i < 50; i++) {
-			cout << m_resultGPU[Task][i] << "\t" << m_resultCPU[i] << "\t" << m_hInput[i] << endl;
-			//cout << m_resultGPU[Task][i] << ",\t";
-		}
-		cout << endl;
-		for (unsigned int i = 0; i < m_N; i++) {
-			cout << m_resultGPU[Task][i] << "-" << m_resultCPU[i] << ",\t";
+	localWorkSize[0] = LocalWorkSize[0];
+	globalWorkSize[0] = CLUtil::GetGlobalWorkSize(m_N_padded / 2, localWorkSize[0]);
+	cl_uint limit = (cl_uint)(2 * LocalWorkSize[0]);
+	cl_uint size = (cl_uint)m_N_padded;
+
+	clError = clSetKernelArg(m_BitonicShuffleStartKernel, 0, sizeof(cl_mem), (void *)&m_dPingArray);
+	clError |= clSetKernelArg(m_BitonicShuffleStartKernel, 1, sizeof(cl_mem), (void *)&m_dPongArray);
+	V_RETURN_CL(clError, "Failed to set kernel args: BitonicShuffleStartKernel");
+
+	clError = EnqueueSortKernel(CommandQueue, m_BitonicShuffleStartKernel, globalWorkSize, localWorkSize, m_N_padded, false);
+	V_RETURN_CL(clError, "Error executing BitonicShuffleStartKernel!");
+
+	// global strides as in Sort_BitonicMergesort, all strides below the tile size are done by one kernel
+	for (cl_uint blocksize = 2 * limit; blocksize <= m_N_padded; blocksize <<= 1) {
+		cl_uint stride = blocksize / 2;
+		for (; stride >= limit; stride >>= 1) {
+			clError = clSetKernelArg(m_BitonicGlobalKernel, 0, sizeof(cl_mem), (void *)&m_dPongArray);
+			clError |= clSetKernelArg(m_BitonicGlobalKernel, 1, sizeof(cl_uint), (void *)&size);
+			clError |= clSetKernelArg(m_BitonicGlobalKernel, 2, sizeof(cl_uint), (void *)&blocksize);
+			clError |= clSetKernelArg(m_BitonicGlobalKernel, 3, sizeof(cl_uint), (void *)&stride);
+			V_RETURN_CL(clError, "Failed to set kernel args: BitonicGlobalKernel");
+
+			clError = EnqueueSortKernel(CommandQueue, m_BitonicGlobalKernel, globalWorkSize, localWorkSize, m_N_padded, true);
+			V_RETURN_CL(clError, "Error executing BitonicGlobalKernel!");
 		}
-		cout << endl;
+
+		clError = clSetKernelArg(m_BitonicShuffleMergeKernel, 0, sizeof(cl_mem), (void *)&m_dPongArray);
+		clError |= clSetKernelArg(m_BitonicShuffleMergeKernel, 1, sizeof(cl_uint), (void *)&blocksize);
+		clError |= clSetKernelArg(m_BitonicShuffleMergeKernel, 2, sizeof(cl_uint), (void *)&stride);
+		V_RETURN_CL(clError, "Failed to set kernel args: BitonicShuffleMergeKernel");
+
+		clError = EnqueueSortKernel(CommandQueue, m_BitonicShuffleMergeKernel, globalWorkSize, localWorkSize, m_N_padded, false);
+		V_RETURN_CL(clError, "Error executing BitonicShuffleMergeKernel!");
 	}
+	swap(m_dPingArray, m_dPongArray);
 }
 
-void CSortTask::TestPerformance(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task)
+void CSortTask::Sort_BitonicBlocked(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
 {
-	cout << "Testing performance of task " << g_kernelNames[Task] << endl;
-
-	//write input data to the GPU
-	V_RETURN_CL(clEnqueueWriteBuffer(CommandQueue, m_dPingArray, CL_FALSE, 0, m_N_padded * sizeof(cl_uint), m_hInput, 0, NULL, NULL), "Error copying data from host to device!");
-	//finish all before we start meassuring the time
-	V_RETURN_CL(clFinish(CommandQueue), "Error finishing the queue!");
+	cl_int clError;
+	size_t globalWorkSize[1];
+	size_t localWorkSize[1];
 
-	bool skipped = false;
-	CTimer timer;
-	timer.Start();
+	// every work-group sorts a tile of BITONIC_KEYS_PER_ITEM keys per work-item, there is no 64-bit index variant
+	unsigned int tile = (unsigned int)(BITONIC_KEYS_PER_ITEM * LocalWorkSize[0]);
+	if (m_N_padded < tile || m_WideIndex) {
+		Sort_BitonicMergesort(Context, CommandQueue, LocalWorkSize);
+		return;
+	}
 
-	//run the kernel N times TODO vary this if necessary!
-	unsigned int nIterations = 10;
-	for (unsigned int i = 0; i < nIterations; i++) {
-		//run selected task
-		switch (Task){
-		case 0:
-			if (m_N_padded <= MERGE_LIMIT)
-				Sort_Mergesort(Context, CommandQueue, LocalWorkSize);
-			else skipped = true;
-			break;
-		case 1:
-			if (m_N_padded <= SSN_LIMIT)
-				//Sort_SimpleSortingNetwork(Context, CommandQueue, LocalWorkSize);
-				Sort_SimpleSortingNetworkLocal(Context, CommandQueue, LocalWorkSize);
-			else skipped = true;
-			break;
-		case 2:
-			Sort_BitonicMergesort(Context, CommandQueue, LocalWorkSize);
-			break;
+	localWorkSize[0] = LocalWorkSize[0];
+	globalWorkSize[0] = m_N_padded / BITONIC_KEYS_PER_ITEM;
+
+	clError = clSetKernelArg(m_BitonicBlockedStartKernel, 0, sizeof(cl_mem), (void *)&m_dPingArray);
+	clError |= clSetKernelArg(m_BitonicBlockedStartKernel, 1, sizeof(cl_mem), (void *)&m_dPongArray);
+	V_RETURN_CL(clError, "Failed to set kernel args: BitonicBlockedStartKernel");
+
+	clError = EnqueueSortKernel(CommandQueue, m_BitonicBlockedStartKernel, globalWorkSize, localWorkSize, m_N_padded, false);
+	V_RETURN_CL(clError, "Error executing BitonicBlockedStartKernel!");
+
+	// the global strides still move one pair per work-item, all strides below the tile size are done by one kernel
+	cl_uint size = (cl_uint)m_N_padded;
+	size_t globalPairs[1] = { m_N_padded / 2 };
+	for (cl_uint blocksize = 2 * tile; blocksize <= m_N_padded; blocksize <<= 1) {
+		cl_uint stride = blocksize / 2;
+		for (; stride >= tile; stride >>= 1) {
+			clError = clSetKernelArg(m_BitonicGlobalKernel, 0, sizeof(cl_mem), (void *)&m_dPongArray);
+			clError |= clSetKernelArg(m_BitonicGlobalKernel, 1, sizeof(cl_uint), (void *)&size);
+			clError |= clSetKernelArg(m_BitonicGlobalKernel, 2, sizeof(cl_uint), (void *)&blocksize);
+			clError |= clSetKernelArg(m_BitonicGlobalKernel, 3, sizeof(cl_uint), (void *)&stride);
+			V_RETURN_CL(clError, "Failed to set kernel args: BitonicGlobalKernel");
+
+			clError = EnqueueSortKernel(CommandQueue, m_BitonicGlobalKernel, globalPairs, localWorkSize, m_N_padded, true);
+			V_RETURN_CL(clError, "Error executing BitonicGlobalKernel!");
 		}
-	}
 
-	//wait until the command queue is empty again
-	V_RETURN_CL(clFinish(CommandQueue), "Error finishing the queue!");
+		clError = clSetKernelArg(m_BitonicBlockedMergeKernel, 0, sizeof(cl_mem), (void *)&m_dPongArray);
+		clError |= clSetKernelArg(m_BitonicBlockedMergeKernel, 1, sizeof(cl_uint), (void *)&blocksize);
+		clError |= clSetKernelArg(m_BitonicBlockedMergeKernel, 2, sizeof(cl_uint), (void *)&stride);
+		V_RETURN_CL(clError, "Failed to set kernel args: BitonicBlockedMergeKernel");
+
+		clError = EnqueueSortKernel(CommandQueue, m_BitonicBlockedMergeKernel, globalWorkSize, localWorkSize, m_N_padded, false);
+		V_RETURN_CL(clError, "Error executing BitonicBlockedMergeKernel!");
+	}
+	swap(m_dPingArray, m_dPongArray);
+}
+
+void CSortTask::Sort_CpuMergesort(cl_context Context, cl_command_queue CommandQueue)
+{
+	cl_int clError;
+	size_t globalWorkSize[1];
+	size_t localWorkSize[1] = { m_CpuVectorWidth };
+
+	// every work-item sorts a chunk that fits in the core's caches
+	size_t chunk = min<size_t>(CPU_DEVICE_CHUNK_KEYS, m_N_padded);
+	globalWorkSize[0] = CLUtil::GetGlobalWorkSize(m_N_padded / chunk, localWorkSize[0]);
+	clError = clSetKernelArg(m_CpuChunksKernel, 0, sizeof(cl_mem), (void*)&m_dPingArray);
+	clError |= clSetKernelArg(m_CpuChunksKernel, 1, sizeof(cl_mem), (void*)&m_dPongArray);
+	clError |= SetIndexArg(m_CpuChunksKernel, 2, m_N_padded);
+	clError |= SetIndexArg(m_CpuChunksKernel, 3, chunk);
+	V_RETURN_CL(clError, "Failed to set kernel args: CpuChunksKernel");
+	clError = EnqueueSortKernel(CommandQueue, m_CpuChunksKernel, globalWorkSize, localWorkSize, m_N_padded, false);
+	V_RETURN_CL(clError, "Error executing CpuChunksKernel!");
+	swap(m_dPingArray, m_dPongArray);
+
+	// then one pass per doubling of the run width, every work-item merges items keys of a pair of runs
+	size_t items = min<size_t>(CPU_DEVICE_MERGE_KEYS, chunk);
+	globalWorkSize[0] = CLUtil::GetGlobalWorkSize(m_N_padded / items, localWorkSize[0]);
+	for (size_t width = chunk; width < m_N_padded; width <<= 1) {
+		clError = clSetKernelArg(m_CpuMergeKernel, 0, sizeof(cl_mem), (void*)&m_dPingArray);
+		clError |= clSetKernelArg(m_CpuMergeKernel, 1, sizeof(cl_mem), (void*)&m_dPongArray);
+		clError |= SetIndexArg(m_CpuMergeKernel, 2, m_N_padded);
+		clError |= SetIndexArg(m_CpuMergeKernel, 3, width);
+		clError |= SetIndexArg(m_CpuMergeKernel, 4, items);
+		V_RETURN_CL(clError, "Failed to set kernel args: CpuMergeKernel");
+		clError = EnqueueSortKernel(CommandQueue, m_CpuMergeKernel, globalWorkSize, localWorkSize, m_N_padded, true);
+		V_RETURN_CL(clError, "Error executing CpuMergeKernel!");
+		swap(m_dPingArray, m_dPongArray);
+	}
+}
+
+void CSortTask::Sort_SampleSort(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+{
+	cl_int clError;
+	size_t globalWorkSize[1];
+	size_t localWorkSize[1];
+
+	localWorkSize[0] = LocalWorkSize[0];
+	const unsigned int localLimit = (unsigned int)(2 * LocalWorkSize[0]); // buckets up to this size are sorted in local memory
+	const unsigned int tileSize = (unsigned int)(SAMPLESORT_ELEMENTS_PER_ITEM * LocalWorkSize[0]);
+	const unsigned int allBuckets = 2 * m_SampleSortBuckets - 1;
+
+	// segments: begin, size, tile count, first counter. tiles: begin, size, segment, counter
+	vector<cl_uint4> segments, nextSegments, tiles;
+	vector<cl_uint2> smallBuckets;
+	vector<cl_uint> bucketStarts;
+
+	cl_uint4 all = { { 0, (cl_uint)m_N, 0, 0 } };
+	if (m_N > localLimit) segments.push_back(all);
+	else smallBuckets.push_back(cl_uint2{ { 0, (cl_uint)m_N } });
+
+	// the input is in the ping array and the result has to end up there again
+	cl_mem src = m_dPingArray;
+	cl_mem dst = m_dPongArray;
+
+	for (cl_uint level = 0; !segments.empty(); level++) {
+		// split the segments into tiles
+		tiles.clear();
+		cl_uint numCounters = 0;
+		for (cl_uint s = 0; s < segments.size(); s++) {
+			cl_uint4& seg = segments[s];
+			seg.s[2] = (seg.s[1] + tileSize - 1) / tileSize;
+			seg.s[3] = numCounters;
+			for (cl_uint t = 0; t < seg.s[2]; t++) {
+				cl_uint4 tile = { { seg.s[0] + t * tileSize, min(tileSize, seg.s[1] - t * tileSize), s, numCounters + t } };
+				tiles.push_back(tile);
+			}
+			numCounters += allBuckets * seg.s[2];
+		}
+		cl_uint numSegments = (cl_uint)segments.size();
+		cl_uint numTiles = (cl_uint)tiles.size();
+
+		clError = clEnqueueWriteBuffer(CommandQueue, m_dSampleSortSegments, CL_TRUE, 0, numSegments * sizeof(cl_uint4), &segments[0], 0, NULL, NULL);
+		clError |= clEnqueueWriteBuffer(CommandQueue, m_dSampleSortTiles, CL_TRUE, 0, numTiles * sizeof(cl_uint4), &tiles[0], 0, NULL, NULL);
+		V_RETURN_CL(clError, "Error copying sample sort segments to device!");
+
+		// pick the splitters of every segment
+		cl_uint seed = level * 0x9e3779b9;
+		clError = clSetKernelArg(m_SampleSortSplittersKernel, 0, sizeof(cl_mem), (void*)&src);
+		clError |= clSetKernelArg(m_SampleSortSplittersKernel, 1, sizeof(cl_mem), (void*)&m_dSampleSortSegments);
+		clError |= clSetKernelArg(m_SampleSortSplittersKernel, 2, sizeof(cl_mem), (void*)&m_dSampleSortSplitters);
+		clError |= clSetKernelArg(m_SampleSortSplittersKernel, 3, sizeof(cl_uint), (void*)&seed);
+		V_RETURN_CL(clError, "Failed to set kernel args: SampleSortSplitters");
+
+		globalWorkSize[0] = numSegments * localWorkSize[0];
+		clError = clEnqueueNDRangeKernel(CommandQueue, m_SampleSortSplittersKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+		V_RETURN_CL(clError, "Error executing SampleSortSplitters kernel!");
+
+		// classify and count
+		clError = clSetKernelArg(m_SampleSortClassifyKernel, 0, sizeof(cl_mem), (void*)&src);
+		clError |= clSetKernelArg(m_SampleSortClassifyKernel, 1, sizeof(cl_mem), (void*)&m_dSampleSortTiles);
+		clError |= clSetKernelArg(m_SampleSortClassifyKernel, 2, sizeof(cl_mem), (void*)&m_dSampleSortSegments);
+		clError |= clSetKernelArg(m_SampleSortClassifyKernel, 3, sizeof(cl_mem), (void*)&m_dSampleSortSplitters);
+		clError |= clSetKernelArg(m_SampleSortClassifyKernel, 4, sizeof(cl_mem), (void*)&m_dSampleSortBucketIds);
+		clError |= clSetKernelArg(m_SampleSortClassifyKernel, 5, sizeof(cl_mem), (void*)&m_dSampleSortCounters);
+		V_RETURN_CL(clError, "Failed to set kernel args: SampleSortClassify");
+
+		globalWorkSize[0] = numTiles * localWorkSize[0];
+		clError = clEnqueueNDRangeKernel(CommandQueue, m_SampleSortClassifyKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+		V_RETURN_CL(clError, "Error executing SampleSortClassify kernel!");
+
+		// bucket offsets of every tile
+		ExclusiveScan(Context, CommandQueue, m_dSampleSortCounters, numCounters);
+
+		// scatter into the other array
+		clError = clSetKernelArg(m_SampleSortScatterKernel, 0, sizeof(cl_mem), (void*)&src);
+		clError |= clSetKernelArg(m_SampleSortScatterKernel, 1, sizeof(cl_mem), (void*)&dst);
+		clError |= clSetKernelArg(m_SampleSortScatterKernel, 2, sizeof(cl_mem), (void*)&m_dSampleSortBucketIds);
+		clError |= clSetKernelArg(m_SampleSortScatterKernel, 3, sizeof(cl_mem), (void*)&m_dSampleSortTiles);
+		clError |= clSetKernelArg(m_SampleSortScatterKernel, 4, sizeof(cl_mem), (void*)&m_dSampleSortSegments);
+		clError |= clSetKernelArg(m_SampleSortScatterKernel, 5, sizeof(cl_mem), (void*)&m_dSampleSortCounters);
+		clError |= clSetKernelArg(m_SampleSortScatterKernel, 6, sizeof(cl_mem), (void*)&m_dSampleSortBucketStarts);
+		V_RETURN_CL(clError, "Failed to set kernel args: SampleSortScatter");
+
+		clError = clEnqueueNDRangeKernel(CommandQueue, m_SampleSortScatterKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+		V_RETURN_CL(clError, "Error executing SampleSortScatter kernel!");
+
+		// the host decides how every bucket continues
+		bucketStarts.resize(numSegments * allBuckets);
+		V_RETURN_CL(clEnqueueReadBuffer(CommandQueue, m_dSampleSortBucketStarts, CL_TRUE, 0, bucketStarts.size() * sizeof(cl_uint), &bucketStarts[0], 0, NULL, NULL), "Error reading sample sort buckets!");
+
+		nextSegments.clear();
+		smallBuckets.clear();
+		for (cl_uint s = 0; s < numSegments; s++) {
+			for (cl_uint b = 0; b < allBuckets; b++) {
+				cl_uint start = bucketStarts[s * allBuckets + b];
+				cl_uint end = (b + 1 < allBuckets) ? bucketStarts[s * allBuckets + b + 1] : segments[s].s[1];
+				cl_uint2 bucket = { { segments[s].s[0] + start, end - start } };
+				if (bucket.s[1] == 0) continue;
+
+				if (bucket.s[1] <= localLimit) {
+					smallBuckets.push_back(bucket);
+				}
+				else if (b & 1) {
+					// equality buckets are done, but have to end up in the ping array
+					if (dst != m_dPingArray) {
+						clError = clEnqueueCopyBuffer(CommandQueue, dst, m_dPingArray, bucket.s[0] * sizeof(cl_uint), bucket.s[0] * sizeof(cl_uint), bucket.s[1] * sizeof(cl_uint), 0, NULL, NULL);
+						V_RETURN_CL(clError, "Error copying sample sort bucket!");
+					}
+				}
+				else {
+					cl_uint4 seg = { { bucket.s[0], bucket.s[1], 0, 0 } };
+					nextSegments.push_back(seg);
+				}
+			}
+		}
+
+		// sort the small buckets of this level directly into the ping array
+		if (!smallBuckets.empty()) {
+			V_RETURN_CL(clEnqueueWriteBuffer(CommandQueue, m_dSampleSortSmallBuckets, CL_TRUE, 0, smallBuckets.size() * sizeof(cl_uint2), &smallBuckets[0], 0, NULL, NULL), "Error copying sample sort buckets to device!");
+
+			clError = clSetKernelArg(m_SampleSortLocalKernel, 0, sizeof(cl_mem), (void*)&dst);
+			clError |= clSetKernelArg(m_SampleSortLocalKernel, 1, sizeof(cl_mem), (void*)&m_dPingArray);
+			clError |= clSetKernelArg(m_SampleSortLocalKernel, 2, sizeof(cl_mem), (void*)&m_dSampleSortSmallBuckets);
+			V_RETURN_CL(clError, "Failed to set kernel args: SampleSortLocal");
+
+			globalWorkSize[0] = smallBuckets.size() * localWorkSize[0];
+			clError = clEnqueueNDRangeKernel(CommandQueue, m_SampleSortLocalKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+			V_RETURN_CL(clError, "Error executing SampleSortLocal kernel!");
+			smallBuckets.clear();
+		}
+
+		segments.swap(nextSegments);
+		swap(src, dst);
+	}
+
+	// arrays that fit into local memory right away
+	if (!smallBuckets.empty()) {
+		V_RETURN_CL(clEnqueueWriteBuffer(CommandQueue, m_dSampleSortSmallBuckets, CL_TRUE, 0, smallBuckets.size() * sizeof(cl_uint2), &smallBuckets[0], 0, NULL, NULL), "Error copying sample sort buckets to device!");
+
+		clError = clSetKernelArg(m_SampleSortLocalKernel, 0, sizeof(cl_mem), (void*)&m_dPingArray);
+		clError |= clSetKernelArg(m_SampleSortLocalKernel, 1, sizeof(cl_mem), (void*)&m_dPingArray);
+		clError |= clSetKernelArg(m_SampleSortLocalKernel, 2, sizeof(cl_mem), (void*)&m_dSampleSortSmallBuckets);
+		V_RETURN_CL(clError, "Failed to set kernel args: SampleSortLocal");
+
+		globalWorkSize[0] = localWorkSize[0];
+		clError = clEnqueueNDRangeKernel(CommandQueue, m_SampleSortLocalKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+		V_RETURN_CL(clError, "Error executing SampleSortLocal kernel!");
+	}
+}
+
+void CSortTask::Sort_RadixSort(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+{
+	cl_int clError;
+	size_t globalWorkSize[1];
+	size_t localWorkSize[1];
+
+	localWorkSize[0] = LocalWorkSize[0];
+	cl_uint size = (cl_uint)m_N;
+
+	// start with the identity permutation as values
+	globalWorkSize[0] = CLUtil::GetGlobalWorkSize(m_N, localWorkSize[0]);
+	clError = clSetKernelArg(m_RadixInitValuesKernel, 0, sizeof(cl_mem), (void*)&m_dRadixValues[0]);
+	clError |= clSetKernelArg(m_RadixInitValuesKernel, 1, sizeof(cl_uint), (void*)&size);
+	V_RETURN_CL(clError, "Failed to set kernel args: RadixInitValues");
+
+	clError = clEnqueueNDRangeKernel(CommandQueue, m_RadixInitValuesKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+	V_RETURN_CL(clError, "Error executing RadixInitValues kernel!");
+
+	// with a known key range only the bits of key - minimum that differ need passes
+	cl_uint base = 0, keyBits = m_KeyHi - m_KeyLo;
+	cl_uint lo, hi;
+	if (m_dKeyRange && FindKeyRange(CommandQueue, lo, hi)) {
+		base = lo;
+		keyBits = 0;
+		while (keyBits < 32 && ((hi - lo) >> keyBits) > 0)
+			keyBits++;
+	}
+
+	// one stable counting pass per digit, least significant digit first
+	EnqueueRadixPasses(Context, CommandQueue, m_dPingArray, m_dPongArray, m_dRadixValues[0], m_dRadixValues[1], m_dRadixCounters, m_N, base, keyBits);
+}
+
+bool CSortTask::EnqueueRadixPasses(cl_context Context, cl_command_queue CommandQueue, cl_mem& Keys, cl_mem& KeysOut, cl_mem& Values,
+	cl_mem& ValuesOut, cl_mem Counters, size_t Size, cl_uint Base, cl_uint KeyBits)
+{
+	// Keys and Values hold the result, the counters need (1 << RADIX_BITS) entries per tile
+	cl_int clError;
+	size_t globalWorkSize[1];
+	size_t localWorkSize[1];
+	localWorkSize[0] = LocalWorkSize[0];
+	size_t tileSize = RADIX_ELEMENTS_PER_ITEM * LocalWorkSize[0];
+	size_t numTiles = (Size + tileSize - 1) / tileSize;
+	cl_uint size = (cl_uint)Size;
+
+	globalWorkSize[0] = numTiles * localWorkSize[0];
+	for (cl_uint shift = 0; shift < KeyBits; shift += RADIX_BITS) {
+		clError = clSetKernelArg(m_RadixHistogramKernel, 0, sizeof(cl_mem), (void*)&Keys);
+		clError |= clSetKernelArg(m_RadixHistogramKernel, 1, sizeof(cl_mem), (void*)&Counters);
+		clError |= clSetKernelArg(m_RadixHistogramKernel, 2, sizeof(cl_uint), (void*)&size);
+		clError |= clSetKernelArg(m_RadixHistogramKernel, 3, sizeof(cl_uint), (void*)&shift);
+		clError |= clSetKernelArg(m_RadixHistogramKernel, 4, sizeof(cl_uint), (void*)&Base);
+		V_RETURN_FALSE_CL(clError, "Failed to set kernel args: RadixHistogram");
+
+		clError = clEnqueueNDRangeKernel(CommandQueue, m_RadixHistogramKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+		V_RETURN_FALSE_CL(clError, "Error executing RadixHistogram kernel!");
+
+		ExclusiveScan(Context, CommandQueue, Counters, (1 << RADIX_BITS) * numTiles);
+
+		clError = clSetKernelArg(m_RadixScatterKernel, 0, sizeof(cl_mem), (void*)&Keys);
+		clError |= clSetKernelArg(m_RadixScatterKernel, 1, sizeof(cl_mem), (void*)&Values);
+		clError |= clSetKernelArg(m_RadixScatterKernel, 2, sizeof(cl_mem), (void*)&KeysOut);
+		clError |= clSetKernelArg(m_RadixScatterKernel, 3, sizeof(cl_mem), (void*)&ValuesOut);
+		clError |= clSetKernelArg(m_RadixScatterKernel, 4, sizeof(cl_mem), (void*)&Counters);
+		clError |= clSetKernelArg(m_RadixScatterKernel, 5, sizeof(cl_uint), (void*)&size);
+		clError |= clSetKernelArg(m_RadixScatterKernel, 6, sizeof(cl_uint), (void*)&shift);
+		clError |= clSetKernelArg(m_RadixScatterKernel, 7, sizeof(cl_uint), (void*)&Base);
+		V_RETURN_FALSE_CL(clError, "Failed to set kernel args: RadixScatter");
+
+		clError = clEnqueueNDRangeKernel(CommandQueue, m_RadixScatterKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+		V_RETURN_FALSE_CL(clError, "Error executing RadixScatter kernel!");
+
+		swap(Keys, KeysOut);
+		swap(Values, ValuesOut);
+	}
+	return true;
+}
+
+bool CSortTask::FindKeyRange(cl_command_queue CommandQueue, cl_uint& Lo, cl_uint& Hi)
+{
+	cl_int clError;
+	size_t globalWorkSize[1];
+	size_t localWorkSize[1];
+
+	// grid-stride loop like the fingerprint, only the two results are read back
+	localWorkSize[0] = LocalWorkSize[0];
+	globalWorkSize[0] = min(CLUtil::GetGlobalWorkSize(m_N, localWorkSize[0]), VALIDATE_MAX_GROUPS * localWorkSize[0]);
+	cl_uint range[2] = { UINT_MAX, 0 };
+	cl_uint size = (cl_uint)m_N;
+
+	V_RETURN_FALSE_CL(clEnqueueWriteBuffer(CommandQueue, m_dKeyRange, CL_FALSE, 0, sizeof(range), range, 0, NULL, NULL), "Error resetting the key range!");
+
+	clError = clSetKernelArg(m_RangeMinMaxKernel, 0, sizeof(cl_mem), (void*)&m_dPingArray);
+	clError |= clSetKernelArg(m_RangeMinMaxKernel, 1, sizeof(cl_mem), (void*)&m_dKeyRange);
+	clError |= clSetKernelArg(m_RangeMinMaxKernel, 2, sizeof(cl_uint), (void*)&size);
+	V_RETURN_FALSE_CL(clError, "Failed to set kernel args: Range_MinMax");
+
+	clError = clEnqueueNDRangeKernel(CommandQueue, m_RangeMinMaxKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+	V_RETURN_FALSE_CL(clError, "Error executing Range_MinMax kernel!");
+
+	V_RETURN_FALSE_CL(clEnqueueReadBuffer(CommandQueue, m_dKeyRange, CL_TRUE, 0, sizeof(range), range, 0, NULL, NULL), "Error reading data from device!");
+	Lo = range[0];
+	Hi = range[1];
+	return true;
+}
+
+bool CSortTask::Sort_Counting(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+{
+	// keys with the same KEY have to be identical, so the key values can be written from the counts
+	if (!m_Comparator.empty() || m_KeyHi - m_KeyLo < 32)
+		return false;
+	cl_uint lo, hi;
+	if (!FindKeyRange(CommandQueue, lo, hi) || (size_t)(hi - lo) >= min<size_t>(COUNTING_MAX_RANGE, m_N))
+		return false;
+
+	cl_int clError;
+	size_t globalWorkSize[1];
+	size_t localWorkSize[1];
+	localWorkSize[0] = LocalWorkSize[0];
+	cl_uint size = (cl_uint)m_N;
+	cl_uint range = hi - lo + 1;
+	cl_uint zero = 0;
+
+	// histogram with a grid-stride loop, so every work-group merges its local bins only once
+	V_RETURN_FALSE_CL(clEnqueueFillBuffer(CommandQueue, m_dCountingCounts, &zero, sizeof(cl_uint), 0, range * sizeof(cl_uint), 0, NULL, NULL), "Error resetting the counters!");
+	globalWorkSize[0] = min(CLUtil::GetGlobalWorkSize(m_N, localWorkSize[0]), VALIDATE_MAX_GROUPS * localWorkSize[0]);
+	clError = clSetKernelArg(m_CountingHistogramKernel, 0, sizeof(cl_mem), (void*)&m_dPingArray);
+	clError |= clSetKernelArg(m_CountingHistogramKernel, 1, sizeof(cl_mem), (void*)&m_dCountingCounts);
+	clError |= clSetKernelArg(m_CountingHistogramKernel, 2, sizeof(cl_uint), (void*)&size);
+	clError |= clSetKernelArg(m_CountingHistogramKernel, 3, sizeof(cl_uint), (void*)&range);
+	clError |= clSetKernelArg(m_CountingHistogramKernel, 4, sizeof(cl_uint), (void*)&lo);
+	clError |= clSetKernelArg(m_CountingHistogramKernel, 5, sizeof(cl_uint), (void*)&hi);
+	V_RETURN_FALSE_CL(clError, "Failed to set kernel args: CountingHistogram");
+	clError = clEnqueueNDRangeKernel(CommandQueue, m_CountingHistogramKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+	V_RETURN_FALSE_CL(clError, "Error executing CountingHistogram kernel!");
+
+	ExclusiveScan(Context, CommandQueue, m_dCountingCounts, range);
+
+	// the keys only depend on the offsets, so this works in place as well. Padding as in the input
+	globalWorkSize[0] = CLUtil::GetGlobalWorkSize(m_N, localWorkSize[0]);
+	clError = clSetKernelArg(m_CountingWriteKernel, 0, sizeof(cl_mem), (void*)&m_dCountingCounts);
+	clError |= clSetKernelArg(m_CountingWriteKernel, 1, sizeof(cl_mem), (void*)&m_dPongArray);
+	clError |= clSetKernelArg(m_CountingWriteKernel, 2, sizeof(cl_uint), (void*)&size);
+	clError |= clSetKernelArg(m_CountingWriteKernel, 3, sizeof(cl_uint), (void*)&range);
+	clError |= clSetKernelArg(m_CountingWriteKernel, 4, sizeof(cl_uint), (void*)&lo);
+	clError |= clSetKernelArg(m_CountingWriteKernel, 5, sizeof(cl_uint), (void*)&hi);
+	V_RETURN_FALSE_CL(clError, "Failed to set kernel args: CountingWrite");
+	clError = clEnqueueNDRangeKernel(CommandQueue, m_CountingWriteKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+	V_RETURN_FALSE_CL(clError, "Error executing CountingWrite kernel!");
+	if (m_N_padded > m_N && m_dPongArray != m_dPingArray) {
+		cl_uint sentinel = Sentinel();
+		V_RETURN_FALSE_CL(clEnqueueFillBuffer(CommandQueue, m_dPongArray, &sentinel, sizeof(cl_uint), m_N * sizeof(cl_uint), (m_N_padded - m_N) * sizeof(cl_uint), 0, NULL, NULL), "Error padding the output!");
+	}
+
+	swap(m_dPingArray, m_dPongArray);
+	return true;
+}
+
+void CSortTask::Fingerprint(cl_command_queue CommandQueue, cl_mem Data, cl_mem Result, size_t LocalWorkSize[3])
+{
+	cl_int clError;
+	size_t globalWorkSize[1];
+	size_t localWorkSize[1];
+
+	// grid-stride loop, a limited number of work-groups is enough to saturate the memory bandwidth
+	localWorkSize[0] = LocalWorkSize[0];
+	globalWorkSize[0] = min(CLUtil::GetGlobalWorkSize(m_N, localWorkSize[0]), VALIDATE_MAX_GROUPS * localWorkSize[0]);
+	cl_uint zeros[3] = { 0, 0, 0 };
+
+	V_RETURN_CL(clEnqueueWriteBuffer(CommandQueue, Result, CL_FALSE, 0, sizeof(zeros), zeros, 0, NULL, NULL), "Error resetting validation results!");
+
+	clError = clSetKernelArg(m_ValidateFingerprintKernel, 0, sizeof(cl_mem), (void*)&Data);
+	clError |= clSetKernelArg(m_ValidateFingerprintKernel, 1, sizeof(cl_mem), (void*)&Result);
+	clError |= SetIndexArg(m_ValidateFingerprintKernel, 2, m_N);
+	clError |= clSetKernelArg(m_ValidateFingerprintKernel, 3, sizeof(cl_uint), (void*)&m_ValidationSeed);
+	V_RETURN_CL(clError, "Failed to set kernel args: ValidateFingerprint");
+
+	clError = clEnqueueNDRangeKernel(CommandQueue, m_ValidateFingerprintKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+	V_RETURN_CL(clError, "Error executing ValidateFingerprint kernel!");
+}
+
+bool CSortTask::ValidateOnDevice(cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task)
+{
+	cl_int clError;
+
+	Fingerprint(CommandQueue, m_dPingArray, m_dValidationResults[1], LocalWorkSize);
+
+	// the stable permutation adds its errors to the unsorted count
+	if (Task == 4 && m_StableMode) {
+		size_t localWorkSize[1] = { LocalWorkSize[0] };
+		size_t globalWorkSize[1] = { min(CLUtil::GetGlobalWorkSize(m_N, localWorkSize[0]), VALIDATE_MAX_GROUPS * localWorkSize[0]) };
+		cl_uint size = (cl_uint)m_N;
+
+		clError = clSetKernelArg(m_ValidateStablePermutationKernel, 0, sizeof(cl_mem), (void*)&m_dPingArray);
+		clError |= clSetKernelArg(m_ValidateStablePermutationKernel, 1, sizeof(cl_mem), (void*)&m_dRadixValues[0]);
+		clError |= clSetKernelArg(m_ValidateStablePermutationKernel, 2, sizeof(cl_mem), (void*)&m_dValidationInput);
+		clError |= clSetKernelArg(m_ValidateStablePermutationKernel, 3, sizeof(cl_mem), (void*)&m_dValidationResults[1]);
+		clError |= clSetKernelArg(m_ValidateStablePermutationKernel, 4, sizeof(cl_uint), (void*)&size);
+		V_RETURN_FALSE_CL(clError, "Failed to set kernel args: ValidateStablePermutation");
+
+		clError = clEnqueueNDRangeKernel(CommandQueue, m_ValidateStablePermutationKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+		V_RETURN_FALSE_CL(clError, "Error executing ValidateStablePermutation kernel!");
+	}
+
+	cl_uint input[3], output[3];
+	V_RETURN_FALSE_CL(clEnqueueReadBuffer(CommandQueue, m_dValidationResults[0], CL_FALSE, 0, sizeof(input), input, 0, NULL, NULL), "Error reading validation results!");
+	V_RETURN_FALSE_CL(clEnqueueReadBuffer(CommandQueue, m_dValidationResults[1], CL_TRUE, 0, sizeof(output), output, 0, NULL, NULL), "Error reading validation results!");
+
+	// sorted and the same multiset of keys as the input
+	return output[0] == 0 && output[1] == input[1] && output[2] == input[2];
+}
+
+bool CSortTask::ReserveScan(cl_context Context, size_t Size)
+{
+	if (Size <= m_ScanCapacity)
+		return true;
+
+	//one block sums array per level, the last level has a single block
+	for (size_t i = 0; i < m_dScanBlockSums.size(); i++)
+		SAFE_RELEASE_MEMOBJECT(m_dScanBlockSums[i]);
+	m_dScanBlockSums.clear();
+	m_ScanCapacity = 0;
+	cl_int clError;
+	for (size_t scanSize = Size; ; ) {
+		size_t blocks = (scanSize + 2 * LocalWorkSize[0] - 1) / (2 * LocalWorkSize[0]);
+		m_dScanBlockSums.push_back(clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * blocks, NULL, &clError));
+		V_RETURN_FALSE_CL(clError, "Error allocating scan arrays");
+		if (blocks == 1) break;
+		scanSize = blocks;
+	}
+	m_ScanCapacity = Size;
+	return true;
+}
+
+void CSortTask::ExclusiveScan(cl_context Context, cl_command_queue CommandQueue, cl_mem Data, size_t Size, unsigned int Level)
+{
+	cl_int clError;
+	size_t globalWorkSize[1];
+	size_t localWorkSize[1];
+
+	// every work-group scans 2 * localWorkSize elements
+	localWorkSize[0] = LocalWorkSize[0];
+	size_t blocks = (Size + 2 * localWorkSize[0] - 1) / (2 * localWorkSize[0]);
+	globalWorkSize[0] = blocks * localWorkSize[0];
+	cl_uint size = (cl_uint)Size;
+
+	clError = clSetKernelArg(m_ScanLocalKernel, 0, sizeof(cl_mem), (void*)&Data);
+	clError |= clSetKernelArg(m_ScanLocalKernel, 1, sizeof(cl_mem), (void*)&m_dScanBlockSums[Level]);
+	clError |= clSetKernelArg(m_ScanLocalKernel, 2, sizeof(cl_uint), (void*)&size);
+	V_RETURN_CL(clError, "Failed to set kernel args: ScanLocal");
+
+	clError = clEnqueueNDRangeKernel(CommandQueue, m_ScanLocalKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+	V_RETURN_CL(clError, "Error executing ScanLocal kernel!");
+
+	if (blocks > 1) {
+		// scan the block sums and add them to the blocks
+		ExclusiveScan(Context, CommandQueue, m_dScanBlockSums[Level], blocks, Level + 1);
+
+		clError = clSetKernelArg(m_ScanAddKernel, 0, sizeof(cl_mem), (void*)&Data);
+		clError |= clSetKernelArg(m_ScanAddKernel, 1, sizeof(cl_mem), (void*)&m_dScanBlockSums[Level]);
+		clError |= clSetKernelArg(m_ScanAddKernel, 2, sizeof(cl_uint), (void*)&size);
+		V_RETURN_CL(clError, "Failed to set kernel args: ScanAdd");
+
+		clError = clEnqueueNDRangeKernel(CommandQueue, m_ScanAddKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+		V_RETURN_CL(clError, "Error executing ScanAdd kernel!");
+	}
+}
+
+bool CSortTask::FindRuns(cl_context Context, cl_command_queue CommandQueue, cl_uint& NumRuns)
+{
+	if (m_WideIndex) {
+		cerr << "Error: the post-sort primitives need 32-bit indices" << endl;
+		return false;
+	}
+
+	//the run of every key, the compacted keys and values per run
+	cl_int clError, clError2;
+	if (m_dPostRuns == NULL) {
+		m_dPostRuns = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * (m_N + 1), NULL, &clError2);
+		clError = clError2;
+		m_dPostKeys = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N, NULL, &clError2);
+		clError |= clError2;
+		m_dPostValues = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N, NULL, &clError2);
+		clError |= clError2;
+		V_RETURN_FALSE_CL(clError, "Error allocating post-sort arrays");
+	}
+
+	size_t localWorkSize[1] = { LocalWorkSize[0] };
+	size_t globalWorkSize[1] = { CLUtil::GetGlobalWorkSize(m_N + 1, localWorkSize[0]) };
+	cl_uint size = (cl_uint)m_N;
+
+	clError = clSetKernelArg(m_PostRunHeadsKernel, 0, sizeof(cl_mem), (void*)&m_dPingArray);
+	clError |= clSetKernelArg(m_PostRunHeadsKernel, 1, sizeof(cl_mem), (void*)&m_dPostRuns);
+	clError |= clSetKernelArg(m_PostRunHeadsKernel, 2, sizeof(cl_uint), (void*)&size);
+	V_RETURN_FALSE_CL(clError, "Failed to set kernel args: Post_RunHeads");
+	clError = clEnqueueNDRangeKernel(CommandQueue, m_PostRunHeadsKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+	V_RETURN_FALSE_CL(clError, "Error executing Post_RunHeads kernel!");
+
+	ExclusiveScan(Context, CommandQueue, m_dPostRuns, m_N + 1);
+
+	clError = clSetKernelArg(m_PostCompactKernel, 0, sizeof(cl_mem), (void*)&m_dPingArray);
+	clError |= clSetKernelArg(m_PostCompactKernel, 1, sizeof(cl_mem), (void*)&m_dPostRuns);
+	clError |= clSetKernelArg(m_PostCompactKernel, 2, sizeof(cl_mem), (void*)&m_dPostKeys);
+	clError |= clSetKernelArg(m_PostCompactKernel, 3, sizeof(cl_mem), (void*)&m_dPostValues);
+	clError |= clSetKernelArg(m_PostCompactKernel, 4, sizeof(cl_uint), (void*)&size);
+	V_RETURN_FALSE_CL(clError, "Failed to set kernel args: Post_Compact");
+	clError = clEnqueueNDRangeKernel(CommandQueue, m_PostCompactKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+	V_RETURN_FALSE_CL(clError, "Error executing Post_Compact kernel!");
+
+	//the only value we have to wait for, it sizes the read back
+	V_RETURN_FALSE_CL(clEnqueueReadBuffer(CommandQueue, m_dPostRuns, CL_TRUE, m_N * sizeof(cl_uint), sizeof(cl_uint), &NumRuns, 0, NULL, NULL), "Error reading data from device!");
+	return true;
+}
+
+bool CSortTask::ReadRuns(cl_command_queue CommandQueue, cl_uint NumRuns, vector<unsigned int>& Keys, vector<unsigned int>* Values)
+{
+	Keys.resize(NumRuns);
+	V_RETURN_FALSE_CL(clEnqueueReadBuffer(CommandQueue, m_dPostKeys, Values == NULL, 0, NumRuns * sizeof(cl_uint), &Keys[0], 0, NULL, NULL), "Error reading data from device!");
+	if (Values) {
+		Values->resize(NumRuns);
+		V_RETURN_FALSE_CL(clEnqueueReadBuffer(CommandQueue, m_dPostValues, CL_TRUE, 0, NumRuns * sizeof(cl_uint), &(*Values)[0], 0, NULL, NULL), "Error reading data from device!");
+	}
+	return true;
+}
+
+bool CSortTask::Unique(cl_context Context, cl_command_queue CommandQueue, vector<unsigned int>& Keys)
+{
+	cl_uint numRuns;
+	return FindRuns(Context, CommandQueue, numRuns) && ReadRuns(CommandQueue, numRuns, Keys, NULL);
+}
+
+bool CSortTask::RunLengths(cl_context Context, cl_command_queue CommandQueue, vector<unsigned int>& Keys, vector<unsigned int>& Counts)
+{
+	cl_uint numRuns;
+	if (!FindRuns(Context, CommandQueue, numRuns))
+		return false;
+
+	//turn the start indices into lengths
+	size_t localWorkSize[1] = { LocalWorkSize[0] };
+	size_t globalWorkSize[1] = { CLUtil::GetGlobalWorkSize(m_N, localWorkSize[0]) };
+	cl_uint size = (cl_uint)m_N;
+	cl_int clError;
+	clError = clSetKernelArg(m_PostRunLengthsKernel, 0, sizeof(cl_mem), (void*)&m_dPingArray);
+	clError |= clSetKernelArg(m_PostRunLengthsKernel, 1, sizeof(cl_mem), (void*)&m_dPostRuns);
+	clError |= clSetKernelArg(m_PostRunLengthsKernel, 2, sizeof(cl_mem), (void*)&m_dPostValues);
+	clError |= clSetKernelArg(m_PostRunLengthsKernel, 3, sizeof(cl_uint), (void*)&size);
+	V_RETURN_FALSE_CL(clError, "Failed to set kernel args: Post_RunLengths");
+	clError = clEnqueueNDRangeKernel(CommandQueue, m_PostRunLengthsKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+	V_RETURN_FALSE_CL(clError, "Error executing Post_RunLengths kernel!");
+
+	return ReadRuns(CommandQueue, numRuns, Keys, &Counts);
+}
+
+bool CSortTask::ReduceByKey(cl_context Context, cl_command_queue CommandQueue, cl_mem Payload, cl_mem Permutation, ReduceOp Op,
+	vector<unsigned int>& Keys, vector<unsigned int>& Results)
+{
+	cl_uint numRuns;
+	if (!FindRuns(Context, CommandQueue, numRuns))
+		return false;
+
+	//runs crossing the chunks of the work-items are combined with atomics, they start with the neutral element
+	cl_uint neutral = (Op == ReduceMin) ? UINT_MAX : 0;
+	V_RETURN_FALSE_CL(clEnqueueFillBuffer(CommandQueue, m_dPostValues, &neutral, sizeof(cl_uint), 0, numRuns * sizeof(cl_uint), 0, NULL, NULL), "Error initializing the reductions!");
+
+	size_t localWorkSize[1] = { LocalWorkSize[0] };
+	size_t globalWorkSize[1] = { CLUtil::GetGlobalWorkSize((m_N + POST_ELEMENTS_PER_ITEM - 1) / POST_ELEMENTS_PER_ITEM, localWorkSize[0]) };
+	cl_uint size = (cl_uint)m_N;
+	cl_uint op = Op;
+	cl_uint gather = Permutation != NULL;
+	cl_int clError;
+	clError = clSetKernelArg(m_PostReduceKernel, 0, sizeof(cl_mem), (void*)&m_dPingArray);
+	clError |= clSetKernelArg(m_PostReduceKernel, 1, sizeof(cl_mem), (void*)&m_dPostRuns);
+	clError |= clSetKernelArg(m_PostReduceKernel, 2, sizeof(cl_mem), gather ? (void*)&Permutation : (void*)&Payload);
+	clError |= clSetKernelArg(m_PostReduceKernel, 3, sizeof(cl_mem), (void*)&Payload);
+	clError |= clSetKernelArg(m_PostReduceKernel, 4, sizeof(cl_mem), (void*)&m_dPostValues);
+	clError |= clSetKernelArg(m_PostReduceKernel, 5, sizeof(cl_uint), (void*)&size);
+	clError |= clSetKernelArg(m_PostReduceKernel, 6, sizeof(cl_uint), (void*)&op);
+	clError |= clSetKernelArg(m_PostReduceKernel, 7, sizeof(cl_uint), (void*)&gather);
+	V_RETURN_FALSE_CL(clError, "Failed to set kernel args: Post_ReduceByKey");
+	clError = clEnqueueNDRangeKernel(CommandQueue, m_PostReduceKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+	V_RETURN_FALSE_CL(clError, "Error executing Post_ReduceByKey kernel!");
+
+	return ReadRuns(CommandQueue, numRuns, Keys, &Results);
+}
+
+void CSortTask::ExecuteTask(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task)
+{
+	//write input data to the GPU
+	V_RETURN_CL(clEnqueueWriteBuffer(CommandQueue, m_dPingArray, CL_FALSE, 0, m_N_padded * sizeof(cl_uint), m_hInput, 0, NULL, NULL), "Error copying data from host to device!");
+
+	//fingerprint of the input
+	if (m_DeviceValidation) {
+		Fingerprint(CommandQueue, m_dPingArray, m_dValidationResults[0], LocalWorkSize);
+		if (Task == 4 && m_StableMode && !m_InPlace && !m_WideIndex)
+			V_RETURN_CL(clEnqueueCopyBuffer(CommandQueue, m_dPingArray, m_dValidationInput, 0, 0, m_N * sizeof(cl_uint), 0, NULL, NULL), "Error copying input for validation!");
+	}
+
+	bool skipped = false;
+	//run selected task
+	switch (Task){
+	case 0:
+		if (m_N_padded <= MERGE_LIMIT || m_InPlace)
+			Sort_Mergesort(Context, CommandQueue, LocalWorkSize);
+		else {
+			cout << endl << "Skipping Mergesort on GPU!" << endl;
+			skipped = true;
+		}
+		break;
+	case 1:
+		Sort_OddEvenMergesort(Context, CommandQueue, LocalWorkSize);
+		break;
+	case 2:
+		Sort_BitonicMergesort(Context, CommandQueue, LocalWorkSize);
+		break;
+	case 3:
+		if (!m_InPlace && !m_WideIndex)
+			Sort_SampleSort(Context, CommandQueue, LocalWorkSize);
+		else {
+			cout << endl << "Skipping SampleSort, it needs a second buffer and 32-bit indices!" << endl;
+			skipped = true;
+		}
+		break;
+	case 4:
+		if (m_InPlace || m_WideIndex) {
+			cout << endl << "Skipping RadixSort, it needs a second buffer and 32-bit indices!" << endl;
+			skipped = true;
+		}
+		else if (m_Comparator.empty())
+			Sort_RadixSort(Context, CommandQueue, LocalWorkSize);
+		else {
+			cout << endl << "Skipping RadixSort, it does not support custom comparators!" << endl;
+			skipped = true;
+		}
+		break;
+	case 5:
+		Sort_BitonicBlocked(Context, CommandQueue, LocalWorkSize);
+		break;
+	}
+
+	if (m_DeviceValidation)
+		m_deviceValid[Task] = skipped || ValidateOnDevice(CommandQueue, LocalWorkSize, Task);
+
+	//validated on the device, so only the results the later tests compare against are read back: the bitonic
+	//mergesort for the incremental inserts, the radix sort for the post-sort primitives
+	if (m_DeviceValidation && !(Task == 2 && m_IncrementalBatches > 0 && !m_WideIndex) && !(Task == 4 && m_PostSort))
+		return;
+
+	//read back the permutation of the key-value sort
+	if (Task == 4 && !skipped) {
+		if (m_resultGPUPermutation == NULL)
+			m_resultGPUPermutation = m_HostPool.AllocateArray<unsigned int>(m_N);
+		V_RETURN_CL(clEnqueueReadBuffer(CommandQueue, m_dRadixValues[0], CL_TRUE, 0, m_N * sizeof(cl_uint), m_resultGPUPermutation, 0, NULL, NULL), "Error reading data from device!");
+	}
+
+	//read back the results synchronously.
+	if (m_resultGPU[Task] == NULL)
+		m_resultGPU[Task] = m_HostPool.AllocateArray<unsigned int>(m_N);
+	//without the reference sort there is no CPU result to stand in for a skipped task, nothing reads it then
+	if (skipped) {
+		if (!m_DeviceValidation)
+			memcpy(m_resultGPU[Task], m_resultCPU, m_N * sizeof(unsigned int));
+	}
+	else V_RETURN_CL(clEnqueueReadBuffer(CommandQueue, m_dPingArray, CL_TRUE, 0, m_N * sizeof(cl_uint), m_resultGPU[Task], 0, NULL, NULL), "Error reading data from device!");
+
+	//DEBUG TODO: change Task number or delete
+	if (Task == 012) {
+		cout << endl;
+		cout << "GPU\tCPU\tInput" << endl;
+		for (unsigned int i = 0; i < 50; i++) {
+			cout << m_resultGPU[Task][i] << "\t" << m_resultCPU[i] << "\t" << m_hInput[i] << endl;
+			//cout << m_resultGPU[Task][i] << ",\t";
+		}
+		cout << endl;
+		for (unsigned int i = 0; i < m_N; i++) {
+			cout << m_resultGPU[Task][i] << "-" << m_resultCPU[i] << ",\t";
+		}
+		cout << endl;
+	}
+}
+
+void CSortTask::TestPerformance(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task)
+{
+	cout << "Testing performance of task " << g_kernelNames[Task] << endl;
+
+	//write input data to the GPU
+	V_RETURN_CL(clEnqueueWriteBuffer(CommandQueue, m_dPingArray, CL_FALSE, 0, m_N_padded * sizeof(cl_uint), m_hInput, 0, NULL, NULL), "Error copying data from host to device!");
+	//finish all before we start meassuring the time
+	V_RETURN_CL(clFinish(CommandQueue), "Error finishing the queue!");
+
+	bool skipped = false;
+	CTimer timer;
+	timer.Start();
+
+	//run the kernel N times TODO vary this if necessary!
+	unsigned int nIterations = 10;
+	for (unsigned int i = 0; i < nIterations; i++) {
+		//run selected task
+		switch (Task){
+		case 0:
+			if (m_N_padded <= MERGE_LIMIT || m_InPlace)
+				Sort_Mergesort(Context, CommandQueue, LocalWorkSize);
+			else skipped = true;
+			break;
+		case 1:
+			Sort_OddEvenMergesort(Context, CommandQueue, LocalWorkSize);
+			break;
+		case 2:
+			Sort_BitonicMergesort(Context, CommandQueue, LocalWorkSize);
+			break;
+		case 3:
+			if (!m_InPlace && !m_WideIndex)
+				Sort_SampleSort(Context, CommandQueue, LocalWorkSize);
+			else skipped = true;
+			break;
+		case 4:
+			if (m_Comparator.empty() && !m_InPlace && !m_WideIndex)
+				Sort_RadixSort(Context, CommandQueue, LocalWorkSize);
+			else skipped = true;
+			break;
+		case 5:
+			Sort_BitonicBlocked(Context, CommandQueue, LocalWorkSize);
+			break;
+		}
+	}
+
+	//wait until the command queue is empty again
+	V_RETURN_CL(clFinish(CommandQueue), "Error finishing the queue!");
 
 	timer.Stop();
 
@@ -528,4 +2187,1141 @@ void CSortTask::TestPerformance(cl_context Context, cl_command_queue CommandQueu
 	}
 }
 
+void CSortTask::ReportBandwidth(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+{
+	cout << "Bandwidth report" << endl;
+
+	// the launches are timed with events, on a queue of their own with profiling enabled
+	cl_int clError;
+	cl_device_id device;
+	V_RETURN_CL(clGetCommandQueueInfo(CommandQueue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL), "Failed to get the device of the queue!");
+	cl_command_queue queue = clCreateCommandQueue(Context, device, CL_QUEUE_PROFILING_ENABLE, &clError);
+	V_RETURN_CL(clError, "Failed to create a profiling command queue!");
+
+	double peak = 0;
+	if (MeasurePeakBandwidth(queue, LocalWorkSize, peak)) {
+		cout << "  peak copy bandwidth: " << peak << " GB/s" << endl;
+
+		// the same variants as TestPerformance, with every instrumented launch recorded
+		const unsigned int tasks[3] = { 0, 2, 5 };
+		for (int t = 0; t < 3; t++) {
+			if (tasks[t] == 0 && m_N_padded > MERGE_LIMIT && !m_InPlace)
+				continue;
+			cout << " " << g_kernelNames[tasks[t]] << endl;
+			if (clEnqueueWriteBuffer(queue, m_dPingArray, CL_TRUE, 0, m_N_padded * sizeof(cl_uint), m_hInput, 0, NULL, NULL) != CL_SUCCESS)
+				break;
+			m_ProfileLaunches = true;
+			if (tasks[t] == 0)
+				Sort_Mergesort(Context, queue, LocalWorkSize);
+			else if (tasks[t] == 2)
+				Sort_BitonicMergesort(Context, queue, LocalWorkSize);
+			else
+				Sort_BitonicBlocked(Context, queue, LocalWorkSize);
+			m_ProfileLaunches = false;
+			clFinish(queue);
+			PrintLaunches(peak);
+		}
+	}
+	clReleaseCommandQueue(queue);
+}
+
+bool CSortTask::MeasurePeakBandwidth(cl_command_queue CommandQueue, size_t LocalWorkSize[3], double& PeakGBs)
+{
+	// the best of a few copies of the whole array, ping to pong (in place in in-place mode)
+	size_t vectors = m_N_padded / 4;
+	size_t localWorkSize[1] = { LocalWorkSize[0] };
+	size_t globalWorkSize[1] = { CLUtil::GetGlobalWorkSize(vectors, localWorkSize[0]) };
+	cl_int clError = clSetKernelArg(m_BandwidthCopyKernel, 0, sizeof(cl_mem), (void*)&m_dPingArray);
+	clError |= clSetKernelArg(m_BandwidthCopyKernel, 1, sizeof(cl_mem), (void*)&m_dPongArray);
+	clError |= SetIndexArg(m_BandwidthCopyKernel, 2, vectors);
+	V_RETURN_FALSE_CL(clError, "Failed to set kernel args: BandwidthCopyKernel");
+
+	double bestMs = 0;
+	for (int i = 0; i < 5; i++) {
+		cl_event event;
+		V_RETURN_FALSE_CL(clEnqueueNDRangeKernel(CommandQueue, m_BandwidthCopyKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, &event), "Error executing BandwidthCopyKernel!");
+		V_RETURN_FALSE_CL(clWaitForEvents(1, &event), "Error waiting for BandwidthCopyKernel!");
+		cl_ulong start = 0, end = 0;
+		clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+		clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+		clReleaseEvent(event);
+		double ms = 1.0e-6 * (double)(end - start);
+		if (i == 0 || ms < bestMs)
+			bestMs = ms;
+	}
+	PeakGBs = bestMs > 0 ? 2.0 * m_N_padded * sizeof(cl_uint) / (bestMs * 1.0e6) : 0;
+	return PeakGBs > 0;
+}
+
+void CSortTask::PrintLaunches(double PeakGBs)
+{
+	// sum up bytes and device time per kernel (in order of the first launch) and per stage class
+	struct CKernelTotal { string Name; size_t Launches; double Bytes; double Ms; };
+	vector<CKernelTotal> kernels;
+	double classBytes[2] = { 0, 0 }, classMs[2] = { 0, 0 };
+	for (size_t i = 0; i < m_KernelLaunches.size(); i++) {
+		const CKernelLaunch& launch = m_KernelLaunches[i];
+		char name[256] = "";
+		clGetKernelInfo(launch.Kernel, CL_KERNEL_FUNCTION_NAME, sizeof(name), name, NULL);
+		cl_ulong start = 0, end = 0;
+		clGetEventProfilingInfo(launch.Event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+		clGetEventProfilingInfo(launch.Event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+		clReleaseEvent(launch.Event);
+		double ms = 1.0e-6 * (double)(end - start);
+
+		size_t k = 0;
+		while (k < kernels.size() && kernels[k].Name != name)
+			k++;
+		if (k == kernels.size()) {
+			CKernelTotal total = { name, 0, 0, 0 };
+			kernels.push_back(total);
+		}
+		kernels[k].Launches++;
+		kernels[k].Bytes += (double)launch.Bytes;
+		kernels[k].Ms += ms;
+		classBytes[launch.GlobalStage] += (double)launch.Bytes;
+		classMs[launch.GlobalStage] += ms;
+	}
+	m_KernelLaunches.clear();
+
+	if (kernels.empty()) {
+		cout << "  no launches recorded (counting sort or single host call)" << endl;
+		return;
+	}
+	for (size_t k = 0; k < kernels.size(); k++) {
+		double gbs = kernels[k].Ms > 0 ? kernels[k].Bytes / (kernels[k].Ms * 1.0e6) : 0;
+		cout << "  " << kernels[k].Name << ": " << kernels[k].Launches << " launches, " << kernels[k].Ms << " ms, "
+			<< gbs << " GB/s, " << 100.0 * gbs / PeakGBs << "% of peak" << endl;
+	}
+	const char* classNames[2] = { "local stages", "global stages" };
+	for (int c = 0; c < 2; c++) {
+		if (classMs[c] <= 0)
+			continue;
+		double gbs = classBytes[c] / (classMs[c] * 1.0e6);
+		cout << "  " << classNames[c] << ": " << classMs[c] << " ms, " << gbs << " GB/s, " << 100.0 * gbs / PeakGBs << "% of peak" << endl;
+	}
+}
+
+// a sort in flight, completed by the callback of its last command
+struct CAsyncSort
+{
+	std::promise<bool>			Done;
+	std::function<void(bool)>	Callback;
+};
+
+static void CL_CALLBACK AsyncSortDone(cl_event Event, cl_int Status, void* UserData)
+{
+	CAsyncSort* sort = (CAsyncSort*)UserData;
+	clReleaseEvent(Event);
+	if (sort->Callback)
+		sort->Callback(Status == CL_COMPLETE);
+	sort->Done.set_value(Status == CL_COMPLETE);
+	delete sort;
+}
+
+future<bool> CSortTask::SortAsync(cl_context Context, const unsigned int* Input, unsigned int* Output, size_t Size, function<void(bool)> Callback)
+{
+	CAsyncSort* sort = new CAsyncSort();
+	sort->Callback = Callback;
+	future<bool> done = sort->Done.get_future();
+
+	//a buffer of its own, one is enough as the start kernel works in place. The stages need at least one full tile.
+	size_t padded = max(getPaddedSize(Size), 2 * LocalWorkSize[0]);
+	cl_command_queue queue = m_AsyncQueues.empty() ? NULL : m_AsyncQueues[m_NextAsyncQueue++ % m_AsyncQueues.size()];
+	cl_int clError = CL_INVALID_COMMAND_QUEUE;
+	cl_mem buffer = NULL;
+	if (queue && (m_WideIndex || padded <= UINT_MAX))
+		buffer = clCreateBuffer(Context, CL_MEM_READ_WRITE, padded * sizeof(cl_uint), NULL, &clError);
+
+	if (buffer) {
+		cl_uint sentinel = Sentinel();
+		cl_event event = NULL;
+		clError = clEnqueueWriteBuffer(queue, buffer, CL_FALSE, 0, Size * sizeof(cl_uint), Input, 0, NULL, NULL);
+		if (clError == CL_SUCCESS && padded > Size)
+			clError = clEnqueueFillBuffer(queue, buffer, &sentinel, sizeof(cl_uint), Size * sizeof(cl_uint), (padded - Size) * sizeof(cl_uint), 0, NULL, NULL);
+		if (clError == CL_SUCCESS && !EnqueueBitonicMergesort(queue, buffer, buffer, padded, padded, LocalWorkSize))
+			clError = CL_INVALID_KERNEL_ARGS;
+		if (clError == CL_SUCCESS)
+			clError = clEnqueueReadBuffer(queue, buffer, CL_FALSE, 0, Size * sizeof(cl_uint), Output, 0, NULL, &event);
+		if (clError == CL_SUCCESS)
+			clError = clSetEventCallback(event, CL_COMPLETE, AsyncSortDone, sort);
+		else
+			event = NULL;
+		clFlush(queue);
+
+		//the buffer lives until the commands using it are done, the callback releases the event
+		clReleaseMemObject(buffer);
+		if (clError == CL_SUCCESS)
+			return done;
+		if (event)
+			clReleaseEvent(event);
+	}
+
+	cerr << "Error: cannot submit the asynchronous sort [" << CLUtil::GetCLErrorString(clError) << "]" << endl;
+	if (sort->Callback)
+		sort->Callback(false);
+	sort->Done.set_value(false);
+	delete sort;
+	return done;
+}
+
+bool CSortTask::SortBatch(cl_context Context, cl_command_queue CommandQueue, const vector<unsigned int*>& Arrays, const vector<size_t>& Sizes)
+{
+	//the bitonic stages need a power of two of at least one tile per segment and a power of two of segments
+	size_t segment = 2 * LocalWorkSize[0];
+	for (size_t i = 0; i < Sizes.size(); i++)
+		segment = max(segment, getPaddedSize(Sizes[i]));
+	size_t size = segment * getPaddedSize(Arrays.size());
+	if (!m_WideIndex && size > UINT_MAX)
+		return false;
+
+	cl_int clError;
+	if (!ReserveBatchBuffer(Context, size))
+		return false;
+
+	//sentinels everywhere first, then every array at the start of its segment. The copies are not blocking, so the queue
+	//is finished before returning in any case
+	cl_uint sentinel = Sentinel();
+	clError = clEnqueueFillBuffer(CommandQueue, m_dBatchBuffer, &sentinel, sizeof(cl_uint), 0, size * sizeof(cl_uint), 0, NULL, NULL);
+	for (size_t i = 0; i < Arrays.size() && clError == CL_SUCCESS; i++)
+		clError = clEnqueueWriteBuffer(CommandQueue, m_dBatchBuffer, CL_FALSE, i * segment * sizeof(cl_uint), Sizes[i] * sizeof(cl_uint), Arrays[i], 0, NULL, NULL);
+	bool sorted = clError == CL_SUCCESS && EnqueueBitonicMergesort(CommandQueue, m_dBatchBuffer, m_dBatchBuffer, size, segment, LocalWorkSize);
+	for (size_t i = 0; i < Arrays.size() && sorted && clError == CL_SUCCESS; i++)
+		clError = clEnqueueReadBuffer(CommandQueue, m_dBatchBuffer, CL_FALSE, i * segment * sizeof(cl_uint), Sizes[i] * sizeof(cl_uint), Arrays[i], 0, NULL, NULL);
+	cl_int finished = clFinish(CommandQueue);
+	V_RETURN_FALSE_CL(clError, "Error copying the batch between host and device!");
+	V_RETURN_FALSE_CL(finished, "Error finishing the queue!");
+	return sorted;
+}
+
+bool CSortTask::ReserveBatchBuffer(cl_context Context, size_t Size)
+{
+	if (Size <= m_BatchCapacity)
+		return true;
+
+	cl_int clError;
+	SAFE_RELEASE_MEMOBJECT(m_dBatchBuffer);
+	m_BatchCapacity = 0;
+	m_dBatchBuffer = clCreateBuffer(Context, CL_MEM_READ_WRITE, Size * sizeof(cl_uint), NULL, &clError);
+	V_RETURN_FALSE_CL(clError, "Error allocating the batch buffer");
+	m_BatchCapacity = Size;
+	return true;
+}
+
+bool CSortTask::InsertBatch(cl_context Context, cl_command_queue CommandQueue, const unsigned int* Batch, size_t Size)
+{
+	size_t total = m_ResidentSize + Size;
+	if (Size == 0)
+		return true;
+	if (total > UINT_MAX) {
+		cerr << "Error: the resident set is limited to 2^32 - 1 keys" << endl;
+		return false;
+	}
+
+	//sort the batch on its own, padded to a power of two of at least one tile. The upload blocks, so the caller may
+	//reuse Batch right away
+	size_t padded = max(getPaddedSize(Size), 2 * LocalWorkSize[0]);
+	if (!ReserveBatchBuffer(Context, padded))
+		return false;
+	cl_uint sentinel = Sentinel();
+	V_RETURN_FALSE_CL(clEnqueueWriteBuffer(CommandQueue, m_dBatchBuffer, CL_TRUE, 0, Size * sizeof(cl_uint), Batch, 0, NULL, NULL), "Error copying data from host to device!");
+	if (padded > Size)
+		V_RETURN_FALSE_CL(clEnqueueFillBuffer(CommandQueue, m_dBatchBuffer, &sentinel, sizeof(cl_uint), Size * sizeof(cl_uint), (padded - Size) * sizeof(cl_uint), 0, NULL, NULL), "Error padding the batch!");
+	if (!EnqueueBitonicMergesort(CommandQueue, m_dBatchBuffer, m_dBatchBuffer, padded, padded, LocalWorkSize))
+		return false;
+
+	//grow both set buffers by doubling, the set is copied over
+	cl_int clError, clError2;
+	if (total > m_ResidentCapacity) {
+		size_t capacity = max(total, 2 * m_ResidentCapacity);
+		cl_mem buffers[2];
+		buffers[0] = clCreateBuffer(Context, CL_MEM_READ_WRITE, capacity * sizeof(cl_uint), NULL, &clError2);
+		clError = clError2;
+		buffers[1] = clCreateBuffer(Context, CL_MEM_READ_WRITE, capacity * sizeof(cl_uint), NULL, &clError2);
+		clError |= clError2;
+		if (clError == CL_SUCCESS && m_ResidentSize > 0)
+			clError = clEnqueueCopyBuffer(CommandQueue, m_dResident[0], buffers[0], 0, 0, m_ResidentSize * sizeof(cl_uint), 0, NULL, NULL);
+		if (clError != CL_SUCCESS) {
+			SAFE_RELEASE_MEMOBJECT(buffers[0]);
+			SAFE_RELEASE_MEMOBJECT(buffers[1]);
+		}
+		V_RETURN_FALSE_CL(clError, "Error growing the resident set");
+		SAFE_RELEASE_MEMOBJECT(m_dResident[0]);
+		SAFE_RELEASE_MEMOBJECT(m_dResident[1]);
+		m_dResident[0] = buffers[0];
+		m_dResident[1] = buffers[1];
+		m_ResidentCapacity = capacity;
+	}
+
+	//one merge pass into the other buffer, which then holds the set
+	size_t localWorkSize[1] = { LocalWorkSize[0] };
+	size_t globalWorkSize[1] = { CLUtil::GetGlobalWorkSize(total, localWorkSize[0]) };
+	cl_uint setSize = (cl_uint)m_ResidentSize;
+	cl_uint batchSize = (cl_uint)Size;
+	clError = clSetKernelArg(m_MergeInsertKernel, 0, sizeof(cl_mem), (void*)&m_dResident[0]);
+	clError |= clSetKernelArg(m_MergeInsertKernel, 1, sizeof(cl_uint), (void*)&setSize);
+	clError |= clSetKernelArg(m_MergeInsertKernel, 2, sizeof(cl_mem), (void*)&m_dBatchBuffer);
+	clError |= clSetKernelArg(m_MergeInsertKernel, 3, sizeof(cl_uint), (void*)&batchSize);
+	clError |= clSetKernelArg(m_MergeInsertKernel, 4, sizeof(cl_mem), (void*)&m_dResident[1]);
+	V_RETURN_FALSE_CL(clError, "Failed to set kernel args: Sort_MergeInsert");
+	clError = clEnqueueNDRangeKernel(CommandQueue, m_MergeInsertKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+	V_RETURN_FALSE_CL(clError, "Error executing Sort_MergeInsert kernel!");
+
+	swap(m_dResident[0], m_dResident[1]);
+	m_ResidentSize = total;
+	clFlush(CommandQueue);
+	return true;
+}
+
+bool CSortTask::ReadResident(cl_command_queue CommandQueue, unsigned int* Keys)
+{
+	if (m_ResidentSize > 0)
+		V_RETURN_FALSE_CL(clEnqueueReadBuffer(CommandQueue, m_dResident[0], CL_TRUE, 0, m_ResidentSize * sizeof(cl_uint), Keys, 0, NULL, NULL), "Error reading data from device!");
+	return true;
+}
+
+void CSortTask::TestAsync(cl_context Context)
+{
+	//a few slices per queue, submitted without waiting in between
+	size_t numSorts = 4 * m_AsyncQueues.size();
+	size_t sliceSize = (m_N + numSorts - 1) / numSorts;
+	cout << "Testing " << numSorts << " concurrent sorts of " << sliceSize << " keys on " << m_AsyncQueues.size() << " command queues" << endl;
+
+	vector<unsigned int> results(m_N);
+	vector<future<bool>> sorts;
+	atomic<size_t> completed(0);
+	CTimer timer;
+	timer.Start();
+
+	for (size_t start = 0; start < m_N; start += sliceSize)
+		sorts.push_back(SortAsync(Context, m_hInput + start, &results[start], min(sliceSize, m_N - start),
+			[&completed](bool Success) { if (Success) completed++; }));
+	for (size_t i = 0; i < sorts.size(); i++)
+		m_AsyncValid &= sorts[i].get();
+	m_AsyncValid &= completed == sorts.size();
+
+	timer.Stop();
+	double ms = timer.GetElapsedMilliseconds();
+	cout << "  time: " << ms << " ms, throughput: " << 1.0e-3 * (double)m_N / ms << " Melem/s" << endl;
+
+	//every slice has to be sorted and hold the same keys as before (custom comparators only run on the device)
+	unsigned int inputSum = 0, outputSum = 0;
+	for (size_t i = 0; i < m_N; i++) {
+		inputSum += m_hInput[i];
+		outputSum += results[i];
+		if (i % sliceSize != 0 && m_Comparator.empty() && SortLess(results[i], results[i - 1]))
+			m_AsyncValid = false;
+	}
+	if (inputSum != outputSum)
+		m_AsyncValid = false;
+}
+
+void CSortTask::TestIncremental(cl_context Context, cl_command_queue CommandQueue)
+{
+	size_t batchSize = (m_N + m_IncrementalBatches - 1) / m_IncrementalBatches;
+	cout << "Testing incremental inserts of " << m_IncrementalBatches << " batches of " << batchSize << " keys" << endl;
+
+	//every insert is timed on its own, the last one merges into the biggest set
+	ClearResident();
+	CTimer timer;
+	double ms = 0, lastMs = 0;
+	for (size_t start = 0; start < m_N && m_IncrementalValid; start += batchSize) {
+		timer.Start();
+		m_IncrementalValid = InsertBatch(Context, CommandQueue, m_hInput + start, min(batchSize, m_N - start)) && clFinish(CommandQueue) == CL_SUCCESS;
+		timer.Stop();
+		lastMs = timer.GetElapsedMilliseconds();
+		ms += lastMs;
+	}
+	cout << "  time for all inserts: " << ms << " ms, last insert: " << lastMs << " ms" << endl;
+
+	vector<unsigned int> result(m_N);
+	m_IncrementalValid = m_IncrementalValid && GetResidentSize() == m_N && ReadResident(CommandQueue, &result[0]) &&
+		memcmp(&result[0], m_resultGPU[2], m_N * sizeof(unsigned int)) == 0;
+	ClearResident();
+}
+
+bool CSortTask::ReserveStringBuffers(cl_context Context, size_t Count, size_t Bytes)
+{
+	cl_int clError = CL_SUCCESS, clError2;
+	if (Bytes > m_StringByteCapacity) {
+		SAFE_RELEASE_MEMOBJECT(m_dStringBytes);
+		m_StringByteCapacity = 0;
+		m_dStringBytes = clCreateBuffer(Context, CL_MEM_READ_ONLY, Bytes, NULL, &clError);
+		V_RETURN_FALSE_CL(clError, "Error allocating the string bytes");
+		m_StringByteCapacity = Bytes;
+	}
+	if (Count <= m_StringCapacity)
+		return true;
+
+	//the offsets and flags have one more entry, the counters one per digit and radix tile
+	size_t tileSize = RADIX_ELEMENTS_PER_ITEM * LocalWorkSize[0];
+	size_t counters = (size_t)(1 << RADIX_BITS) * ((Count + tileSize - 1) / tileSize);
+	SAFE_RELEASE_MEMOBJECT(m_dStringOffsets);
+	SAFE_RELEASE_MEMOBJECT(m_dStringPermutation);
+	SAFE_RELEASE_MEMOBJECT(m_dStringSegments);
+	SAFE_RELEASE_MEMOBJECT(m_dStringCounters);
+	m_StringCapacity = 0;
+	m_dStringOffsets = clCreateBuffer(Context, CL_MEM_READ_ONLY, sizeof(cl_uint) * (Count + 1), NULL, &clError2);
+	clError |= clError2;
+	m_dStringPermutation = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * Count, NULL, &clError2);
+	clError |= clError2;
+	m_dStringSegments = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * Count, NULL, &clError2);
+	clError |= clError2;
+	m_dStringCounters = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * counters, NULL, &clError2);
+	clError |= clError2;
+	for (int i = 0; i < 2; i++) {
+		SAFE_RELEASE_MEMOBJECT(m_dStringKeys[i]);
+		SAFE_RELEASE_MEMOBJECT(m_dStringItems[i]);
+		SAFE_RELEASE_MEMOBJECT(m_dStringPositions[i]);
+		SAFE_RELEASE_MEMOBJECT(m_dStringFlags[i]);
+		m_dStringKeys[i] = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * Count, NULL, &clError2);
+		clError |= clError2;
+		m_dStringItems[i] = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * Count, NULL, &clError2);
+		clError |= clError2;
+		m_dStringPositions[i] = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * Count, NULL, &clError2);
+		clError |= clError2;
+		m_dStringFlags[i] = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * (Count + 1), NULL, &clError2);
+		clError |= clError2;
+	}
+	V_RETURN_FALSE_CL(clError, "Error allocating the string sort arrays");
+	if (!ReserveScan(Context, max(counters, Count + 1)))
+		return false;
+	m_StringCapacity = Count;
+	return true;
+}
+
+bool CSortTask::SortStrings(cl_context Context, cl_command_queue CommandQueue, const unsigned char* Bytes, const unsigned int* Offsets,
+	size_t Count, unsigned int* Permutation)
+{
+	m_StringRounds = m_StringResorted = 0;
+	if (Count == 0)
+		return true;
+	if (!m_Comparator.empty() || m_KeyHi - m_KeyLo < 32) {
+		cerr << "Error: the string sort compares whole bytes, key bits and custom comparators are not supported" << endl;
+		return false;
+	}
+	size_t numBytes = Offsets[Count];
+	if (Count >= UINT_MAX || numBytes > UINT_MAX - 16) {
+		cerr << "Error: the string sort is limited to 2^32 - 1 strings and 4 GiB of bytes" << endl;
+		return false;
+	}
+	if (!ReserveStringBuffers(Context, Count, max<size_t>(numBytes, 1)))
+		return false;
+
+	cl_int clError;
+	size_t localWorkSize[1] = { LocalWorkSize[0] };
+	size_t globalWorkSize[1];
+	cl_uint size = (cl_uint)Count;
+	cl_uint zero = 0;
+
+	//all strings start in one segment, as items in input order at the positions of the identity permutation
+	if (numBytes > 0)
+		V_RETURN_FALSE_CL(clEnqueueWriteBuffer(CommandQueue, m_dStringBytes, CL_FALSE, 0, numBytes, Bytes, 0, NULL, NULL), "Error copying data from host to device!");
+	V_RETURN_FALSE_CL(clEnqueueWriteBuffer(CommandQueue, m_dStringOffsets, CL_FALSE, 0, sizeof(cl_uint) * (Count + 1), Offsets, 0, NULL, NULL), "Error copying data from host to device!");
+	V_RETURN_FALSE_CL(clEnqueueFillBuffer(CommandQueue, m_dStringSegments, &zero, sizeof(cl_uint), 0, sizeof(cl_uint) * Count, 0, NULL, NULL), "Error resetting the segments!");
+	globalWorkSize[0] = CLUtil::GetGlobalWorkSize(Count, localWorkSize[0]);
+	for (int i = 0; i < 2; i++) {
+		cl_mem identity = i == 0 ? m_dStringItems[0] : m_dStringPositions[0];
+		clError = clSetKernelArg(m_RadixInitValuesKernel, 0, sizeof(cl_mem), (void*)&identity);
+		clError |= clSetKernelArg(m_RadixInitValuesKernel, 1, sizeof(cl_uint), (void*)&size);
+		V_RETURN_FALSE_CL(clError, "Failed to set kernel args: RadixInitValues");
+		clError = clEnqueueNDRangeKernel(CommandQueue, m_RadixInitValuesKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+		V_RETURN_FALSE_CL(clError, "Error executing RadixInitValues kernel!");
+	}
+
+	cl_uint segments = 1;
+	for (cl_uint offset = 0; size > 0; offset += 8) {
+		m_StringRounds++;
+		if (offset > 0)
+			m_StringResorted += size;
+		globalWorkSize[0] = CLUtil::GetGlobalWorkSize(size, localWorkSize[0]);
+
+		//least significant word first: bytes left (4 bits), the two words of bytes and the significant bits of the segment
+		for (cl_uint word = 0; word < 4; word++) {
+			cl_uint base = 0, keyBits = word == 0 ? 4 : 32;
+			if (word == 3) {
+				if (segments < 2)
+					break;
+				for (keyBits = 0; keyBits < 32 && ((segments - 1) >> keyBits) > 0; keyBits++);
+				base = m_Descending ? ~(segments - 1) : 0;
+			}
+
+			clError = clSetKernelArg(m_StringKeysKernel, 0, sizeof(cl_mem), (void*)&m_dStringBytes);
+			clError |= clSetKernelArg(m_StringKeysKernel, 1, sizeof(cl_mem), (void*)&m_dStringOffsets);
+			clError |= clSetKernelArg(m_StringKeysKernel, 2, sizeof(cl_mem), (void*)&m_dStringItems[0]);
+			clError |= clSetKernelArg(m_StringKeysKernel, 3, sizeof(cl_mem), (void*)&m_dStringSegments);
+			clError |= clSetKernelArg(m_StringKeysKernel, 4, sizeof(cl_mem), (void*)&m_dStringKeys[0]);
+			clError |= clSetKernelArg(m_StringKeysKernel, 5, sizeof(cl_uint), (void*)&size);
+			clError |= clSetKernelArg(m_StringKeysKernel, 6, sizeof(cl_uint), (void*)&offset);
+			clError |= clSetKernelArg(m_StringKeysKernel, 7, sizeof(cl_uint), (void*)&word);
+			V_RETURN_FALSE_CL(clError, "Failed to set kernel args: String_Keys");
+			clError = clEnqueueNDRangeKernel(CommandQueue, m_StringKeysKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+			V_RETURN_FALSE_CL(clError, "Error executing String_Keys kernel!");
+
+			if (!EnqueueRadixPasses(Context, CommandQueue, m_dStringKeys[0], m_dStringKeys[1], m_dStringItems[0], m_dStringItems[1],
+				m_dStringCounters, size, base, keyBits))
+				return false;
+		}
+
+		//flag the ties that need the next 8 bytes
+		globalWorkSize[0] = CLUtil::GetGlobalWorkSize(size + 1, localWorkSize[0]);
+		clError = clSetKernelArg(m_StringTiesKernel, 0, sizeof(cl_mem), (void*)&m_dStringBytes);
+		clError |= clSetKernelArg(m_StringTiesKernel, 1, sizeof(cl_mem), (void*)&m_dStringOffsets);
+		clError |= clSetKernelArg(m_StringTiesKernel, 2, sizeof(cl_mem), (void*)&m_dStringItems[0]);
+		clError |= clSetKernelArg(m_StringTiesKernel, 3, sizeof(cl_mem), (void*)&m_dStringSegments);
+		clError |= clSetKernelArg(m_StringTiesKernel, 4, sizeof(cl_mem), (void*)&m_dStringFlags[0]);
+		clError |= clSetKernelArg(m_StringTiesKernel, 5, sizeof(cl_mem), (void*)&m_dStringFlags[1]);
+		clError |= clSetKernelArg(m_StringTiesKernel, 6, sizeof(cl_uint), (void*)&size);
+		clError |= clSetKernelArg(m_StringTiesKernel, 7, sizeof(cl_uint), (void*)&offset);
+		V_RETURN_FALSE_CL(clError, "Failed to set kernel args: String_Ties");
+		clError = clEnqueueNDRangeKernel(CommandQueue, m_StringTiesKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+		V_RETURN_FALSE_CL(clError, "Error executing String_Ties kernel!");
+		ExclusiveScan(Context, CommandQueue, m_dStringFlags[0], size + 1);
+		ExclusiveScan(Context, CommandQueue, m_dStringFlags[1], size + 1);
+
+		//write the round into the permutation and gather the open items
+		globalWorkSize[0] = CLUtil::GetGlobalWorkSize(size, localWorkSize[0]);
+		clError = clSetKernelArg(m_StringCompactKernel, 0, sizeof(cl_mem), (void*)&m_dStringItems[0]);
+		clError |= clSetKernelArg(m_StringCompactKernel, 1, sizeof(cl_mem), (void*)&m_dStringPositions[0]);
+		clError |= clSetKernelArg(m_StringCompactKernel, 2, sizeof(cl_mem), (void*)&m_dStringPermutation);
+		clError |= clSetKernelArg(m_StringCompactKernel, 3, sizeof(cl_mem), (void*)&m_dStringFlags[0]);
+		clError |= clSetKernelArg(m_StringCompactKernel, 4, sizeof(cl_mem), (void*)&m_dStringFlags[1]);
+		clError |= clSetKernelArg(m_StringCompactKernel, 5, sizeof(cl_mem), (void*)&m_dStringItems[1]);
+		clError |= clSetKernelArg(m_StringCompactKernel, 6, sizeof(cl_mem), (void*)&m_dStringPositions[1]);
+		clError |= clSetKernelArg(m_StringCompactKernel, 7, sizeof(cl_mem), (void*)&m_dStringSegments);
+		clError |= clSetKernelArg(m_StringCompactKernel, 8, sizeof(cl_uint), (void*)&size);
+		V_RETURN_FALSE_CL(clError, "Failed to set kernel args: String_Compact");
+		clError = clEnqueueNDRangeKernel(CommandQueue, m_StringCompactKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+		V_RETURN_FALSE_CL(clError, "Error executing String_Compact kernel!");
+
+		//the totals of the scans are the size and the number of segments of the next round
+		cl_uint totals[2];
+		V_RETURN_FALSE_CL(clEnqueueReadBuffer(CommandQueue, m_dStringFlags[0], CL_FALSE, sizeof(cl_uint) * size, sizeof(cl_uint), &totals[0], 0, NULL, NULL), "Error reading data from device!");
+		V_RETURN_FALSE_CL(clEnqueueReadBuffer(CommandQueue, m_dStringFlags[1], CL_TRUE, sizeof(cl_uint) * size, sizeof(cl_uint), &totals[1], 0, NULL, NULL), "Error reading data from device!");
+		size = totals[0];
+		segments = totals[1];
+		swap(m_dStringItems[0], m_dStringItems[1]);
+		swap(m_dStringPositions[0], m_dStringPositions[1]);
+	}
+
+	V_RETURN_FALSE_CL(clEnqueueReadBuffer(CommandQueue, m_dStringPermutation, CL_TRUE, 0, sizeof(cl_uint) * Count, Permutation, 0, NULL, NULL), "Error reading data from device!");
+	return true;
+}
+
+void CSortTask::TestStrings(cl_context Context, cl_command_queue CommandQueue)
+{
+	cout << "Testing the string sort of " << m_StringCount << " strings" << endl;
+
+	//IDs and URLs with long common prefixes, and short strings of few byte values (including zeros) with many
+	//duplicates and strings that extend others
+	vector<unsigned char> bytes;
+	vector<unsigned int> offsets(1, 0);
+	char buffer[128];
+	for (size_t i = 0; i < m_StringCount; i++) {
+		int length;
+		switch (rand() % 3) {
+		case 0:
+			length = snprintf(buffer, sizeof(buffer), "user-%08d", rand() % 100000);
+			break;
+		case 1:
+			length = snprintf(buffer, sizeof(buffer), "https://example.com/%s/%d", (rand() % 2) ? "images" : "products/items", rand() % 100000);
+			break;
+		default:
+			length = rand() % 13;
+			for (int c = 0; c < length; c++)
+				buffer[c] = (char)(rand() % 3);
+		}
+		bytes.insert(bytes.end(), buffer, buffer + length);
+		offsets.push_back((unsigned int)bytes.size());
+	}
+
+	vector<unsigned int> permutation(m_StringCount);
+	CTimer timer;
+	timer.Start();
+	m_StringsValid = SortStrings(Context, CommandQueue, bytes.empty() ? NULL : &bytes[0], &offsets[0], m_StringCount, &permutation[0]);
+	timer.Stop();
+	double ms = timer.GetElapsedMilliseconds();
+
+	//the device sort is stable, so it has to match a stable sort on the host exactly
+	vector<unsigned int> reference(m_StringCount);
+	for (size_t i = 0; i < m_StringCount; i++)
+		reference[i] = (unsigned int)i;
+	timer.Start();
+	const unsigned char* data = bytes.empty() ? NULL : &bytes[0];
+	bool descending = m_Descending;
+	stable_sort(reference.begin(), reference.end(), [&](unsigned int a, unsigned int b) {
+		if (descending)
+			swap(a, b);
+		size_t lengthA = offsets[a + 1] - offsets[a], lengthB = offsets[b + 1] - offsets[b];
+		int order = min(lengthA, lengthB) > 0 ? memcmp(data + offsets[a], data + offsets[b], min(lengthA, lengthB)) : 0;
+		return order < 0 || (order == 0 && lengthA < lengthB);
+	});
+	timer.Stop();
+
+	cout << "  time: " << ms << " ms (host stable sort " << timer.GetElapsedMilliseconds() << " ms), " << m_StringRounds
+		<< " rounds, " << m_StringResorted << " strings sorted again after the first 8 bytes" << endl;
+	m_StringsValid = m_StringsValid && permutation == reference;
+}
+
+bool CSortTask::ReserveColumnBuffers(cl_context Context, size_t Columns, size_t Rows)
+{
+	cl_int clError = CL_SUCCESS, clError2;
+	if (Rows > m_ColumnCapacity) {
+		//the counters have one entry per digit and radix tile
+		size_t tileSize = RADIX_ELEMENTS_PER_ITEM * LocalWorkSize[0];
+		size_t counters = (size_t)(1 << RADIX_BITS) * ((Rows + tileSize - 1) / tileSize);
+		for (size_t i = 0; i < m_dColumns.size(); i++)
+			SAFE_RELEASE_MEMOBJECT(m_dColumns[i]);
+		m_dColumns.clear();
+		SAFE_RELEASE_MEMOBJECT(m_dColumnCounters);
+		m_ColumnCapacity = 0;
+		m_dColumnCounters = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * counters, NULL, &clError2);
+		clError |= clError2;
+		for (int i = 0; i < 2; i++) {
+			SAFE_RELEASE_MEMOBJECT(m_dColumnKeys[i]);
+			SAFE_RELEASE_MEMOBJECT(m_dColumnItems[i]);
+			m_dColumnKeys[i] = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * Rows, NULL, &clError2);
+			clError |= clError2;
+			m_dColumnItems[i] = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * Rows, NULL, &clError2);
+			clError |= clError2;
+		}
+		V_RETURN_FALSE_CL(clError, "Error allocating the multi-column sort arrays");
+		if (!ReserveScan(Context, counters))
+			return false;
+		m_ColumnCapacity = Rows;
+	}
+	if (!m_dColumnRange) {
+		m_dColumnRange = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * 2, NULL, &clError);
+		V_RETURN_FALSE_CL(clError, "Error allocating the column range");
+	}
+	while (m_dColumns.size() < Columns) {
+		cl_mem column = clCreateBuffer(Context, CL_MEM_READ_ONLY, sizeof(cl_uint) * m_ColumnCapacity, NULL, &clError);
+		V_RETURN_FALSE_CL(clError, "Error allocating a column");
+		m_dColumns.push_back(column);
+	}
+	return true;
+}
+
+bool CSortTask::SortColumns(cl_context Context, cl_command_queue CommandQueue, const vector<const unsigned int*>& Columns, size_t Rows,
+	unsigned int* Permutation, const vector<bool>& Descending)
+{
+	m_ColumnKeyBits.clear();
+	if (Rows == 0)
+		return true;
+	if (!m_Comparator.empty() || m_KeyHi - m_KeyLo < 32) {
+		cerr << "Error: the multi-column sort compares whole columns, key bits and custom comparators are not supported" << endl;
+		return false;
+	}
+	if (Rows >= UINT_MAX || (!Descending.empty() && Descending.size() != Columns.size())) {
+		cerr << "Error: the multi-column sort needs up to 2^32 - 1 rows and a direction for every column" << endl;
+		return false;
+	}
+	if (!ReserveColumnBuffers(Context, Columns.size(), Rows))
+		return false;
+
+	cl_int clError;
+	size_t localWorkSize[1] = { LocalWorkSize[0] };
+	size_t globalWorkSize[1];
+	cl_uint size = (cl_uint)Rows;
+
+	//upload the columns and detect their ranges, a column with a single value needs no passes
+	vector<cl_uint> minimum(Columns.size()), range(Columns.size()), bits(Columns.size());
+	globalWorkSize[0] = min(CLUtil::GetGlobalWorkSize(Rows, localWorkSize[0]), VALIDATE_MAX_GROUPS * localWorkSize[0]);
+	for (size_t c = 0; c < Columns.size(); c++) {
+		cl_uint limits[2] = { UINT_MAX, 0 };
+		V_RETURN_FALSE_CL(clEnqueueWriteBuffer(CommandQueue, m_dColumns[c], CL_FALSE, 0, sizeof(cl_uint) * Rows, Columns[c], 0, NULL, NULL), "Error copying data from host to device!");
+		V_RETURN_FALSE_CL(clEnqueueWriteBuffer(CommandQueue, m_dColumnRange, CL_FALSE, 0, sizeof(limits), limits, 0, NULL, NULL), "Error resetting the column range!");
+		clError = clSetKernelArg(m_RangeMinMaxKernel, 0, sizeof(cl_mem), (void*)&m_dColumns[c]);
+		clError |= clSetKernelArg(m_RangeMinMaxKernel, 1, sizeof(cl_mem), (void*)&m_dColumnRange);
+		clError |= clSetKernelArg(m_RangeMinMaxKernel, 2, sizeof(cl_uint), (void*)&size);
+		V_RETURN_FALSE_CL(clError, "Failed to set kernel args: Range_MinMax");
+		clError = clEnqueueNDRangeKernel(CommandQueue, m_RangeMinMaxKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+		V_RETURN_FALSE_CL(clError, "Error executing Range_MinMax kernel!");
+		V_RETURN_FALSE_CL(clEnqueueReadBuffer(CommandQueue, m_dColumnRange, CL_TRUE, 0, sizeof(limits), limits, 0, NULL, NULL), "Error reading data from device!");
+		minimum[c] = limits[0];
+		range[c] = limits[1] - limits[0];
+		for (bits[c] = 0; bits[c] < 32 && (range[c] >> bits[c]) > 0; bits[c]++);
+	}
+
+	//the rows start in input order
+	globalWorkSize[0] = CLUtil::GetGlobalWorkSize(Rows, localWorkSize[0]);
+	clError = clSetKernelArg(m_RadixInitValuesKernel, 0, sizeof(cl_mem), (void*)&m_dColumnItems[0]);
+	clError |= clSetKernelArg(m_RadixInitValuesKernel, 1, sizeof(cl_uint), (void*)&size);
+	V_RETURN_FALSE_CL(clError, "Failed to set kernel args: RadixInitValues");
+	clError = clEnqueueNDRangeKernel(CommandQueue, m_RadixInitValuesKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+	V_RETURN_FALSE_CL(clError, "Error executing RadixInitValues kernel!");
+
+	//every key packs the columns [first, last) while their bits fit, the last column goes to the lowest bits. The keys
+	//are sorted from the least significant one, every pass is stable, so the more significant keys decide
+	for (size_t last = Columns.size(); last > 0; ) {
+		size_t first = last;
+		cl_uint keyBits = 0;
+		while (first > 0 && keyBits + bits[first - 1] <= 32)
+			keyBits += bits[--first];
+
+		cl_uint shift = 0, start = 1;
+		for (size_t c = last; c > first; c--) {
+			if (bits[c - 1] == 0)
+				continue;
+			cl_uint flip = (Descending.empty() ? m_Descending : Descending[c - 1]) != m_Descending;
+			clError = clSetKernelArg(m_ColumnsPackKernel, 0, sizeof(cl_mem), (void*)&m_dColumns[c - 1]);
+			clError |= clSetKernelArg(m_ColumnsPackKernel, 1, sizeof(cl_mem), (void*)&m_dColumnItems[0]);
+			clError |= clSetKernelArg(m_ColumnsPackKernel, 2, sizeof(cl_mem), (void*)&m_dColumnKeys[0]);
+			clError |= clSetKernelArg(m_ColumnsPackKernel, 3, sizeof(cl_uint), (void*)&size);
+			clError |= clSetKernelArg(m_ColumnsPackKernel, 4, sizeof(cl_uint), (void*)&minimum[c - 1]);
+			clError |= clSetKernelArg(m_ColumnsPackKernel, 5, sizeof(cl_uint), (void*)&range[c - 1]);
+			clError |= clSetKernelArg(m_ColumnsPackKernel, 6, sizeof(cl_uint), (void*)&shift);
+			clError |= clSetKernelArg(m_ColumnsPackKernel, 7, sizeof(cl_uint), (void*)&flip);
+			clError |= clSetKernelArg(m_ColumnsPackKernel, 8, sizeof(cl_uint), (void*)&start);
+			V_RETURN_FALSE_CL(clError, "Failed to set kernel args: Columns_Pack");
+			clError = clEnqueueNDRangeKernel(CommandQueue, m_ColumnsPackKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+			V_RETURN_FALSE_CL(clError, "Error executing Columns_Pack kernel!");
+			shift += bits[c - 1];
+			start = 0;
+		}
+
+		if (keyBits > 0) {
+			if (!EnqueueRadixPasses(Context, CommandQueue, m_dColumnKeys[0], m_dColumnKeys[1], m_dColumnItems[0], m_dColumnItems[1],
+				m_dColumnCounters, Rows, 0, keyBits))
+				return false;
+			m_ColumnKeyBits.push_back(keyBits);
+		}
+		last = first;
+	}
+
+	V_RETURN_FALSE_CL(clEnqueueReadBuffer(CommandQueue, m_dColumnItems[0], CL_TRUE, 0, sizeof(cl_uint) * Rows, Permutation, 0, NULL, NULL), "Error reading data from device!");
+	return true;
+}
+
+void CSortTask::TestColumns(cl_context Context, cl_command_queue CommandQueue)
+{
+	cout << "Testing the multi-column sort of " << m_ColumnRows << " rows" << endl;
+
+	//a narrow column, a descending one, one with a big offset and a wide one: the first three share a key
+	const size_t numColumns = 4;
+	vector<vector<unsigned int>> table(numColumns, vector<unsigned int>(m_ColumnRows));
+	for (size_t i = 0; i < m_ColumnRows; i++) {
+		table[0][i] = rand() % 4;
+		table[1][i] = rand() % 1000;
+		table[2][i] = 1000000 + rand() % 64;
+		table[3][i] = ((unsigned int)rand() << 16) ^ (unsigned int)rand();
+	}
+	vector<bool> descending(numColumns, m_Descending);
+	descending[1] = !m_Descending;
+	vector<const unsigned int*> columns;
+	for (size_t c = 0; c < numColumns; c++)
+		columns.push_back(&table[c][0]);
+
+	vector<unsigned int> permutation(m_ColumnRows);
+	CTimer timer;
+	timer.Start();
+	m_ColumnsValid = SortColumns(Context, CommandQueue, columns, m_ColumnRows, &permutation[0], descending);
+	timer.Stop();
+	double ms = timer.GetElapsedMilliseconds();
+
+	//the radix passes are stable, so the permutation has to match a stable sort on the host exactly
+	vector<unsigned int> reference(m_ColumnRows);
+	for (size_t i = 0; i < m_ColumnRows; i++)
+		reference[i] = (unsigned int)i;
+	timer.Start();
+	stable_sort(reference.begin(), reference.end(), [&](unsigned int a, unsigned int b) {
+		for (size_t c = 0; c < numColumns; c++)
+			if (table[c][a] != table[c][b])
+				return descending[c] ? table[c][a] > table[c][b] : table[c][a] < table[c][b];
+		return false;
+	});
+	timer.Stop();
+
+	size_t passes = 0;
+	cout << "  time: " << ms << " ms (host stable sort " << timer.GetElapsedMilliseconds() << " ms), keys of";
+	for (size_t k = 0; k < m_ColumnKeyBits.size(); k++) {
+		cout << " " << m_ColumnKeyBits[k];
+		passes += (m_ColumnKeyBits[k] + RADIX_BITS - 1) / RADIX_BITS;
+	}
+	cout << " bits: " << passes << " radix passes instead of " << numColumns * 32 / RADIX_BITS << endl;
+	m_ColumnsValid = m_ColumnsValid && permutation == reference;
+}
+
+void CSortTask::TestPostSort(cl_context Context, cl_command_queue CommandQueue)
+{
+	cout << "Testing post-sort primitives on the result of " << g_kernelNames[4] << endl;
+
+	//the payload is the input itself: gathered through the permutation it equals the sorted keys, whose runs are
+	//easily reduced on the host
+	cl_int clError;
+	cl_mem payload = clCreateBuffer(Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint) * m_N, m_hInput, &clError);
+	V_RETURN_CL(clError, "Error allocating the payload");
+
+	vector<unsigned int> keys, counts, sums, mins, maxs;
+	CTimer timer;
+	timer.Start();
+	m_PostSortValid = Unique(Context, CommandQueue, keys) && RunLengths(Context, CommandQueue, keys, counts) &&
+		ReduceByKey(Context, CommandQueue, payload, m_dRadixValues[0], ReduceSum, keys, sums) &&
+		ReduceByKey(Context, CommandQueue, payload, m_dRadixValues[0], ReduceMin, keys, mins) &&
+		ReduceByKey(Context, CommandQueue, payload, m_dRadixValues[0], ReduceMax, keys, maxs);
+	timer.Stop();
+	clReleaseMemObject(payload);
+	if (!m_PostSortValid)
+		return;
+
+	cout << "  " << keys.size() << " runs in " << m_N << " keys, read back " << keys.size() * sizeof(cl_uint) << " instead of " << m_N * sizeof(cl_uint)
+		<< " bytes per result, time for all 5: " << timer.GetElapsedMilliseconds() << " ms" << endl;
+
+	//reference from the validated keys of the radix sort
+	const unsigned int* sorted = m_resultGPU[4];
+	size_t run = 0;
+	for (size_t i = 0; i < m_N && m_PostSortValid; run++) {
+		size_t end = i + 1;
+		unsigned int sum = sorted[i], minimum = sorted[i], maximum = sorted[i];
+		for (; end < m_N && !KeyLess(sorted[end - 1], sorted[end]); end++) {
+			sum += sorted[end];
+			minimum = min(minimum, sorted[end]);
+			maximum = max(maximum, sorted[end]);
+		}
+		m_PostSortValid = run < keys.size() && keys[run] == sorted[i] && counts[run] == end - i &&
+			sums[run] == sum && mins[run] == minimum && maxs[run] == maximum;
+		i = end;
+	}
+	m_PostSortValid &= run == keys.size();
+}
+
+void CSortTask::SortFile(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+{
+	if (m_ExternalSize > 0) {
+		SortFileExternal(Context, CommandQueue, LocalWorkSize);
+		return;
+	}
+
+	cout << endl << "Sorting " << m_N << " keys of " << m_InputFile << " into " << (m_OutputFile.empty() ? m_InputFile : m_OutputFile) << endl;
+
+	CTimer timer;
+	timer.Start();
+
+	//straight from the mapped input and back into the mapped output, the kernel writes back the dirty pages
+	m_deviceValid[2] = SortChunk(Context, CommandQueue, LocalWorkSize, m_hInput, m_hOutput, m_N);
+
+	timer.Stop();
+
+	double ms = timer.GetElapsedMilliseconds();
+	cout << "  time including transfers: " << ms << " ms, throughput: " << 1.0e-3 * (double)m_N / ms << " Melem/s" << endl;
+}
+
+bool CSortTask::SortChunk(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], const unsigned int* Input, unsigned int* Output, size_t Size)
+{
+	//copy the keys into the ping buffer and pad them on the device. Keys beyond Size are sentinels in the input and the
+	//output, so the fingerprints over m_N keys still match
+	cl_uint sentinel = Sentinel();
+	V_RETURN_FALSE_CL(clEnqueueWriteBuffer(CommandQueue, m_dPingArray, CL_FALSE, 0, Size * sizeof(cl_uint), Input, 0, NULL, NULL), "Error copying data from host to device!");
+	if (m_N_padded > Size)
+		V_RETURN_FALSE_CL(clEnqueueFillBuffer(CommandQueue, m_dPingArray, &sentinel, sizeof(cl_uint), Size * sizeof(cl_uint), (m_N_padded - Size) * sizeof(cl_uint), 0, NULL, NULL), "Error padding the input!");
+
+	Fingerprint(CommandQueue, m_dPingArray, m_dValidationResults[0], LocalWorkSize);
+	Sort_BitonicMergesort(Context, CommandQueue, LocalWorkSize);
+	bool valid = ValidateOnDevice(CommandQueue, LocalWorkSize, 2);
+
+	V_RETURN_FALSE_CL(clEnqueueReadBuffer(CommandQueue, m_dPingArray, CL_TRUE, 0, Size * sizeof(cl_uint), Output, 0, NULL, NULL), "Error reading data from device!");
+	return valid;
+}
+
+#ifndef _WIN32
+// pread and pwrite may transfer less than asked for
+static bool ReadAll(int File, void* Data, size_t Bytes, off_t Offset)
+{
+	char* data = (char*)Data;
+	while (Bytes > 0) {
+		ssize_t done = pread(File, data, Bytes, Offset);
+		if (done <= 0)
+			return false;
+		data += done;
+		Bytes -= done;
+		Offset += done;
+	}
+	return true;
+}
+
+static bool WriteAll(int File, const void* Data, size_t Bytes, off_t Offset)
+{
+	const char* data = (const char*)Data;
+	while (Bytes > 0) {
+		ssize_t done = pwrite(File, data, Bytes, Offset);
+		if (done <= 0)
+			return false;
+		data += done;
+		Bytes -= done;
+		Offset += done;
+	}
+	return true;
+}
+
+// a sorted run of the external sort: the next block is read asynchronously while the current one is merged. Both
+// blocks come from the host pool, so they are not zero-filled and faulted in again for every merge
+struct CRunReader
+{
+	int					File;
+	off_t				Offset;
+	size_t				Remaining;
+	size_t				BlockSize;
+	CHostPool*			Pool;
+	unsigned int*		Block;
+	unsigned int*		Next;
+	size_t				BlockCount;
+	size_t				NextCount;
+	size_t				Pos;
+	std::future<bool>	Pending;
+
+	CRunReader() : File(-1), Offset(0), Remaining(0), BlockSize(0), Pool(NULL), Block(NULL), Next(NULL), BlockCount(0), NextCount(0), Pos(0) {}
+	~CRunReader()
+	{
+		if (Pending.valid()) Pending.wait();
+		if (File >= 0) close(File);
+		if (Pool) {
+			SAFE_POOL_FREE(*Pool, Block);
+			SAFE_POOL_FREE(*Pool, Next);
+		}
+	}
+
+	bool Open(const std::string& Path, size_t Size, size_t Blocks, CHostPool& HostPool)
+	{
+		File = open(Path.c_str(), O_RDONLY);
+		if (File < 0)
+			return false;
+		posix_fadvise(File, 0, 0, POSIX_FADV_SEQUENTIAL);
+		Remaining = Size;
+		BlockSize = min(Blocks, Size);
+		Pool = &HostPool;
+		Block = Pool->AllocateArray<unsigned int>(BlockSize);
+		Next = Pool->AllocateArray<unsigned int>(BlockSize);
+		Prefetch();
+		return Refill();
+	}
+
+	void Prefetch()
+	{
+		size_t n = min(Remaining, BlockSize);
+		off_t offset = Offset;
+		unsigned int* next = Next;
+		NextCount = n;
+		Remaining -= n;
+		Offset += n * sizeof(unsigned int);
+		Pending = async(launch::async, [this, next, n, offset]() { return ReadAll(File, next, n * sizeof(unsigned int), offset); });
+	}
+
+	// swap in the prefetched block and start reading the one after it, the run is done when the block stays empty
+	bool Refill()
+	{
+		BlockCount = 0;
+		Pos = 0;
+		if (!Pending.valid())
+			return true;
+		if (!Pending.get())
+			return false;
+		swap(Block, Next);
+		BlockCount = NextCount;
+		if (Remaining > 0)
+			Prefetch();
+		return true;
+	}
+
+	bool Done() const { return Pos == BlockCount; }
+	unsigned int Key() const { return Block[Pos]; }
+};
+#endif
+
+void CSortTask::SortFileExternal(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+{
+#ifndef _WIN32
+	size_t numRuns = (m_ExternalSize + m_N - 1) / m_N;
+	cout << endl << "External sort of " << m_ExternalSize << " keys of " << m_InputFile << ": " << numRuns << " runs of up to " << m_N << " keys in " << m_TempDirectory << endl;
+
+	int input = open(m_InputFile.c_str(), O_RDONLY);
+	if (input < 0) {
+		cerr << "Error: cannot open " << m_InputFile << endl;
+		return;
+	}
+	posix_fadvise(input, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	vector<string> runFiles(numRuns);
+	vector<size_t> runSizes(numRuns);
+	for (size_t run = 0; run < numRuns; run++) {
+		ostringstream name;
+		name << m_TempDirectory << "/sort_" << getpid() << "_run" << run;
+		runFiles[run] = name.str();
+		runSizes[run] = min(m_N, m_ExternalSize - run * m_N);
+	}
+
+	auto readChunk = [&](size_t run, unsigned int* chunk) {
+		return ReadAll(input, chunk, runSizes[run] * sizeof(unsigned int), (off_t)(run * m_N * sizeof(unsigned int)));
+	};
+	auto writeRun = [&](size_t run, const unsigned int* chunk) {
+		int file = open(runFiles[run].c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		bool written = file >= 0 && WriteAll(file, chunk, runSizes[run] * sizeof(unsigned int), 0);
+		if (file >= 0) close(file);
+		return written;
+	};
+
+	CTimer timer;
+	timer.Start();
+
+	//run generation: while one buffer is sorted, the other one writes its run and then reads the chunk after next,
+	//so the disk stays busy. The futures are declared last and wait for their I/O before anything else goes away.
+	bool valid = true;
+	future<bool> io[2];
+	for (size_t b = 0; b < 2 && b < numRuns; b++)
+		io[b] = async(launch::async, readChunk, b, m_hRunBuffers[b]);
+	for (size_t run = 0; run < numRuns && valid; run++) {
+		unsigned int* chunk = m_hRunBuffers[run % 2];
+		if (!io[run % 2].get()) {
+			cerr << "Error: cannot read " << m_InputFile << endl;
+			valid = false;
+			break;
+		}
+
+		if (m_ExternalCPU)
+			MergesortBlocked(chunk, chunk, runSizes[run]);
+		else if (!SortChunk(Context, CommandQueue, LocalWorkSize, chunk, chunk, runSizes[run])) {
+			cerr << "Error: run " << run << " was not sorted correctly" << endl;
+			valid = false;
+		}
+
+		io[run % 2] = async(launch::async, [=]() {
+			return writeRun(run, chunk) && (run + 2 >= numRuns || readChunk(run + 2, chunk));
+		});
+	}
+	for (size_t b = 0; b < 2; b++)
+		if (io[b].valid() && !io[b].get()) {
+			cerr << "Error: cannot write the runs to " << m_TempDirectory << endl;
+			valid = false;
+		}
+	close(input);
+
+	timer.Stop();
+	cout << "  run generation: " << timer.GetElapsedMilliseconds() << " ms" << endl;
+
+	if (valid) {
+		CTimer timer2;
+		timer2.Start();
+		valid = MergeRuns(runFiles, runSizes);
+		timer2.Stop();
+		double ms = timer2.GetElapsedMilliseconds();
+		cout << "  merge: " << ms << " ms, throughput: " << 1.0e-3 * (double)m_ExternalSize / ms << " Melem/s" << endl;
+	}
+
+	//after a failed merge the runs may be the only complete copy of the keys
+	if (valid) {
+		for (size_t run = 0; run < numRuns; run++)
+			unlink(runFiles[run].c_str());
+	}
+	else {
+		cerr << "The sorted runs are kept:" << endl;
+		for (size_t run = 0; run < numRuns; run++)
+			cerr << "  " << runFiles[run] << endl;
+	}
+	m_deviceValid[2] = valid;
+#endif
+}
+
+bool CSortTask::MergeRuns(const vector<string>& RunFiles, const vector<size_t>& RunSizes)
+{
+#ifndef _WIN32
+	size_t numRuns = RunFiles.size();
+	const string& outputFile = m_OutputFile.empty() ? m_InputFile : m_OutputFile;
+
+	//every run and the output hold two blocks, about as much memory as the run generation used
+	vector<CRunReader> runs(numRuns);
+	size_t blockSize = max<size_t>(m_N / (2 * numRuns), EXTERNAL_MIN_BLOCK);
+	for (size_t i = 0; i < numRuns; i++)
+		if (!runs[i].Open(RunFiles[i], RunSizes[i], blockSize, m_HostPool)) {
+			cerr << "Error: cannot read " << RunFiles[i] << endl;
+			return false;
+		}
+
+	//merged into a temporary file next to the output that replaces it only once complete, the output may be the input
+	ostringstream tempName;
+	tempName << outputFile << ".sort_" << getpid() << ".tmp";
+	const string tempFile = tempName.str();
+	int output = open(tempFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (output < 0) {
+		cerr << "Error: cannot create " << tempFile << endl;
+		return false;
+	}
+	size_t outBlockSize = max<size_t>(m_N / 4, EXTERNAL_MIN_BLOCK);
+	unsigned int* outBlocks[2] = { m_HostPool.AllocateArray<unsigned int>(outBlockSize), m_HostPool.AllocateArray<unsigned int>(outBlockSize) };
+	size_t outCount = 0, outPos = 0, written = 0;
+	unsigned int* out = outBlocks[0];
+	future<bool> writing;
+	bool valid = true;
+
+	auto finishWrite = [&]() {
+		if (writing.valid() && !writing.get()) {
+			cerr << "Error: cannot write " << tempFile << endl;
+			valid = false;
+		}
+	};
+	//write the full block asynchronously and continue in the other one
+	auto flush = [&]() {
+		finishWrite();
+		const unsigned int* block = out;
+		size_t bytes = outPos * sizeof(unsigned int);
+		off_t offset = (off_t)(written * sizeof(unsigned int));
+		writing = async(launch::async, [=]() { return WriteAll(output, block, bytes, offset); });
+		written += outPos;
+		out = (out == outBlocks[0]) ? outBlocks[1] : outBlocks[0];
+		outPos = 0;
+	};
+
+	//loser tree: every inner node holds the run that lost the comparison there, tree[0] the overall winner
+	auto before = [&](size_t a, size_t b) {
+		return !runs[a].Done() && (runs[b].Done() || SortLess(runs[a].Key(), runs[b].Key()));
+	};
+	vector<size_t> tree(numRuns), winners(2 * numRuns);
+	for (size_t i = 0; i < numRuns; i++)
+		winners[numRuns + i] = i;
+	for (size_t node = numRuns - 1; node > 0; node--) {
+		size_t a = winners[2 * node], b = winners[2 * node + 1];
+		winners[node] = before(b, a) ? b : a;
+		tree[node] = before(b, a) ? a : b;
+	}
+	tree[0] = winners[1];
+
+	while (valid && !runs[tree[0]].Done()) {
+		size_t winner = tree[0];
+		out[outPos++] = runs[winner].Key();
+		outCount++;
+		if (outPos == outBlockSize)
+			flush();
+		if (++runs[winner].Pos == runs[winner].BlockCount && !runs[winner].Refill()) {
+			cerr << "Error: cannot read " << RunFiles[winner] << endl;
+			valid = false;
+		}
+
+		//replay the path from the leaf of the winner to the root
+		for (size_t node = (winner + numRuns) / 2; node > 0; node /= 2)
+			if (before(tree[node], winner))
+				swap(tree[node], winner);
+		tree[0] = winner;
+	}
+	if (outPos > 0)
+		flush();
+	finishWrite();
+	m_HostPool.Free(outBlocks[0]);
+	m_HostPool.Free(outBlocks[1]);
+	valid = valid && outCount == m_ExternalSize;
+	if (valid && fsync(output) != 0) {
+		cerr << "Error: cannot write " << tempFile << endl;
+		valid = false;
+	}
+	close(output);
+
+	if (valid && rename(tempFile.c_str(), outputFile.c_str()) != 0) {
+		cerr << "Error: cannot replace " << outputFile << endl;
+		valid = false;
+	}
+	if (!valid)
+		unlink(tempFile.c_str());
+	return valid;
+#else
+	return false;
+#endif
+}
+
 ///////////////////////////////////////////////////////////////////////////////
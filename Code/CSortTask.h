@@ -20,6 +20,16 @@
 #define _CSORT_TASK_H
 
 #include "../Common/IComputeTask.h"
+#include "../Common/CHostPool.h"
+#include "../Common/CPerfCounters.h"
+
+#include <climits>
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+
+#define NUM_SORT_TASKS 6
 
 class CSortTask : public IComputeTask
 {
@@ -40,47 +50,408 @@ public:
 
 	virtual bool ValidateResults();
 
+	//! In stable mode the CPU reference also computes the stable permutation and the key-value sorts are checked against it
+	void SetStableMode(bool Stable) { m_StableMode = Stable; }
+
+	//! Validate on the device (sortedness and multiset hash of input and output) instead of against a CPU reference sort
+	void SetDeviceValidation(bool DeviceValidation) { m_DeviceValidation = DeviceValidation; }
+
+	//! Submit the whole bitonic mergesort with a single host call: scheduled by the device itself if it supports device-side
+	//! enqueue (OpenCL 2.0), otherwise as a persistent kernel with a global barrier between the stages
+	void SetDeviceScheduling(bool DeviceScheduling) { m_DeviceScheduling = DeviceScheduling; }
+
+	//! Sort within a single device buffer: the mergesort merges in place, sample sort and radix sort are skipped
+	void SetInPlace(bool InPlace) { m_InPlace = InPlace; }
+
+	//! Several command queues for independent sorts in flight at once, used by SortAsync. The performance test then also
+	//! sorts slices of the input concurrently
+	void SetAsyncQueues(unsigned int Count) { m_NumAsyncQueues = Count; }
+
+	//! Sort Size keys from Input into Output (may be the same array) with the bitonic mergesort without blocking: the commands
+	//! go to the next async queue, the future completes (after the callback, called from an OpenCL thread) once Output holds
+	//! the result. Input has to stay valid until then. Needs InitResources and must be called from one host thread only.
+	std::future<bool> SortAsync(cl_context Context, const unsigned int* Input, unsigned int* Output, size_t Size,
+		std::function<void(bool)> Callback = std::function<void(bool)>());
+
+	//! Sort several arrays in place with a single bitonic mergesort launch sequence: every array gets a segment of the same
+	//! power of two in a device buffer kept across calls, and the stages stop at the segment size. Blocks until done.
+	bool SortBatch(cl_context Context, cl_command_queue CommandQueue, const std::vector<unsigned int*>& Arrays, const std::vector<size_t>& Sizes);
+
+	//! Post-sort primitives on the sorted keys in m_dPingArray: equal keys form a run, the results are compacted to one
+	//! entry per run on the device and only those are read back. Unique returns the first key of every run, RunLengths
+	//! also the number of keys, ReduceByKey the sum (mod 2^32), minimum or maximum of a payload over every run. The payload
+	//! holds one value per key in sorted order, or in input order if the Permutation of a key-value sort is given.
+	enum ReduceOp { ReduceSum = 0, ReduceMin = 1, ReduceMax = 2 };
+	bool Unique(cl_context Context, cl_command_queue CommandQueue, std::vector<unsigned int>& Keys);
+	bool RunLengths(cl_context Context, cl_command_queue CommandQueue, std::vector<unsigned int>& Keys, std::vector<unsigned int>& Counts);
+	bool ReduceByKey(cl_context Context, cl_command_queue CommandQueue, cl_mem Payload, cl_mem Permutation, ReduceOp Op,
+		std::vector<unsigned int>& Keys, std::vector<unsigned int>& Results);
+
+	//! Detect the key range with a device min/max reduction first: the bitonic mergesort becomes a counting sort if the
+	//! range is small (whole 32-bit keys only), the radix sort only sorts the significant bits of key - minimum
+	void SetRangeDetection(bool RangeDetection) { m_RangeDetection = RangeDetection; }
+
+	//! Also test the post-sort primitives on the result of the radix sort
+	void SetPostSort(bool PostSort) { m_PostSort = PostSort; }
+
+	//! Incremental mode: a sorted set kept on the device. InsertBatch uploads and sorts only the new keys (bitonic mergesort)
+	//! and merges them into the set with one parallel merge pass, so the cost follows the batch plus one pass over the set.
+	//! Up to 2^32 - 1 keys, the set buffers grow by doubling
+	bool InsertBatch(cl_context Context, cl_command_queue CommandQueue, const unsigned int* Batch, size_t Size);
+	bool ReadResident(cl_command_queue CommandQueue, unsigned int* Keys);
+	size_t GetResidentSize() const { return m_ResidentSize; }
+	void ClearResident() { m_ResidentSize = 0; }
+
+	//! Also test the incremental mode by inserting the input in this many batches (0 to skip)
+	void SetIncrementalBatches(unsigned int Batches) { m_IncrementalBatches = Batches; }
+
+	//! String sort: Count strings stored back to back in Bytes, string i is [Offsets[i], Offsets[i + 1]). Permutation
+	//! gets the string indices in byte order (a string before its extensions, equal strings keep their order). The radix
+	//! sort orders all strings by their first 8 bytes, then only the strings tied with a neighbour are sorted again by the
+	//! next 8 bytes within their tie, until no ties are left. Up to 2^32 - 1 strings and 4 GiB of bytes, whole keys only
+	//! (ascending or descending order, no key bits or custom comparator). The buffers are kept for the next call
+	bool SortStrings(cl_context Context, cl_command_queue CommandQueue, const unsigned char* Bytes, const unsigned int* Offsets,
+		size_t Count, unsigned int* Permutation);
+
+	//! Also test the string sort on this many random strings (0 to skip)
+	void SetStringSort(size_t Count) { m_StringCount = Count; }
+
+	//! Multi-column sort (ORDER BY Columns[0], Columns[1], ...): Permutation gets the row indices of a table of Rows rows
+	//! stored column-wise in lexicographic order, equal rows keep their order. Descending holds the direction of every
+	//! column (empty: all in the sort order). The range of every column is detected on the device and consecutive columns
+	//! are packed into one 32-bit key while their significant bits fit, then the radix sort runs stable passes over these
+	//! keys from the least to the most significant one. Up to 2^32 - 1 rows, whole keys only (no key bits or custom
+	//! comparator). The buffers are kept for the next call
+	bool SortColumns(cl_context Context, cl_command_queue CommandQueue, const std::vector<const unsigned int*>& Columns, size_t Rows,
+		unsigned int* Permutation, const std::vector<bool>& Descending = std::vector<bool>());
+
+	//! Also test the multi-column sort on a table of this many random rows (0 to skip)
+	void SetColumnSort(size_t Rows) { m_ColumnRows = Rows; }
+
+	//! Also time the cache-blocked mergesort on the CPU and check it against the plain mergesort of the reference
+	void SetBlockedReference(bool BlockedReference) { m_BlockedReference = BlockedReference; }
+
+	//! Also report hardware counters (cycles, instructions, LLC, branch and dTLB misses per key) of the CPU sorts
+	void SetPerfCounters(bool PerfCounters) { m_PerfCounters = PerfCounters; }
+
+	//! Also report the achieved bandwidth of every bitonic and mergesort kernel and stage class (local or global
+	//! strides), against the peak of a copy kernel
+	void SetBandwidthReport(bool BandwidthReport) { m_BandwidthReport = BandwidthReport; }
+
+	//! Huge pages and pre-faulting of the big host arrays (input, results and the scratch arrays of the CPU sorts),
+	//! set before InitResources. Freed arrays stay pooled for the next run until the task is destroyed
+	void SetHostMemory(CHostPool::HugePages HugePages, bool Prefault) { m_HostPool.SetHugePages(HugePages); m_HostPool.SetPrefault(Prefault); }
+
+	//! Sort order, compiled into specialized kernels: descending order, only the bits [Lo, Hi) as key, or a custom
+	//! "a comes before b" OpenCL C expression on a and b with a sentinel value that is ordered after every key
+	void SetDescending(bool Descending) { m_Descending = Descending; }
+	void SetKeyBits(unsigned int Lo, unsigned int Hi) { m_KeyLo = Lo; m_KeyHi = Hi; }
+	void SetComparator(const std::string& Comparator, unsigned int Sentinel) { m_Comparator = Comparator; m_Sentinel = Sentinel; }
+
+	//! Sort the 32-bit keys of a binary file with the bitonic mergesort instead of random data, into the output file or in
+	//! place if it is empty. Both files are memory-mapped, the array size has to match the input file
+	void SetFiles(const std::string& InputFile, const std::string& OutputFile) { m_InputFile = InputFile; m_OutputFile = OutputFile; }
+
+	//! Sort a file of FileSize keys that does not fit into memory: runs of the array size are sorted on the device (or with
+	//! the CPU mergesort), spilled to TempDirectory and merged into the output file
+	void SetExternalSort(size_t FileSize, const std::string& TempDirectory, bool CPURuns) { m_ExternalSize = FileSize; m_TempDirectory = TempDirectory; m_ExternalCPU = CPURuns; }
+
 protected:
 
 	size_t getPaddedSize(size_t n);
 
+	bool MapFiles();
+	void UnmapFiles();
+	void SortFile(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+	void SortFileExternal(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+	bool SortChunk(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], const unsigned int* Input, unsigned int* Output, size_t Size);
+	bool MergeRuns(const std::vector<std::string>& RunFiles, const std::vector<size_t>& RunSizes);
+
+	// sizes and indices are cl_ulong for the 64-bit index kernels (WIDE_INDEX), cl_uint otherwise
+	cl_int SetIndexArg(cl_kernel Kernel, cl_uint Index, size_t Value);
+
+	//! Launch of a bitonic or mergesort kernel that reads and writes Keys keys once. The launch is recorded for the
+	//! bandwidth report while m_ProfileLaunches is set, the queue then needs profiling enabled
+	cl_int EnqueueSortKernel(cl_command_queue CommandQueue, cl_kernel Kernel, const size_t* GlobalWorkSize, const size_t* LocalWorkSize,
+		size_t Keys, bool GlobalStage);
+
+	// host versions of KEY, KEY_LESS and SORT_LESS in Sort.cl (custom comparators are only evaluated on the device)
+	unsigned int Key(unsigned int x) const { return (m_KeyHi - m_KeyLo < 32) ? (x >> m_KeyLo) & ((1u << (m_KeyHi - m_KeyLo)) - 1) : x; }
+	bool KeyLess(unsigned int a, unsigned int b) const { return m_Descending ? Key(a) > Key(b) : Key(a) < Key(b); }
+	bool SortLess(unsigned int a, unsigned int b) const { return KeyLess(a, b) || (Key(a) == Key(b) && (m_Descending ? a > b : a < b)); }
+	unsigned int Sentinel() const { return m_Comparator.empty() ? (m_Descending ? 0 : UINT_MAX) : m_Sentinel; }
+	// bijection onto values whose natural order is SortLess: the key bits move to the top, the other bits keep their
+	// order below them, descending inverts all bits
+	unsigned int OrderCode(unsigned int x) const {
+		unsigned int bits = m_KeyHi - m_KeyLo;
+		unsigned int code = (bits == 32) ? x : (Key(x) << (32 - bits)) | (unsigned int)(((unsigned long long)x >> m_KeyHi) << m_KeyLo) | (x & ((1u << m_KeyLo) - 1));
+		return m_Descending ? ~code : code;
+	}
+	unsigned int OrderDecode(unsigned int Code) const {
+		unsigned int code = m_Descending ? ~Code : Code, bits = m_KeyHi - m_KeyLo;
+		if (bits == 32)
+			return code;
+		unsigned int high = (code & ((1u << (32 - bits)) - 1)) >> m_KeyLo;
+		return (unsigned int)((unsigned long long)high << m_KeyHi) | ((code >> (32 - bits)) << m_KeyLo) | (code & ((1u << m_KeyLo) - 1));
+	}
+
 	void Mergesort();
+	void Mergesort(const unsigned int* Input, unsigned int* Result, size_t Size);
+	void MergesortBlocked(const unsigned int* Input, unsigned int* Result, size_t Size);
+	void SortBlock(unsigned int* Data, unsigned int* Scratch, size_t Size);
+	void MergeMultiway(const unsigned int* Input, unsigned int* Output, size_t Size, size_t RunSize, bool Decode);
+	void MergesortStable();
 	void ValidateCPU();
 
 	void Sort_Mergesort(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
-	void Sort_SimpleSortingNetwork(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
-	void Sort_SimpleSortingNetworkLocal(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+	void Sort_MergesortInPlace(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+	void Sort_OddEvenMergesort(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
 	void Sort_BitonicMergesort(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+	bool EnqueueBitonicMergesort(cl_command_queue CommandQueue, cl_mem Input, cl_mem Output, size_t Size, size_t SegmentSize, size_t LocalWorkSize[3]);
+	void Sort_BitonicScheduled(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+	void Sort_BitonicShuffle(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+	void Sort_BitonicBlocked(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+	void Sort_CpuMergesort(cl_context Context, cl_command_queue CommandQueue);
+	void Sort_SampleSort(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+	void Sort_RadixSort(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+	bool FindKeyRange(cl_command_queue CommandQueue, cl_uint& Lo, cl_uint& Hi);
+	bool Sort_Counting(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+
+	void Fingerprint(cl_command_queue CommandQueue, cl_mem Data, cl_mem Result, size_t LocalWorkSize[3]);
+	bool ValidateOnDevice(cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task);
+
+	bool EnqueueRadixPasses(cl_context Context, cl_command_queue CommandQueue, cl_mem& Keys, cl_mem& KeysOut, cl_mem& Values,
+		cl_mem& ValuesOut, cl_mem Counters, size_t Size, cl_uint Base, cl_uint KeyBits);
+
+	bool ReserveScan(cl_context Context, size_t Size);
+	void ExclusiveScan(cl_context Context, cl_command_queue CommandQueue, cl_mem Data, size_t Size, unsigned int Level = 0);
 
 	void ExecuteTask(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int task);
 	void TestPerformance(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int task);
+	void TestAsync(cl_context Context);
+	bool FindRuns(cl_context Context, cl_command_queue CommandQueue, cl_uint& NumRuns);
+	bool ReadRuns(cl_command_queue CommandQueue, cl_uint NumRuns, std::vector<unsigned int>& Keys, std::vector<unsigned int>* Values);
+	void TestPostSort(cl_context Context, cl_command_queue CommandQueue);
+	bool ReserveBatchBuffer(cl_context Context, size_t Size);
+	void TestIncremental(cl_context Context, cl_command_queue CommandQueue);
+	bool ReserveStringBuffers(cl_context Context, size_t Count, size_t Bytes);
+	void TestStrings(cl_context Context, cl_command_queue CommandQueue);
+	bool ReserveColumnBuffers(cl_context Context, size_t Columns, size_t Rows);
+	void TestColumns(cl_context Context, cl_command_queue CommandQueue);
+	void ReportBandwidth(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+	bool MeasurePeakBandwidth(cl_command_queue CommandQueue, size_t LocalWorkSize[3], double& PeakGBs);
+	void PrintLaunches(double PeakGBs);
 
 	//NOTE: we have two memory address spaces, so we mark pointers with a prefix
 	//to avoid confusions: 'h' - host, 'd' - device
 
 	size_t				m_N;
 	size_t				m_N_padded;
+	// 2^32 keys and more need 64-bit indices in the kernels, only some tasks support that
+	bool				m_WideIndex;
 	size_t				LocalWorkSize[3];
+	bool				m_StableMode;
+	bool				m_DeviceValidation;
+	bool				m_DeviceScheduling;
+	bool				m_InPlace;
+
+	// sort order
+	bool				m_Descending;
+	unsigned int		m_KeyLo;
+	unsigned int		m_KeyHi;
+	std::string			m_Comparator;
+	unsigned int		m_Sentinel;
+
+	// file mode: the input data and the output are mappings of these files (the same one if sorted in place)
+	std::string			m_InputFile;
+	std::string			m_OutputFile;
+	unsigned int*		m_hOutput;
+
+	// external sort: number of keys in the file (0 if it fits), where the runs go and the two host buffers that alternate
+	// between sorting a run and its disk I/O
+	size_t				m_ExternalSize;
+	std::string			m_TempDirectory;
+	bool				m_ExternalCPU;
+	unsigned int*		m_hRunBuffers[2];
+
+	// all host arrays of the sorts, aligned and with huge pages, reused across calls and runs
+	CHostPool			m_HostPool;
+
+	bool				m_BlockedReference;
+
+	// hardware counters of the CPU reference, one set for the sections: all of ComputeCPU, the current sort, blocks
+	// and merge passes of the cache-blocked mergesort. Closed unless enabled, then Start and Stop do nothing
+	bool				m_PerfCounters;
+	CPerfCounters		m_Perf;
+	CPerfSection		m_PerfTotal;
+	CPerfSection		m_PerfSort;
+	CPerfSection		m_PerfBlocks;
+	CPerfSection		m_PerfMerges;
+
+	// bandwidth report: every instrumented launch with its event and the bytes it moves, while m_ProfileLaunches is set
+	struct CKernelLaunch { cl_kernel Kernel; cl_event Event; size_t Bytes; bool GlobalStage; };
+	bool				m_BandwidthReport;
+	bool				m_ProfileLaunches;
+	std::vector<CKernelLaunch> m_KernelLaunches;
 
 	// input data
 	unsigned int		*m_hInput;
 	// results
 	unsigned int*		m_resultCPU;
-	unsigned int*		m_resultGPU[3];
+	unsigned int*		m_resultGPU[NUM_SORT_TASKS];
+	// stable permutations (original index of every sorted key)
+	unsigned int*		m_resultCPUPermutation;
+	unsigned int*		m_resultGPUPermutation;
+	// outcome of the device-side validation of every task
+	bool				m_deviceValid[NUM_SORT_TASKS];
 
+	// in-place mode: both refer to the same buffer
 	cl_mem				m_dPingArray;
 	cl_mem				m_dPongArray;
 
+	// bitonic mergesort with subgroup shuffles: 0 not supported, 1 cl_khr_subgroup_shuffle, 2 cl_intel_subgroups
+	unsigned int		m_SubgroupShuffle;
+
+	// CPU devices: the bitonic mergesort slot runs the mergesort without local memory and barriers, with work-groups
+	// of the preferred vector width
+	bool				m_CpuDevice;
+	size_t				m_CpuVectorWidth;
+
+	// bitonic mergesort with a single host call: the on-device default queue for the scheduler kernel, or the number of
+	// work-groups and the global barrier counters of the persistent kernel
+	cl_command_queue	m_DeviceQueue;
+	size_t				m_PersistentGroups;
+	cl_mem				m_dBarrierCounters;
+
+	// asynchronous sorts: command queues they are spread over round robin, and the outcome of the concurrent test
+	unsigned int		m_NumAsyncQueues;
+	std::vector<cl_command_queue> m_AsyncQueues;
+	size_t				m_NextAsyncQueue;
+	bool				m_AsyncValid;
+
+	// batched sorts and incremental inserts: device buffer that grows to the biggest batch
+	cl_mem				m_dBatchBuffer;
+	size_t				m_BatchCapacity;
+
+	// post-sort primitives: run index of every key (exclusive scan of the run heads), compacted keys and counts or
+	// reductions per run, allocated on first use. Outcome of the test
+	bool				m_PostSort;
+	cl_mem				m_dPostRuns;
+	cl_mem				m_dPostKeys;
+	cl_mem				m_dPostValues;
+	bool				m_PostSortValid;
+
+	// incremental mode: the sorted set and the buffer the next merge goes to, their capacity and the number of keys in the
+	// set. Outcome of the test
+	cl_mem				m_dResident[2];
+	size_t				m_ResidentCapacity;
+	size_t				m_ResidentSize;
+	unsigned int		m_IncrementalBatches;
+	bool				m_IncrementalValid;
+
+	// string sort: bytes and offsets of the strings, the permutation, radix keys and items (string indices) of the strings
+	// sorted in the current round with their positions in the permutation (ping pong), the tie segment of every string,
+	// open and head flags of the ties and the digit counters. Capacities in strings and bytes, rounds and strings sorted
+	// again by the last call, outcome of the test
+	size_t				m_StringCount;
+	cl_mem				m_dStringBytes;
+	cl_mem				m_dStringOffsets;
+	cl_mem				m_dStringPermutation;
+	cl_mem				m_dStringKeys[2];
+	cl_mem				m_dStringItems[2];
+	cl_mem				m_dStringPositions[2];
+	cl_mem				m_dStringSegments;
+	cl_mem				m_dStringFlags[2];
+	cl_mem				m_dStringCounters;
+	size_t				m_StringCapacity;
+	size_t				m_StringByteCapacity;
+	size_t				m_StringRounds;
+	size_t				m_StringResorted;
+	bool				m_StringsValid;
+
+	// multi-column sort: the columns, packed keys and row indices (ping pong), digit counters and the range of a column.
+	// Capacity in rows, significant bits of every packed key of the last call (least significant first), outcome of the test
+	size_t				m_ColumnRows;
+	std::vector<cl_mem>	m_dColumns;
+	cl_mem				m_dColumnKeys[2];
+	cl_mem				m_dColumnItems[2];
+	cl_mem				m_dColumnCounters;
+	cl_mem				m_dColumnRange;
+	size_t				m_ColumnCapacity;
+	std::vector<unsigned int> m_ColumnKeyBits;
+	bool				m_ColumnsValid;
+
+	// sample sort: number of range buckets and helper arrays
+	unsigned int		m_SampleSortBuckets;
+	cl_mem				m_dSampleSortBucketIds;
+	cl_mem				m_dSampleSortSegments;
+	cl_mem				m_dSampleSortTiles;
+	cl_mem				m_dSampleSortSplitters;
+	cl_mem				m_dSampleSortCounters;
+	cl_mem				m_dSampleSortBucketStarts;
+	cl_mem				m_dSampleSortSmallBuckets;
+
+	// key range detection: min and max of the keys, counters of the counting sort
+	bool				m_RangeDetection;
+	cl_mem				m_dKeyRange;
+	cl_mem				m_dCountingCounts;
+
+	// radix sort: ping pong arrays for the values and digit counters of every tile
+	cl_mem				m_dRadixValues[2];
+	cl_mem				m_dRadixCounters;
+
+	// device validation: unsorted count and hash sums of input and output, copy of the input for the permutation check
+	cl_uint				m_ValidationSeed;
+	cl_mem				m_dValidationResults[2];
+	cl_mem				m_dValidationInput;
+
+	// block sums for every recursion level of ExclusiveScan, enough for scans of m_ScanCapacity elements
+	std::vector<cl_mem>	m_dScanBlockSums;
+	size_t				m_ScanCapacity;
+
 	//OpenCL program and kernels
 	cl_program			m_Program;
 	cl_kernel			m_MergesortStartKernel;
 	cl_kernel			m_MergesortGlobalSmallKernel;
 	cl_kernel			m_MergesortGlobalBigKernel;
-	cl_kernel			m_SimpleSortingNetworkKernel;
-	cl_kernel			m_SimpleSortingNetworkLocalKernel;
+	cl_kernel			m_MergesortFlipKernel;
+	cl_kernel			m_OddEvenStartKernel;
+	cl_kernel			m_OddEvenGlobalKernel;
 	cl_kernel			m_BitonicStartKernel;
 	cl_kernel			m_BitonicGlobalKernel;
 	cl_kernel			m_BitonicLocalKernel;
+	cl_kernel			m_BitonicSchedulerKernel;
+	cl_kernel			m_BitonicPersistentKernel;
+	cl_kernel			m_BitonicShuffleStartKernel;
+	cl_kernel			m_BitonicShuffleMergeKernel;
+	cl_kernel			m_BitonicBlockedStartKernel;
+	cl_kernel			m_BitonicBlockedMergeKernel;
+	cl_kernel			m_CpuChunksKernel;
+	cl_kernel			m_CpuMergeKernel;
+	cl_kernel			m_SampleSortSplittersKernel;
+	cl_kernel			m_SampleSortClassifyKernel;
+	cl_kernel			m_SampleSortScatterKernel;
+	cl_kernel			m_SampleSortLocalKernel;
+	cl_kernel			m_RangeMinMaxKernel;
+	cl_kernel			m_CountingHistogramKernel;
+	cl_kernel			m_CountingWriteKernel;
+	cl_kernel			m_RadixInitValuesKernel;
+	cl_kernel			m_RadixHistogramKernel;
+	cl_kernel			m_RadixScatterKernel;
+	cl_kernel			m_StringKeysKernel;
+	cl_kernel			m_StringTiesKernel;
+	cl_kernel			m_StringCompactKernel;
+	cl_kernel			m_ColumnsPackKernel;
+	cl_kernel			m_ValidateFingerprintKernel;
+	cl_kernel			m_ValidateStablePermutationKernel;
+	cl_kernel			m_MergeInsertKernel;
+	cl_kernel			m_PostRunHeadsKernel;
+	cl_kernel			m_PostCompactKernel;
+	cl_kernel			m_PostRunLengthsKernel;
+	cl_kernel			m_PostReduceKernel;
+	cl_kernel			m_ScanLocalKernel;
+	cl_kernel			m_ScanAddKernel;
+	cl_kernel			m_BandwidthCopyKernel;
 };
 
 #endif // _CSORT_TASK_H
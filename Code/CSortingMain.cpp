@@ -5,8 +5,11 @@ GPU Computing / GPGPU Praktikum source code.
 
 #include "CSortingMain.h"
 
+#include "CSortService.h"
 #include "CSortTask.h"
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
 
 using namespace std;
@@ -14,6 +17,33 @@ using namespace std;
 ///////////////////////////////////////////////////////////////////////////////
 // CAssignment2
 
+bool CSortingMain::EnterMainLoop(int argc, char** argv)
+{
+	// the OpenCL device can be chosen before all other arguments
+	if (argc > 2 && string(argv[1]) == "--device") {
+		SetDeviceSelection(argv[2]);
+		argv[2] = argv[0];
+		argc -= 2;
+		argv += 2;
+	}
+
+	// the clients of the sort service do not need an OpenCL context
+	string mode = argc > 1 ? argv[1] : "";
+	if (mode == "--client" && argc > 3)
+		return CSortService::SortFile(argv[2], argv[3], argc > 4 ? argv[4] : "");
+	if (mode == "--stop" && argc > 2)
+		return CSortService::Stop(argv[2]);
+	if (mode == "--serve" && argc > 2)
+		m_ServiceSocket = argv[2];
+	else if (argc > 1) {
+		m_InputFile = argv[1];
+		if (argc > 2)
+			m_OutputFile = argv[2];
+	}
+
+	return CAssignmentBase::EnterMainLoop(argc, argv);
+}
+
 bool CSortingMain::DoCompute()
 {
 	// Task 1: parallel reduction
@@ -22,14 +52,101 @@ bool CSortingMain::DoCompute()
 	{
 		// set work size and size of input array
 		size_t LocalWorkSize[3] = { 256, 1, 1 };
-		unsigned int arraySize = 1024 * 1024;
+		size_t arraySize = 1024 * 1024;
+		// also validate the permutation of the stable key-value sort
+		bool stableSort = false;
+		// validate on the device instead of against a CPU reference sort (much cheaper for big arrays)
+		bool deviceValidation = false;
+		// submit the bitonic mergesort with a single host call (device-side enqueue or a persistent kernel)
+		bool deviceScheduling = false;
+		// sort within a single device buffer (about half the device memory, sample sort and radix sort are skipped)
+		bool inPlace = false;
+		// detect the key range first: counting sort for small ranges, radix sort passes only over the significant bits
+		bool rangeDetection = false;
+		// also sort slices of the input concurrently with the asynchronous API, spread over this many command queues (0 to skip)
+		unsigned int asyncQueues = 0;
+		// also compute the unique keys, run lengths and per-key reductions of a payload on the device (needs the radix sort)
+		bool postSort = false;
+		// also insert the input in this many batches into a sorted set kept on the device (0 to skip)
+		unsigned int incrementalBatches = 0;
+		// also sort this many random strings (IDs, URLs, short binary strings) by their bytes into a permutation (0 to skip)
+		size_t stringCount = 0;
+		// also sort a random table of this many rows on four columns lexicographically into a permutation (0 to skip)
+		size_t columnRows = 0;
+		// also time the cache-blocked CPU mergesort and check it against the plain one (a second full CPU sort)
+		bool blockedReference = false;
+		// also report cycles, instructions, LLC, branch and dTLB misses per key of the CPU sorts (Linux perf_event_open)
+		bool perfCounters = false;
+		// also report GB/s and percent of the peak copy bandwidth of every bitonic and mergesort kernel
+		bool bandwidthReport = false;
+		// huge pages for the big host arrays (off, transparent or the reserved ones) and faulting them in when allocated
+		CHostPool::HugePages hugePages = CHostPool::HugePagesTransparent;
+		bool prefault = false;
+
+		// files with more keys are sorted externally: runs of this many keys are sorted on the device (or with the CPU
+		// mergesort), spilled to the temp directory and merged on the host
+		size_t externalRunSize = 256 * 1024 * 1024;
+		bool externalCPU = false;
+		string tempDirectory = ".";
+		size_t fileSize = 0;
 
-		// info output
-		cout << "Start sorting array of size " << arraySize;
-		cout << " using LocalWorkSize " << LocalWorkSize[0] << endl << endl;
+		// sort the keys of a file instead
+		if (!m_InputFile.empty()) {
+			ifstream file(m_InputFile.c_str(), ios::binary | ios::ate);
+			streamoff bytes = file ? (streamoff)file.tellg() : -1;
+			if (bytes <= 0 || bytes % sizeof(unsigned int) != 0) {
+				cerr << "Error: " << m_InputFile << " is missing, empty or not made of 32-bit keys" << endl;
+				return false;
+			}
+			fileSize = (size_t)bytes / sizeof(unsigned int);
+			arraySize = min(fileSize, externalRunSize);
+		}
+
+		// the service sizes its buffers by the requests
+		if (!m_ServiceSocket.empty())
+			arraySize = 2 * LocalWorkSize[0];
+		else {
+			// info output
+			cout << "Start sorting array of size " << arraySize;
+			cout << " using LocalWorkSize " << LocalWorkSize[0] << endl << endl;
+		}
 
 		// create sorting task and start it
 		CSortTask sorting(arraySize, LocalWorkSize);
+		sorting.SetStableMode(stableSort);
+		sorting.SetDeviceValidation(deviceValidation);
+		sorting.SetDeviceScheduling(deviceScheduling);
+		sorting.SetInPlace(inPlace);
+		sorting.SetRangeDetection(rangeDetection);
+		sorting.SetAsyncQueues(asyncQueues);
+		sorting.SetPostSort(postSort);
+		sorting.SetIncrementalBatches(incrementalBatches);
+		sorting.SetStringSort(stringCount);
+		sorting.SetColumnSort(columnRows);
+		sorting.SetBlockedReference(blockedReference);
+		sorting.SetPerfCounters(perfCounters);
+		sorting.SetBandwidthReport(bandwidthReport);
+		sorting.SetHostMemory(hugePages, prefault);
+		if (!m_InputFile.empty())
+			sorting.SetFiles(m_InputFile, m_OutputFile);
+		if (fileSize > arraySize)
+			sorting.SetExternalSort(fileSize, tempDirectory, externalCPU);
+		// optional sort order, compiled into specialized kernels
+		//sorting.SetDescending(true);
+		//sorting.SetKeyBits(8, 24);
+		//sorting.SetComparator("(a & 0xFF) > (b & 0xFF)", 0xFFFFFF00);
+
+		// compile the kernels once and serve sort requests until stopped
+		if (!m_ServiceSocket.empty()) {
+			if (!sorting.InitResources(m_CLDevice, m_CLContext)) {
+				sorting.ReleaseResources();
+				return false;
+			}
+			CSortService service(sorting, m_CLContext, m_CLCommandQueue);
+			bool served = service.Run(m_ServiceSocket);
+			sorting.ReleaseResources();
+			return served;
+		}
 		RunComputeTask(sorting, LocalWorkSize);
 	}
 
@@ -22,13 +22,27 @@
 
 #include "../Common/CAssignmentBase.h"
 
+#include <string>
+
 //! Assignment5 solution
 class CSortingMain : public CAssignmentBase
 {
 public:
 	virtual ~CSortingMain() {};
 
+	//! Sorting [<input file> [<output file>]]: without arguments random data is sorted with all variants, otherwise the
+	//! 32-bit keys of the input file are sorted into the output file, or in place if there is none.
+	//! Sorting --serve <socket> runs the sort service, Sorting --client <socket> <input file> [<output file>] sorts a file
+	//! with it and Sorting --stop <socket> shuts it down.
+	//! A leading --device <gpu|cpu|accelerator|all|index|name> chooses the OpenCL device (the first GPU by default)
+	virtual bool EnterMainLoop(int argc, char** argv);
+
 	virtual bool DoCompute();
+
+protected:
+	std::string m_InputFile;
+	std::string m_OutputFile;
+	std::string m_ServiceSocket;
 };
 
 #endif // _CASSIGNMENT5_H
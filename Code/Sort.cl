@@ -1,5 +1,61 @@
 //#define MAX_LOCAL_SIZE 256 //set via compile options
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// sort order, specialized at compile time (all optional, set via compile options):
+// SORT_DESCENDING			- descending instead of ascending order
+// KEY_LO, KEY_HI			- sort on the bits [KEY_LO, KEY_HI) of the values only
+// SORT_COMPARATOR(a, b)	- custom "a comes before b" expression on the whole values, takes precedence over the above
+// SORT_SENTINEL			- value ordered after every key, used for padding
+// The comparison sorts break ties of the key order by the value, so the padding always ends up at the end.
+#ifndef KEY_LO
+#define KEY_LO 0
+#endif
+#ifndef KEY_HI
+#define KEY_HI 32
+#endif
+#define KEY_BITS (KEY_HI - KEY_LO)
+
+#if KEY_BITS < 32
+#define KEY(x) (((x) >> KEY_LO) & ((1u << KEY_BITS) - 1))
+#else
+#define KEY(x) (x)
+#endif
+
+#if defined(SORT_COMPARATOR)
+#define KEY_LESS(a, b) (SORT_COMPARATOR(a, b))
+#define SORT_LESS(a, b) (KEY_LESS(a, b) || (!KEY_LESS(b, a) && (a) < (b)))
+#elif defined(SORT_DESCENDING)
+#define KEY_LESS(a, b) (KEY(a) > KEY(b))
+#if KEY_BITS < 32
+#define SORT_LESS(a, b) (KEY_LESS(a, b) || (KEY(a) == KEY(b) && (a) > (b)))
+#else
+#define SORT_LESS(a, b) KEY_LESS(a, b)
+#endif
+#else
+#define KEY_LESS(a, b) (KEY(a) < KEY(b))
+#if KEY_BITS < 32
+#define SORT_LESS(a, b) (KEY_LESS(a, b) || (KEY(a) == KEY(b) && (a) < (b)))
+#else
+#define SORT_LESS(a, b) KEY_LESS(a, b)
+#endif
+#endif
+
+#ifndef SORT_SENTINEL
+#ifdef SORT_DESCENDING
+#define SORT_SENTINEL 0
+#else
+#define SORT_SENTINEL UINT_MAX
+#endif
+#endif
+
+// WIDE_INDEX: 64-bit sizes and indices for arrays of 2^32 keys and more. Only the kernels that support such arrays take
+// index_t arguments, the host passes them as cl_ulong in that case.
+#ifdef WIDE_INDEX
+typedef ulong index_t;
+#else
+typedef uint index_t;
+#endif
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // needed helper methods
 inline void swap(uint *a, uint *b) {
@@ -9,9 +65,9 @@ inline void swap(uint *a, uint *b) {
 	*a = tmp;
 }
 
-// dir == 1 means ascending
+// dir == 1 means ascending (in SORT_LESS order)
 inline void sort(uint *a, uint *b, char dir) {
-	if ((*a > *b) == dir) swap(a, b);
+	if (SORT_LESS(*b, *a) == dir) swap(a, b);
 }
 
 inline void swapLocal(__local uint *a, __local uint *b) {
@@ -21,9 +77,9 @@ inline void swapLocal(__local uint *a, __local uint *b) {
 	*a = tmp;
 }
 
-// dir == 1 means ascending
+// dir == 1 means ascending (in SORT_LESS order)
 inline void sortLocal(__local uint *a, __local uint *b, char dir) {
-	if ((*a > *b) == dir) swapLocal(a, b);
+	if (SORT_LESS(*b, *a) == dir) swapLocal(a, b);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -33,7 +89,7 @@ __kernel void Sort_MergesortStart(const __global uint* inArray, __global uint* o
 {
 	__local uint local_buffer[2][MAX_LOCAL_SIZE * 2];
 	const uint lid = get_local_id(0);
-	const uint index = get_group_id(0) * (MAX_LOCAL_SIZE * 2) + lid;
+	const index_t index = get_group_id(0) * (MAX_LOCAL_SIZE * 2) + lid;
 	char pong = 0;
 	char ping = 1;
 
@@ -56,7 +112,7 @@ __kernel void Sort_MergesortStart(const __global uint* inArray, __global uint* o
 		for (uint i = 0; i < stride; i++) {
 			uint leftVal = local_buffer[ping][left];
 			uint rightVal = local_buffer[ping][right];
-			bool selectLeft = left < middle && (right >= rightBoundary || leftVal <= rightVal);
+			bool selectLeft = left < middle && (right >= rightBoundary || !SORT_LESS(rightVal, leftVal));
 
 			local_buffer[pong][leftBoundary + i] = (selectLeft) ? leftVal : rightVal;
 
@@ -93,7 +149,7 @@ __kernel void Sort_MergesortGlobalSmall(const __global uint* inArray, __global u
 	for (uint i = baseIndex; i < (baseIndex + stride); i++) {
 		// check which value should be written out
 		local_buffer[baseLocalIndex + (int)selectLeft] = (selectLeft) ? inArray[left] : inArray[right];
-		selectLeft = left < middle && (right == (baseIndex + stride) || local_buffer[baseLocalIndex + 1] <= local_buffer[baseLocalIndex]);
+		selectLeft = left < middle && (right == (baseIndex + stride) || !SORT_LESS(local_buffer[baseLocalIndex], local_buffer[baseLocalIndex + 1]));
 
 		// write out
 		outArray[i] = (selectLeft) ? local_buffer[baseLocalIndex + 1] : local_buffer[baseLocalIndex]; //PROBLEMATIC PART! WE RUN OUT OF MEMORY
@@ -122,7 +178,7 @@ __kernel void Sort_MergesortGlobalBig(const __global uint* inArray, __global uin
 #pragma unroll
 	for (uint i = baseIndex; i < (baseIndex + stride); i++) {
 		// check which value should be written out
-		selectLeft = (left < middle && (right == (baseIndex + stride) || inArray[left] <= inArray[right])) == dir;
+		selectLeft = (left < middle && (right == (baseIndex + stride) || !SORT_LESS(inArray[right], inArray[left]))) == dir;
 
 		// write out
 		outArray[i] = (selectLeft) ? inArray[left] : inArray[right];
@@ -133,78 +189,81 @@ __kernel void Sort_MergesortGlobalBig(const __global uint* inArray, __global uin
 	}
 }
 
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// OLD and BASIC global Kernel
-__kernel void Sort_SimpleSortingNetwork(const __global uint* inArray, __global uint* outArray, const uint offset, const uint size)
+// In-place merge of the sorted runs [0, blocksize / 2) and [blocksize / 2, blocksize) of every block: comparing mirrored
+// pairs leaves two bitonic halves with all keys of the first half before the second one, the bitonic merge strides
+// below blocksize / 2 (all ascending) then sort both halves.
+__kernel void Sort_MergesortFlip(__global uint* data, const index_t blocksize)
 {
-	// TO DO: pimp! Problem: Kernel gets called pretty often -> overhead!
-	const uint index = (get_global_id(0) << 1) + offset;
-	if (index + 1 >= size) return;
-
-	uint left = inArray[index];
-	uint right = inArray[index + 1];
-	sort(&left, &right, 1);
-	outArray[index] = left;
-	outArray[index + 1] = right;
+	const index_t gid = get_global_id(0);
+	const index_t half = blocksize / 2;
+	const index_t left = (gid / half) * blocksize + (gid & (half - 1));
+	const index_t right = (gid / half) * blocksize + blocksize - 1 - (gid & (half - 1));
 
-	// not needed if we use input=output array
-	//bool additionalWork = (get_global_id(0) == 0) && offset;
-	//if (additionalWork) { //alternative: if (offset) {..} only
-	//	outArray[0] = inArray[0];
-	//	outArray[size - 1] = inArray[size - 1];
-	//}
+	uint a = data[left];
+	uint b = data[right];
+	sort(&a, &b, 1);
+	data[left] = a;
+	data[right] = b;
 }
 
-/*
- * data		- the data input and output array
- * size		- size of the array
- * offset	- whether or not there will be an offset
- */
-__kernel void Sort_SimpleSortingNetworkLocal(__global uint* data, const uint size, const uint offset)
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Batcher's odd-even merge sort, all comparators ascending. Merging two sorted blocks of size / 2 first compares
+// elements stride = size / 2 apart, every smaller stride compares (pos - stride, pos) within the block, skipping the
+// first stride of every 2 * stride. These comparators cross tile boundaries, so only the first 2 * MAX_LOCAL_SIZE
+// keys can be sorted in local memory, all bigger merges run one global kernel per stride.
+__kernel void Sort_OddEvenMergesortStart(const __global uint* inArray, __global uint* outArray)
 {
 	__local uint local_buffer[MAX_LOCAL_SIZE * 2];
-	const uint limit = MAX_LOCAL_SIZE * 2;
 	const uint lid = get_local_id(0);
-	const uint locIdx = lid << 1;
-	const uint index = get_group_id(0) * (MAX_LOCAL_SIZE * 2) + (offset * MAX_LOCAL_SIZE) + lid;
-	if (index + MAX_LOCAL_SIZE >= size) return;
+	const index_t index = get_group_id(0) * (MAX_LOCAL_SIZE * 2) + lid;
 
-	//load into local buffer
-	local_buffer[lid] = data[index];
-	local_buffer[lid + MAX_LOCAL_SIZE] = data[index + MAX_LOCAL_SIZE];
+	//load into local mem
+	local_buffer[lid] = inArray[index];
+	local_buffer[lid + MAX_LOCAL_SIZE] = inArray[index + MAX_LOCAL_SIZE];
 
-	//sort
-#pragma unroll
-	for (int i = 0; i < limit; i++) {
-		barrier(CLK_LOCAL_MEM_FENCE);
-		uint index = locIdx + (i & 1);
-		if (index + 1 >= limit) continue;
-		sortLocal(&local_buffer[index], &local_buffer[index + 1], 1);
+	for (uint size = 2; size <= MAX_LOCAL_SIZE * 2; size <<= 1) {
+		for (uint stride = size >> 1; stride > 0; stride >>= 1) {
+			barrier(CLK_LOCAL_MEM_FENCE);
+			uint pos = 2 * lid - (lid & (stride - 1));
+			if (stride < size / 2) {
+				if ((lid & (size / 2 - 1)) >= stride)
+					sortLocal(&local_buffer[pos - stride], &local_buffer[pos], 1);
+			}
+			else sortLocal(&local_buffer[pos], &local_buffer[pos + stride], 1);
+		}
 	}
 
 	// sync and write back
 	barrier(CLK_LOCAL_MEM_FENCE);
-	data[index] = local_buffer[lid];
-	data[index + MAX_LOCAL_SIZE] = local_buffer[lid + MAX_LOCAL_SIZE];
+	outArray[index] = local_buffer[lid];
+	outArray[index + MAX_LOCAL_SIZE] = local_buffer[lid + MAX_LOCAL_SIZE];
 }
 
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-__kernel void Sort_BitonicMergesortStart(const __global uint* inArray, __global uint* outArray)
+__kernel void Sort_OddEvenMergesortGlobal(__global uint* data, const index_t size, const index_t stride)
 {
-	__local uint local_buffer[MAX_LOCAL_SIZE * 2];
-	const uint gid = get_global_id(0);
-	const uint lid = get_local_id(0);
+	const index_t gid = get_global_id(0);
+	index_t pos = 2 * gid - (gid & (stride - 1));
 
-	uint index = get_group_id(0) * (MAX_LOCAL_SIZE * 2) + lid;
-	//load into local mem
-	local_buffer[lid] = inArray[index];
-	local_buffer[lid + MAX_LOCAL_SIZE] = inArray[index + MAX_LOCAL_SIZE];
+	if (stride < size / 2) {
+		if ((gid & (size / 2 - 1)) < stride) return;
+		pos -= stride;
+	}
 
-	uint clampedGID = gid & (MAX_LOCAL_SIZE - 1);
+	uint left = data[pos];
+	uint right = data[pos + stride];
+	sort(&left, &right, 1);
+	data[pos] = left;
+	data[pos + stride] = right;
+}
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The bitonic kernels are split into helpers on a tile of 2 * MAX_LOCAL_SIZE keys in local memory, so the device-side
+// scheduler and the persistent kernel below can run the same stages.
+inline void bitonicSortTile(__local uint *local_buffer, const uint lid)
+{
 	// bitonic merge
 	for (uint blocksize = 2; blocksize < MAX_LOCAL_SIZE * 2; blocksize <<= 1) {
-		char dir = (clampedGID & (blocksize / 2)) == 0; // sort every other block in the other direction (faster % calc)
+		char dir = (lid & (blocksize / 2)) == 0; // sort every other block in the other direction (faster % calc)
 #pragma unroll
 		for (uint stride = blocksize >> 1; stride > 0; stride >>= 1){
 			barrier(CLK_LOCAL_MEM_FENCE);
@@ -214,57 +273,73 @@ __kernel void Sort_BitonicMergesortStart(const __global uint* inArray, __global
 	}
 
 	// bitonic merge for biggest group is special (unrolling this so we dont need ifs in the part above)
-	char dir = (clampedGID & 0); //even or odd? sort accordingly
+	// every tile ends up in the same direction, the first merge stage sorts them into alternating directions
+	char dir = 0;
 #pragma unroll
 	for (uint stride = MAX_LOCAL_SIZE; stride > 0; stride >>= 1){
 		barrier(CLK_LOCAL_MEM_FENCE);
 		uint idx = 2 * lid - (lid & (stride - 1));
 		sortLocal(&local_buffer[idx], &local_buffer[idx + stride], dir);
 	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+}
 
-	// sync and write back
+inline void bitonicMergeTile(__local uint *local_buffer, const uint lid, const char dir, uint stride)
+{
+#pragma unroll
+	for (; stride > 0; stride >>= 1) {
+		barrier(CLK_LOCAL_MEM_FENCE);
+		uint idx = 2 * lid - (lid & (stride - 1));
+		sortLocal(&local_buffer[idx], &local_buffer[idx + stride], dir);
+	}
 	barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+inline void bitonicStart(const __global uint* inArray, __global uint* outArray, __local uint *local_buffer)
+{
+	const uint lid = get_local_id(0);
+	index_t index = get_group_id(0) * (MAX_LOCAL_SIZE * 2) + lid;
+
+	//load into local mem
+	local_buffer[lid] = inArray[index];
+	local_buffer[lid + MAX_LOCAL_SIZE] = inArray[index + MAX_LOCAL_SIZE];
+
+	bitonicSortTile(local_buffer, lid);
+
+	// write back
 	outArray[index] = local_buffer[lid];
 	outArray[index + MAX_LOCAL_SIZE] = local_buffer[lid + MAX_LOCAL_SIZE];
 }
 
-__kernel void Sort_BitonicMergesortLocal(__global uint* data, const uint size, const uint blocksize, uint stride)
+inline void bitonicMergeLocal(__global uint* data, const index_t size, const index_t blocksize, const uint stride,
+	__local uint *local_buffer)
 {
-	// This Kernel is basically the same as Sort_BitonicMergesortStart except of the "unrolled" part and the provided parameters
-	__local uint local_buffer[2 * MAX_LOCAL_SIZE];
-	uint gid = get_global_id(0);
-	uint groupId = get_group_id(0);
+	// This is basically the same as bitonicStart except of the "unrolled" part and the provided parameters
+	index_t gid = get_global_id(0);
 	uint lid = get_local_id(0);
-	uint clampedGID = gid & (size / 2 - 1);
+	index_t clampedGID = gid & (size / 2 - 1);
 
-	uint index = groupId * (MAX_LOCAL_SIZE * 2) + lid;
+	index_t index = get_group_id(0) * (MAX_LOCAL_SIZE * 2) + lid;
 	//load into local mem
 	local_buffer[lid] = data[index];
 	local_buffer[lid + MAX_LOCAL_SIZE] = data[index + MAX_LOCAL_SIZE];
 
 	// bitonic merge
 	char dir = (clampedGID & (blocksize / 2)) == 0; //same as above, % calc
-#pragma unroll
-	for (; stride > 0; stride >>= 1) {
-		barrier(CLK_LOCAL_MEM_FENCE);
-		uint idx = 2 * lid - (lid & (stride - 1));
-		sortLocal(&local_buffer[idx], &local_buffer[idx + stride], dir);
-	}
+	bitonicMergeTile(local_buffer, lid, dir, stride);
 
-	// sync and write back
-	barrier(CLK_LOCAL_MEM_FENCE);
+	// write back
 	data[index] = local_buffer[lid];
 	data[index + MAX_LOCAL_SIZE] = local_buffer[lid + MAX_LOCAL_SIZE];
 }
 
-__kernel void Sort_BitonicMergesortGlobal(__global uint* data, const uint size, const uint blocksize, const uint stride)
+inline void bitonicMergeGlobal(__global uint* data, const index_t size, const index_t blocksize, const index_t stride)
 {
-	// TO DO: Kernel implementation
-	uint gid = get_global_id(0);
-	uint clampedGID = gid & (size / 2 - 1);
+	index_t gid = get_global_id(0);
+	index_t clampedGID = gid & (size / 2 - 1);
 
 	//calculate index and dir like above
-	uint index = 2 * clampedGID - (clampedGID & (stride - 1));
+	index_t index = 2 * clampedGID - (clampedGID & (stride - 1));
 	char dir = (clampedGID & (blocksize / 2)) == 0; //same as above, % calc
 
 	//bitonic merge
@@ -278,4 +353,1105 @@ __kernel void Sort_BitonicMergesortGlobal(__global uint* data, const uint size,
 	data[index + stride] = right;
 }
 
+__kernel void Sort_BitonicMergesortStart(const __global uint* inArray, __global uint* outArray)
+{
+	__local uint local_buffer[MAX_LOCAL_SIZE * 2];
+	bitonicStart(inArray, outArray, local_buffer);
+}
+
+__kernel void Sort_BitonicMergesortLocal(__global uint* data, const index_t size, const index_t blocksize, const index_t stride)
+{
+	__local uint local_buffer[2 * MAX_LOCAL_SIZE];
+	bitonicMergeLocal(data, size, blocksize, stride, local_buffer);
+}
+
+__kernel void Sort_BitonicMergesortGlobal(__global uint* data, const index_t size, const index_t blocksize, const index_t stride)
+{
+	bitonicMergeGlobal(data, size, blocksize, stride);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Bitonic mergesort with a single host call
+//
+// With device-side enqueue (DEVICE_ENQUEUE, OpenCL 2.0) a single work-item enqueues the stages of Sort_BitonicMergesort
+// on the default device queue, every stage waits for the event of the previous one. Otherwise a persistent kernel runs
+// all stages and separates them with a global barrier. That only works if all of its work-groups are resident at the
+// same time, so the host launches at most one work-group per compute unit.
+#ifdef DEVICE_ENQUEUE
+__kernel void Sort_BitonicScheduler(const __global uint* inArray, __global uint* outArray, const index_t size)
+{
+	const queue_t queue = get_default_queue();
+	const ndrange_t ndrange = ndrange_1D(size / 2, MAX_LOCAL_SIZE);
+	const uint localSize = MAX_LOCAL_SIZE * 2 * sizeof(uint);
+	clk_event_t previous, next;
+
+	enqueue_kernel(queue, CLK_ENQUEUE_FLAGS_NO_WAIT, ndrange, 0, NULL, &previous,
+		^(__local void *local_buffer) { bitonicStart(inArray, outArray, (__local uint*)local_buffer); }, localSize);
+
+	for (index_t blocksize = MAX_LOCAL_SIZE * 2; blocksize <= size; blocksize <<= 1) {
+		index_t stride = blocksize / 2;
+		for (; stride >= MAX_LOCAL_SIZE * 2; stride >>= 1) {
+			enqueue_kernel(queue, CLK_ENQUEUE_FLAGS_NO_WAIT, ndrange, 1, &previous, &next,
+				^{ bitonicMergeGlobal(outArray, size, blocksize, stride); });
+			release_event(previous);
+			previous = next;
+		}
+		enqueue_kernel(queue, CLK_ENQUEUE_FLAGS_NO_WAIT, ndrange, 1, &previous, &next,
+			^(__local void *local_buffer) { bitonicMergeLocal(outArray, size, blocksize, stride, (__local uint*)local_buffer); }, localSize);
+		release_event(previous);
+		previous = next;
+	}
+	release_event(previous);
+}
+#endif
+
+// the first work-item of every group counts its arrival and waits for the other groups of the same generation
+inline void globalBarrier(volatile __global uint* counter, const uint generation)
+{
+	barrier(CLK_LOCAL_MEM_FENCE | CLK_GLOBAL_MEM_FENCE);
+	if (get_local_id(0) == 0) {
+		atomic_inc(counter);
+		while (atomic_add(counter, 0) < generation * get_num_groups(0)) {}
+	}
+	barrier(CLK_LOCAL_MEM_FENCE | CLK_GLOBAL_MEM_FENCE);
+}
+
+// counters[0] counts the barrier arrivals, counters[1] the work-groups that finished. Both are zero at launch, the last
+// work-group resets them for the next launch.
+__kernel void Sort_BitonicPersistent(const __global uint* inArray, volatile __global uint* data, volatile __global uint* counters,
+	const index_t size)
+{
+	__local uint local_buffer[MAX_LOCAL_SIZE * 2];
+	const uint lid = get_local_id(0);
+	const index_t tiles = size / (MAX_LOCAL_SIZE * 2);
+	uint generation = 0;
+
+	for (index_t tile = get_group_id(0); tile < tiles; tile += get_num_groups(0)) {
+		const index_t index = tile * (MAX_LOCAL_SIZE * 2) + lid;
+		local_buffer[lid] = inArray[index];
+		local_buffer[lid + MAX_LOCAL_SIZE] = inArray[index + MAX_LOCAL_SIZE];
+		bitonicSortTile(local_buffer, lid);
+		data[index] = local_buffer[lid];
+		data[index + MAX_LOCAL_SIZE] = local_buffer[lid + MAX_LOCAL_SIZE];
+	}
+
+	// same stages as Sort_BitonicMergesort, the work-groups loop over all pairs or tiles of a stage
+	for (index_t blocksize = MAX_LOCAL_SIZE * 2; blocksize <= size; blocksize <<= 1) {
+		index_t stride = blocksize / 2;
+		for (; stride >= MAX_LOCAL_SIZE * 2; stride >>= 1) {
+			globalBarrier(counters, ++generation);
+			for (index_t i = get_global_id(0); i < size / 2; i += get_global_size(0)) {
+				const index_t index = 2 * i - (i & (stride - 1));
+				uint left = data[index];
+				uint right = data[index + stride];
+				sort(&left, &right, (i & (blocksize / 2)) == 0);
+				data[index] = left;
+				data[index + stride] = right;
+			}
+		}
+
+		globalBarrier(counters, ++generation);
+		for (index_t tile = get_group_id(0); tile < tiles; tile += get_num_groups(0)) {
+			const index_t index = tile * (MAX_LOCAL_SIZE * 2) + lid;
+			local_buffer[lid] = data[index];
+			local_buffer[lid + MAX_LOCAL_SIZE] = data[index + MAX_LOCAL_SIZE];
+			bitonicMergeTile(local_buffer, lid, ((tile * MAX_LOCAL_SIZE + lid) & (blocksize / 2)) == 0, stride);
+			data[index] = local_buffer[lid];
+			data[index + MAX_LOCAL_SIZE] = local_buffer[lid + MAX_LOCAL_SIZE];
+		}
+	}
+
+	if (lid == 0 && atomic_inc(&counters[1]) == get_num_groups(0) - 1) {
+		counters[0] = 0;
+		counters[1] = 0;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Register-blocked bitonic mergesort
+//
+// Every work-item holds BITONIC_KEYS_PER_ITEM consecutive keys in registers (loaded and stored as uint4), so a
+// work-group sorts tiles of MAX_LOCAL_SIZE * BITONIC_KEYS_PER_ITEM keys. Strides within the keys of one work-item are
+// done in registers with an unrolled network, only the cross-thread strides go through local memory.
+// Pairs (i, i + stride) are sorted ascending if (i & blocksize) == 0, like in Sort_BitonicMergesortGlobal.
+
+//#define BITONIC_KEYS_PER_ITEM 8 //set via compile options, power of 2 and >= 4
+#define BITONIC_TILE (MAX_LOCAL_SIZE * BITONIC_KEYS_PER_ITEM)
+
+// strides from stride down to 1 within the keys of one work-item, first is the global index of keys[0]
+inline void bitonicMergeRegisters(uint *keys, const uint first, const uint blocksize, const uint stride) {
+#pragma unroll
+	for (uint s = BITONIC_KEYS_PER_ITEM / 2; s > 0; s >>= 1) {
+		if (s > stride) continue;
+#pragma unroll
+		for (uint r = 0; r < BITONIC_KEYS_PER_ITEM; r++) {
+			if (r & s) continue;
+			sort(&keys[r], &keys[r + s], ((first + r) & blocksize) == 0);
+		}
+	}
+}
+
+// cross-thread strides from stride down to BITONIC_KEYS_PER_ITEM in local memory, every work-item sorts
+// BITONIC_KEYS_PER_ITEM / 2 pairs per stride. The keys are stored to and reloaded from local_buffer.
+inline void bitonicMergeLocalStrides(uint *keys, __local uint *local_buffer, const uint lid, const uint tileBase,
+	const uint blocksize, uint stride) {
+	const uint own = lid * BITONIC_KEYS_PER_ITEM;
+#pragma unroll
+	for (uint r = 0; r < BITONIC_KEYS_PER_ITEM; r++) local_buffer[own + r] = keys[r];
+
+	for (; stride >= BITONIC_KEYS_PER_ITEM; stride >>= 1) {
+		barrier(CLK_LOCAL_MEM_FENCE);
+#pragma unroll
+		for (uint k = 0; k < BITONIC_KEYS_PER_ITEM / 2; k++) {
+			uint pair = lid * (BITONIC_KEYS_PER_ITEM / 2) + k;
+			uint idx = 2 * pair - (pair & (stride - 1));
+			sortLocal(&local_buffer[idx], &local_buffer[idx + stride], ((tileBase + idx) & blocksize) == 0);
+		}
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+#pragma unroll
+	for (uint r = 0; r < BITONIC_KEYS_PER_ITEM; r++) keys[r] = local_buffer[own + r];
+	// local_buffer is reused by the caller
+	barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+inline void bitonicLoadKeys(uint *keys, const __global uint *data) {
+#pragma unroll
+	for (uint q = 0; q < BITONIC_KEYS_PER_ITEM / 4; q++) {
+		uint4 v = vload4(q, data);
+		keys[4 * q] = v.x;
+		keys[4 * q + 1] = v.y;
+		keys[4 * q + 2] = v.z;
+		keys[4 * q + 3] = v.w;
+	}
+}
+
+inline void bitonicStoreKeys(const uint *keys, __global uint *data) {
+#pragma unroll
+	for (uint q = 0; q < BITONIC_KEYS_PER_ITEM / 4; q++)
+		vstore4((uint4)(keys[4 * q], keys[4 * q + 1], keys[4 * q + 2], keys[4 * q + 3]), q, data);
+}
+
+// sorts tiles of BITONIC_TILE keys, every other tile descending
+__kernel void Sort_BitonicBlockedStart(const __global uint* inArray, __global uint* outArray)
+{
+	__local uint local_buffer[BITONIC_TILE];
+	uint keys[BITONIC_KEYS_PER_ITEM];
+	const uint lid = get_local_id(0);
+	const uint tileBase = get_group_id(0) * BITONIC_TILE;
+	const uint first = tileBase + lid * BITONIC_KEYS_PER_ITEM;
+
+	bitonicLoadKeys(keys, inArray + first);
+
+	// blocks within one work-item
+#pragma unroll
+	for (uint blocksize = 2; blocksize <= BITONIC_KEYS_PER_ITEM; blocksize <<= 1)
+		bitonicMergeRegisters(keys, first, blocksize, blocksize / 2);
+
+	// bigger blocks start with the cross-thread strides
+	for (uint blocksize = 2 * BITONIC_KEYS_PER_ITEM; blocksize <= BITONIC_TILE; blocksize <<= 1) {
+		bitonicMergeLocalStrides(keys, local_buffer, lid, tileBase, blocksize, blocksize / 2);
+		bitonicMergeRegisters(keys, first, blocksize, BITONIC_KEYS_PER_ITEM / 2);
+	}
+
+	bitonicStoreKeys(keys, outArray + first);
+}
+
+// all strides from stride (< BITONIC_TILE) down to 1 of a merge step with blocksize > BITONIC_TILE
+__kernel void Sort_BitonicBlockedMerge(__global uint* data, const uint blocksize, const uint stride)
+{
+	__local uint local_buffer[BITONIC_TILE];
+	uint keys[BITONIC_KEYS_PER_ITEM];
+	const uint lid = get_local_id(0);
+	const uint tileBase = get_group_id(0) * BITONIC_TILE;
+	const uint first = tileBase + lid * BITONIC_KEYS_PER_ITEM;
+
+	bitonicLoadKeys(keys, data + first);
+
+	if (stride >= BITONIC_KEYS_PER_ITEM)
+		bitonicMergeLocalStrides(keys, local_buffer, lid, tileBase, blocksize, stride);
+	bitonicMergeRegisters(keys, first, blocksize, min(stride, (uint)BITONIC_KEYS_PER_ITEM / 2));
+
+	bitonicStoreKeys(keys, data + first);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Bitonic mergesort with subgroup shuffles
+//
+// Only compiled if the device supports subgroup shuffles (SUBGROUP_SHUFFLE set via compile options: 1 for
+// cl_khr_subgroup_shuffle, 2 for cl_intel_subgroups). Every work-item holds the keys 2 * lane and 2 * lane + 1 of a
+// tile of 2 * MAX_LOCAL_SIZE keys in registers. Stride 1 is done in registers, strides up to the subgroup size
+// exchange the partner key with a shuffle, and only bigger strides go through local memory with a barrier.
+// The lane is numbered by subgroup, so this does not rely on how work-items are mapped to subgroups.
+#ifdef SUBGROUP_SHUFFLE
+
+#if SUBGROUP_SHUFFLE == 1
+#pragma OPENCL EXTENSION cl_khr_subgroups : enable
+#pragma OPENCL EXTENSION cl_khr_subgroup_shuffle : enable
+#define SHUFFLE_XOR(x, mask) sub_group_shuffle_xor(x, mask)
+#else
+#pragma OPENCL EXTENSION cl_intel_subgroups : enable
+#define SHUFFLE_XOR(x, mask) intel_sub_group_shuffle_xor(x, mask)
+#endif
+
+// strides from stride down to 1 of a merge step, first is the global index of keys[0]
+inline void bitonicMergeShuffle(uint *keys, __local uint *local_buffer, const uint lane, const uint tileBase,
+	const uint blocksize, uint stride) {
+	const uint first = tileBase + 2 * lane;
+	const uint subgroupKeys = 2 * get_max_sub_group_size();
+
+	// strides crossing subgroups
+	if (stride >= subgroupKeys) {
+		local_buffer[2 * lane] = keys[0];
+		local_buffer[2 * lane + 1] = keys[1];
+		for (; stride >= subgroupKeys; stride >>= 1) {
+			barrier(CLK_LOCAL_MEM_FENCE);
+			uint idx = 2 * lane - (lane & (stride - 1));
+			sortLocal(&local_buffer[idx], &local_buffer[idx + stride], ((tileBase + idx) & blocksize) == 0);
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+		keys[0] = local_buffer[2 * lane];
+		keys[1] = local_buffer[2 * lane + 1];
+		// local_buffer is reused by the next merge step
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	// strides within the subgroup, the partner key is in lane ^ (stride / 2)
+	for (; stride > 1; stride >>= 1) {
+#pragma unroll
+		for (uint b = 0; b < 2; b++) {
+			uint key = keys[b];
+			uint other = SHUFFLE_XOR(key, stride / 2);
+			bool takeSmaller = (((first + b) & stride) == 0) == (((first + b) & blocksize) == 0);
+			bool keepOther = takeSmaller ? SORT_LESS(other, key) : SORT_LESS(key, other);
+			keys[b] = keepOther ? other : key;
+		}
+	}
+
+	sort(&keys[0], &keys[1], (first & blocksize) == 0);
+}
+
+// sorts tiles of 2 * MAX_LOCAL_SIZE keys, every other tile descending
+__kernel void Sort_BitonicShuffleStart(const __global uint* inArray, __global uint* outArray)
+{
+	__local uint local_buffer[MAX_LOCAL_SIZE * 2];
+	const uint lane = get_sub_group_id() * get_max_sub_group_size() + get_sub_group_local_id();
+	const uint tileBase = get_group_id(0) * (MAX_LOCAL_SIZE * 2);
+
+	uint2 v = vload2(0, inArray + tileBase + 2 * lane);
+	uint keys[2] = { v.x, v.y };
+
+	for (uint blocksize = 2; blocksize <= MAX_LOCAL_SIZE * 2; blocksize <<= 1)
+		bitonicMergeShuffle(keys, local_buffer, lane, tileBase, blocksize, blocksize / 2);
+
+	vstore2((uint2)(keys[0], keys[1]), 0, outArray + tileBase + 2 * lane);
+}
+
+// all strides from stride (< 2 * MAX_LOCAL_SIZE) down to 1 of a merge step with blocksize > 2 * MAX_LOCAL_SIZE
+__kernel void Sort_BitonicShuffleMerge(__global uint* data, const uint blocksize, const uint stride)
+{
+	__local uint local_buffer[MAX_LOCAL_SIZE * 2];
+	const uint lane = get_sub_group_id() * get_max_sub_group_size() + get_sub_group_local_id();
+	const uint tileBase = get_group_id(0) * (MAX_LOCAL_SIZE * 2);
+
+	uint2 v = vload2(0, data + tileBase + 2 * lane);
+	uint keys[2] = { v.x, v.y };
+
+	bitonicMergeShuffle(keys, local_buffer, lane, tileBase, blocksize, stride);
+
+	vstore2((uint2)(keys[0], keys[1]), 0, data + tileBase + 2 * lane);
+}
+
+#endif // SUBGROUP_SHUFFLE
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Mergesort for CPU devices
+//
+// CPU runtimes run a work-group as a loop over its work-items, vectorized across them, so local memory is ordinary cached
+// memory and every barrier splits that loop. These kernels use neither: Sort_CpuChunks sorts a chunk of keys per
+// work-item (insertion sort of CPU_DEVICE_RUN_KEYS runs, then bottom-up merges that stay in the core's caches), and every
+// Sort_CpuMerge pass merges pairs of runs of width keys. Each of its work-items writes items consecutive outputs and finds
+// where they start with a binary search along the merge path, so the work is balanced whatever the keys are.
+
+// the merges alternate between data and result, the insertion sort starts in the one that makes them end in result
+__kernel void Sort_CpuChunks(__global uint* data, __global uint* result, const index_t size, const index_t chunk)
+{
+	const index_t base = get_global_id(0) * chunk;
+	if (base >= size) return;
+
+	uint passes = 0;
+	for (index_t width = CPU_DEVICE_RUN_KEYS; width < chunk; width <<= 1)
+		passes++;
+	__global uint* src = (passes & 1) ? data + base : result + base;
+	__global uint* dst = (passes & 1) ? result + base : data + base;
+
+	for (index_t begin = 0; begin < chunk; begin += CPU_DEVICE_RUN_KEYS) {
+		const index_t end = min(begin + (index_t)CPU_DEVICE_RUN_KEYS, chunk);
+		for (index_t i = begin; i < end; i++) {
+			const uint key = data[base + i];
+			index_t j = i;
+			for (; j > begin && SORT_LESS(key, src[j - 1]); j--)
+				src[j] = src[j - 1];
+			src[j] = key;
+		}
+	}
+
+	for (index_t width = CPU_DEVICE_RUN_KEYS; width < chunk; width <<= 1) {
+		for (index_t left = 0; left < chunk; left += 2 * width) {
+			const index_t middle = left + width, end = left + 2 * width;
+			index_t i = left, j = middle;
+			for (index_t k = left; k < end; k++) {
+				const bool takeLeft = j >= end || (i < middle && !SORT_LESS(src[j], src[i]));
+				dst[k] = takeLeft ? src[i] : src[j];
+				i += takeLeft;
+				j += !takeLeft;
+			}
+		}
+		__global uint* tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+}
+
+// equal keys are taken from the left run first, both the search and the merge keep that order
+__kernel void Sort_CpuMerge(const __global uint* inArray, __global uint* outArray, const index_t size, const index_t width,
+	const index_t items)
+{
+	const index_t first = get_global_id(0) * items;
+	if (first >= size) return;
+
+	const index_t pairStart = first & ~(2 * width - 1);
+	const index_t diag = first - pairStart;
+	const __global uint* a = inArray + pairStart;
+	const __global uint* b = a + width;
+
+	// number of keys of a among the first diag outputs of the pair
+	index_t lo = diag > width ? diag - width : 0;
+	index_t hi = min(diag, width);
+	while (lo < hi) {
+		const index_t mid = (lo + hi) / 2;
+		if (!SORT_LESS(b[diag - mid - 1], a[mid]))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	index_t i = lo, j = diag - lo;
+	for (index_t k = 0; k < items; k++) {
+		const bool takeA = j >= width || (i < width && !SORT_LESS(b[j], a[i]));
+		outArray[first + k] = takeA ? a[i] : b[j];
+		i += takeA;
+		j += !takeA;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Exclusive prefix sum (Blelloch) over blocks of 2 * MAX_LOCAL_SIZE elements. The total of every block is written
+// to blockSums, so the host can scan those recursively and add them back with Scan_AddBlockSums.
+__kernel void Scan_ExclusiveLocal(__global uint* data, __global uint* blockSums, const uint size)
+{
+	__local uint local_buffer[MAX_LOCAL_SIZE * 2];
+	const uint lid = get_local_id(0);
+	const uint index = get_group_id(0) * (MAX_LOCAL_SIZE * 2) + lid;
+
+	local_buffer[lid] = (index < size) ? data[index] : 0;
+	local_buffer[lid + MAX_LOCAL_SIZE] = (index + MAX_LOCAL_SIZE < size) ? data[index + MAX_LOCAL_SIZE] : 0;
+
+	// up-sweep
+	uint offset = 1;
+	for (uint d = MAX_LOCAL_SIZE; d > 0; d >>= 1) {
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (lid < d) {
+			uint left = offset * (2 * lid + 1) - 1;
+			uint right = offset * (2 * lid + 2) - 1;
+			local_buffer[right] += local_buffer[left];
+		}
+		offset <<= 1;
+	}
+
+	if (lid == 0) {
+		blockSums[get_group_id(0)] = local_buffer[MAX_LOCAL_SIZE * 2 - 1];
+		local_buffer[MAX_LOCAL_SIZE * 2 - 1] = 0;
+	}
+
+	// down-sweep
+	for (uint d = 1; d <= MAX_LOCAL_SIZE; d <<= 1) {
+		offset >>= 1;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (lid < d) {
+			uint left = offset * (2 * lid + 1) - 1;
+			uint right = offset * (2 * lid + 2) - 1;
+			uint tmp = local_buffer[left];
+			local_buffer[left] = local_buffer[right];
+			local_buffer[right] += tmp;
+		}
+	}
+
+	// sync and write back
+	barrier(CLK_LOCAL_MEM_FENCE);
+	if (index < size) data[index] = local_buffer[lid];
+	if (index + MAX_LOCAL_SIZE < size) data[index + MAX_LOCAL_SIZE] = local_buffer[lid + MAX_LOCAL_SIZE];
+}
+
+__kernel void Scan_AddBlockSums(__global uint* data, const __global uint* blockSums, const uint size)
+{
+	const uint lid = get_local_id(0);
+	const uint index = get_group_id(0) * (MAX_LOCAL_SIZE * 2) + lid;
+	const uint blockSum = blockSums[get_group_id(0)];
+
+	if (index < size) data[index] += blockSum;
+	if (index + MAX_LOCAL_SIZE < size) data[index + MAX_LOCAL_SIZE] += blockSum;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Sample sort
+//
+// Every level classifies all open segments into SAMPLESORT_ALL_BUCKETS buckets: SAMPLESORT_BUCKETS range buckets
+// (s[b-1], s[b]) interleaved with equality buckets {s[b]}, so duplicated keys never have to be sorted again.
+// Segments are described by uint4 (begin, size, tile count, first counter) and processed in tiles of uint4
+// (begin, size, segment, counter), the counters being laid out bucket-major within every segment.
+
+//#define SAMPLESORT_BUCKETS 64 //set via compile options, power of 2 and <= MAX_LOCAL_SIZE
+#define SAMPLESORT_ALL_BUCKETS (2 * SAMPLESORT_BUCKETS - 1)
+
+// integer hash (Thomas Wang) used to draw the random samples
+inline uint hashIndex(uint x) {
+	x = (x ^ 61) ^ (x >> 16);
+	x *= 9;
+	x = x ^ (x >> 4);
+	x *= 0x27d4eb2d;
+	x = x ^ (x >> 15);
+	return x;
+}
+
+// sorts 2 * MAX_LOCAL_SIZE values in local memory in SORT_LESS order
+inline void bitonicSortLocal(__local uint *local_buffer, const uint lid) {
+	for (uint blocksize = 2; blocksize <= MAX_LOCAL_SIZE * 2; blocksize <<= 1) {
+		char dir = (lid & (blocksize / 2)) == 0;
+		for (uint stride = blocksize >> 1; stride > 0; stride >>= 1) {
+			barrier(CLK_LOCAL_MEM_FENCE);
+			uint idx = 2 * lid - (lid & (stride - 1));
+			sortLocal(&local_buffer[idx], &local_buffer[idx + stride], dir);
+		}
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+// one work-group per segment: draw a sample, sort it and keep every (2 * MAX_LOCAL_SIZE / SAMPLESORT_BUCKETS)-th value
+__kernel void Sort_SampleSortSplitters(const __global uint* data, const __global uint4* segments, __global uint* splitters, const uint seed)
+{
+	__local uint local_buffer[MAX_LOCAL_SIZE * 2];
+	const uint lid = get_local_id(0);
+	const uint segment = get_group_id(0);
+	const uint4 seg = segments[segment];
+
+	// random sample (with replacement) of the segment
+	const uint sampleBase = (segment * MAX_LOCAL_SIZE * 2 + lid) ^ seed;
+	local_buffer[lid] = data[seg.x + hashIndex(sampleBase) % seg.y];
+	local_buffer[lid + MAX_LOCAL_SIZE] = data[seg.x + hashIndex(sampleBase + MAX_LOCAL_SIZE) % seg.y];
+
+	bitonicSortLocal(local_buffer, lid);
+
+	if (lid < SAMPLESORT_BUCKETS) {
+		const uint oversampling = (MAX_LOCAL_SIZE * 2) / SAMPLESORT_BUCKETS;
+		splitters[segment * SAMPLESORT_BUCKETS + lid] = (lid < SAMPLESORT_BUCKETS - 1) ? local_buffer[(lid + 1) * oversampling] : SORT_SENTINEL;
+	}
+}
+
+// classify the keys of one tile with a search tree in local memory and count the bucket sizes
+__kernel void Sort_SampleSortClassify(const __global uint* data, const __global uint4* tiles, const __global uint4* segments,
+	const __global uint* splitters, __global uchar* bucketIds, __global uint* counters)
+{
+	__local uint sorted[SAMPLESORT_BUCKETS];
+	__local uint tree[SAMPLESORT_BUCKETS];
+	__local uint histogram[SAMPLESORT_ALL_BUCKETS];
+	const uint lid = get_local_id(0);
+	const uint4 tile = tiles[get_group_id(0)];
+	const uint4 seg = segments[tile.z];
+
+	if (lid < SAMPLESORT_BUCKETS) sorted[lid] = splitters[tile.z * SAMPLESORT_BUCKETS + lid];
+	for (uint b = lid; b < SAMPLESORT_ALL_BUCKETS; b += MAX_LOCAL_SIZE) histogram[b] = 0;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// implicit binary tree (root at 1, children of j at 2j and 2j + 1) over the sorted splitters
+	if (lid > 0 && lid < SAMPLESORT_BUCKETS) {
+		uint depth = 31 - clz(lid);
+		uint pos = lid - (1 << depth);
+		tree[lid] = sorted[(2 * pos + 1) * (SAMPLESORT_BUCKETS >> (depth + 1)) - 1];
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (uint i = lid; i < tile.y; i += MAX_LOCAL_SIZE) {
+		uint key = data[tile.x + i];
+
+		// branchless descent, j - SAMPLESORT_BUCKETS is the number of splitters smaller than key
+		uint j = 1;
+		while (j < SAMPLESORT_BUCKETS) j = 2 * j + SORT_LESS(tree[j], key);
+		j -= SAMPLESORT_BUCKETS;
+		uint bucket = 2 * j + (j < SAMPLESORT_BUCKETS - 1 && key == sorted[j]);
+
+		bucketIds[tile.x + i] = (uchar)bucket;
+		atomic_inc(&histogram[bucket]);
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for (uint b = lid; b < SAMPLESORT_ALL_BUCKETS; b += MAX_LOCAL_SIZE)
+		counters[tile.w + b * seg.z] = histogram[b];
+}
+
+// move the keys of one tile to their buckets, using the scanned counters as write offsets
+__kernel void Sort_SampleSortScatter(const __global uint* inArray, __global uint* outArray, const __global uchar* bucketIds,
+	const __global uint4* tiles, const __global uint4* segments, const __global uint* counters, __global uint* bucketStarts)
+{
+	__local uint offsets[SAMPLESORT_ALL_BUCKETS];
+	const uint lid = get_local_id(0);
+	const uint4 tile = tiles[get_group_id(0)];
+	const uint4 seg = segments[tile.z];
+	const uint segmentOffset = counters[seg.w];
+
+	for (uint b = lid; b < SAMPLESORT_ALL_BUCKETS; b += MAX_LOCAL_SIZE) {
+		offsets[b] = seg.x + counters[tile.w + b * seg.z] - segmentOffset;
+		// the first tile of a segment also reports where its buckets start
+		if (tile.w == seg.w) bucketStarts[tile.z * SAMPLESORT_ALL_BUCKETS + b] = offsets[b] - seg.x;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (uint i = lid; i < tile.y; i += MAX_LOCAL_SIZE) {
+		uint pos = atomic_inc(&offsets[bucketIds[tile.x + i]]);
+		outArray[pos] = inArray[tile.x + i];
+	}
+}
+
+// one work-group sorts one bucket (uint2: begin, size) of at most 2 * MAX_LOCAL_SIZE keys
+__kernel void Sort_SampleSortLocal(const __global uint* inArray, __global uint* outArray, const __global uint2* buckets)
+{
+	__local uint local_buffer[MAX_LOCAL_SIZE * 2];
+	const uint lid = get_local_id(0);
+	const uint2 bucket = buckets[get_group_id(0)];
+
+	// load into local mem, pad with the sentinel
+	local_buffer[lid] = (lid < bucket.y) ? inArray[bucket.x + lid] : SORT_SENTINEL;
+	local_buffer[lid + MAX_LOCAL_SIZE] = (lid + MAX_LOCAL_SIZE < bucket.y) ? inArray[bucket.x + lid + MAX_LOCAL_SIZE] : SORT_SENTINEL;
+
+	bitonicSortLocal(local_buffer, lid);
+
+	// write back
+	if (lid < bucket.y) outArray[bucket.x + lid] = local_buffer[lid];
+	if (lid + MAX_LOCAL_SIZE < bucket.y) outArray[bucket.x + lid + MAX_LOCAL_SIZE] = local_buffer[lid + MAX_LOCAL_SIZE];
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Radix sort (LSD, stable)
+//
+// Sorts keys together with a value array, RADIX_BITS per pass. Every work-group handles a tile of
+// MAX_LOCAL_SIZE * RADIX_ELEMENTS_PER_ITEM keys and every work-item a contiguous chunk of RADIX_ELEMENTS_PER_ITEM,
+// so ranking the chunks in order keeps equal digits in input order. The counters are laid out digit-major
+// (digit * numTiles + tile), so their exclusive scan yields the global output offset of every digit in every tile.
+// Only the KEY_BITS of the key are sorted (passes with shift < KEY_BITS), descending order inverts the digits. The digits
+// are taken from KEY - keyBase, so with a known key range only the significant bits above its minimum need passes.
+// Custom comparators are not supported.
+
+//#define RADIX_BITS 4 //set via compile options
+//#define RADIX_ELEMENTS_PER_ITEM 4 //set via compile options
+#define RADIX_BINS (1 << RADIX_BITS)
+
+#ifdef SORT_DESCENDING
+#define RADIX_DIGIT(x, shift, base) (RADIX_BINS - 1 - (((KEY(x) - (base)) >> (shift)) & (RADIX_BINS - 1)))
+#else
+#define RADIX_DIGIT(x, shift, base) (((KEY(x) - (base)) >> (shift)) & (RADIX_BINS - 1))
+#endif
+
+__kernel void Sort_RadixInitValues(__global uint* values, const uint size)
+{
+	const uint gid = get_global_id(0);
+	if (gid < size) values[gid] = gid;
+}
+
+__kernel void Sort_RadixHistogram(const __global uint* keys, __global uint* counters, const uint size, const uint shift, const uint keyBase)
+{
+	__local uint histogram[RADIX_BINS];
+	const uint lid = get_local_id(0);
+	const uint tile = get_group_id(0);
+	const uint base = tile * (MAX_LOCAL_SIZE * RADIX_ELEMENTS_PER_ITEM);
+
+	for (uint d = lid; d < RADIX_BINS; d += MAX_LOCAL_SIZE) histogram[d] = 0;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (uint i = base + lid; i < min(base + MAX_LOCAL_SIZE * RADIX_ELEMENTS_PER_ITEM, size); i += MAX_LOCAL_SIZE)
+		atomic_inc(&histogram[RADIX_DIGIT(keys[i], shift, keyBase)]);
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for (uint d = lid; d < RADIX_BINS; d += MAX_LOCAL_SIZE)
+		counters[d * get_num_groups(0) + tile] = histogram[d];
+}
+
+__kernel void Sort_RadixScatter(const __global uint* inKeys, const __global uint* inValues, __global uint* outKeys, __global uint* outValues,
+	const __global uint* counters, const uint size, const uint shift, const uint keyBase)
+{
+	__local uint ranks[RADIX_BINS * MAX_LOCAL_SIZE];
+	__local uint sums[MAX_LOCAL_SIZE];
+	__local uint digitOffsets[RADIX_BINS];
+	const uint lid = get_local_id(0);
+	const uint tile = get_group_id(0);
+	const uint begin = tile * (MAX_LOCAL_SIZE * RADIX_ELEMENTS_PER_ITEM) + lid * RADIX_ELEMENTS_PER_ITEM;
+	const uint end = min(begin + RADIX_ELEMENTS_PER_ITEM, size);
+
+	// count the digits of the own chunk, ranks[d * MAX_LOCAL_SIZE + lid] belongs to this work-item only
+	for (uint d = 0; d < RADIX_BINS; d++) ranks[d * MAX_LOCAL_SIZE + lid] = 0;
+	for (uint i = begin; i < end; i++) ranks[RADIX_DIGIT(inKeys[i], shift, keyBase) * MAX_LOCAL_SIZE + lid]++;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// exclusive scan over all counts, every work-item scans RADIX_BINS consecutive entries
+	uint sum = 0;
+	for (uint k = lid * RADIX_BINS; k < (lid + 1) * RADIX_BINS; k++) {
+		uint tmp = ranks[k];
+		ranks[k] = sum;
+		sum += tmp;
+	}
+	sums[lid] = sum;
+
+	// inclusive scan over the partial sums of the work-items (Hillis-Steele)
+	for (uint stride = 1; stride < MAX_LOCAL_SIZE; stride <<= 1) {
+		barrier(CLK_LOCAL_MEM_FENCE);
+		uint tmp = (lid >= stride) ? sums[lid - stride] : 0;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		sums[lid] += tmp;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+	uint prefix = (lid > 0) ? sums[lid - 1] : 0;
+	for (uint k = lid * RADIX_BINS; k < (lid + 1) * RADIX_BINS; k++) ranks[k] += prefix;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// global offset of every digit minus its offset within the tile
+	for (uint d = lid; d < RADIX_BINS; d += MAX_LOCAL_SIZE)
+		digitOffsets[d] = counters[d * get_num_groups(0) + tile] - ranks[d * MAX_LOCAL_SIZE];
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// write out in input order
+	for (uint i = begin; i < end; i++) {
+		uint key = inKeys[i];
+		uint d = RADIX_DIGIT(key, shift, keyBase);
+		uint pos = digitOffsets[d] + ranks[d * MAX_LOCAL_SIZE + lid]++;
+		outKeys[pos] = key;
+		outValues[pos] = inValues[i];
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// String sort
+//
+// String s is [offsets[s], offsets[s + 1]) of bytes. Every round sorts the items (string indices) that are still tied
+// before the 8 bytes at offset with the radix sort, least significant word first: the number of bytes left (capped at 9,
+// so a string goes before its extensions), bytes 4 to 7 and bytes 0 to 3 packed big-endian and padded with zeros, and
+// from the second round on the tie (segment) the item belongs to. The sorted items go back to the positions of their
+// segments in the permutation, the ones still tied with a neighbour that have more bytes left make up the next round.
+
+inline uint stringWord(const __global uchar* bytes, const uint begin, const uint end)
+{
+	uint word = 0;
+	for (uint i = 0; i < 4; i++)
+		word = (word << 8) | (begin + i < end ? bytes[begin + i] : 0);
+	return word;
+}
+
+// word 0: bytes left, 1: bytes 4 to 7, 2: bytes 0 to 3, 3: segment. Descending order complements the segment, the
+// inverted digits of the radix sort then keep the segments in order
+__kernel void String_Keys(const __global uchar* bytes, const __global uint* offsets, const __global uint* items,
+	const __global uint* segments, __global uint* keys, const uint size, const uint offset, const uint word)
+{
+	const uint gid = get_global_id(0);
+	if (gid >= size) return;
+
+	const uint s = items[gid];
+	const uint begin = offsets[s] + offset, end = offsets[s + 1];
+	uint key;
+	if (word == 0)
+		key = min(end - begin, 9u);
+	else if (word == 1)
+		key = stringWord(bytes, begin + 4, end);
+	else if (word == 2)
+		key = stringWord(bytes, begin, end);
+	else
+#ifdef SORT_DESCENDING
+		key = ~segments[s];
+#else
+		key = segments[s];
+#endif
+	keys[gid] = key;
+}
+
+// same segment, same number of bytes left and the same bytes at offset
+inline bool stringTied(const __global uchar* bytes, const __global uint* offsets, const __global uint* segments,
+	const uint a, const uint b, const uint offset)
+{
+	if (segments[a] != segments[b])
+		return false;
+	const uint beginA = offsets[a] + offset, beginB = offsets[b] + offset;
+	const uint left = min(offsets[a + 1] - beginA, 9u);
+	if (left != min(offsets[b + 1] - beginB, 9u))
+		return false;
+	for (uint i = 0; i < min(left, 8u); i++)
+		if (bytes[beginA + i] != bytes[beginB + i])
+			return false;
+	return true;
+}
+
+// open: the item is tied with a neighbour and has more than 8 bytes left, head: it is the first open item of its tie.
+// Launched for size + 1 items, so both get a 0 appended for their exclusive scans
+__kernel void String_Ties(const __global uchar* bytes, const __global uint* offsets, const __global uint* items,
+	const __global uint* segments, __global uint* open, __global uint* heads, const uint size, const uint offset)
+{
+	const uint gid = get_global_id(0);
+	if (gid > size) return;
+
+	uint isOpen = 0, isHead = 0;
+	if (gid < size) {
+		const uint s = items[gid];
+		if (offsets[s + 1] - offsets[s] - offset > 8) {
+			const bool prev = gid > 0 && stringTied(bytes, offsets, segments, items[gid - 1], s, offset);
+			const bool next = gid + 1 < size && stringTied(bytes, offsets, segments, s, items[gid + 1], offset);
+			isOpen = prev || next;
+			isHead = prev ? 0 : isOpen;
+		}
+	}
+	open[gid] = isOpen;
+	heads[gid] = isHead;
+}
+
+// open and heads are scanned: every sorted item goes to its position in the permutation, the open ones are gathered for
+// the next round with their positions and get the index of their tie as segment
+__kernel void String_Compact(const __global uint* items, const __global uint* positions, __global uint* permutation,
+	const __global uint* open, const __global uint* heads, __global uint* nextItems, __global uint* nextPositions,
+	__global uint* segments, const uint size)
+{
+	const uint gid = get_global_id(0);
+	if (gid >= size) return;
+
+	const uint s = items[gid], position = positions[gid];
+	permutation[position] = s;
+	if (open[gid + 1] != open[gid]) {
+		nextItems[open[gid]] = s;
+		nextPositions[open[gid]] = position;
+		segments[s] = heads[gid + 1] - 1;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Multi-column sort
+//
+// Tables stored column-wise are sorted with stable radix passes over 32-bit keys, the least significant key first. The
+// host packs consecutive columns into one key while their significant bits fit: every column contributes its value minus
+// its minimum, complemented within its range if it is ordered against the sort order. Columns_Pack adds one column to the
+// keys of the rows in the current order (items), first starts new keys.
+__kernel void Columns_Pack(const __global uint* column, const __global uint* items, __global uint* keys, const uint size,
+	const uint minimum, const uint range, const uint shift, const uint flip, const uint first)
+{
+	const uint gid = get_global_id(0);
+	if (gid >= size) return;
+
+	uint value = column[items[gid]] - minimum;
+	if (flip)
+		value = range - value;
+	keys[gid] = (first ? 0 : keys[gid]) | (value << shift);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Key range and counting sort
+//
+// Range_MinMax finds the smallest and biggest KEY with a grid-stride loop, result[0] and result[1] start at UINT_MAX and 0.
+// If the range is small, the counting sort counts every key value in its bin (in local memory if all bins fit), scans the
+// counters and writes every bin's key value over its output range. Only for whole 32-bit keys without a custom
+// comparator, where keys with the same KEY are identical.
+
+//#define COUNTING_LOCAL_BINS 2048 //set via compile options
+#ifdef SORT_DESCENDING
+#define COUNTING_BIN(x, lo, hi) ((hi) - KEY(x))
+#define COUNTING_KEY(bin, lo, hi) ((hi) - (bin))
+#else
+#define COUNTING_BIN(x, lo, hi) (KEY(x) - (lo))
+#define COUNTING_KEY(bin, lo, hi) ((lo) + (bin))
+#endif
+
+__kernel void Range_MinMax(const __global uint* data, __global uint* result, const uint size)
+{
+	__local uint minimum[MAX_LOCAL_SIZE];
+	__local uint maximum[MAX_LOCAL_SIZE];
+	const uint lid = get_local_id(0);
+
+	uint lo = UINT_MAX, hi = 0;
+	for (uint i = get_global_id(0); i < size; i += get_global_size(0)) {
+		uint key = KEY(data[i]);
+		lo = min(lo, key);
+		hi = max(hi, key);
+	}
+	minimum[lid] = lo;
+	maximum[lid] = hi;
+
+	for (uint stride = get_local_size(0) / 2; stride > 0; stride >>= 1) {
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (lid < stride) {
+			minimum[lid] = min(minimum[lid], minimum[lid + stride]);
+			maximum[lid] = max(maximum[lid], maximum[lid + stride]);
+		}
+	}
+	if (lid == 0) {
+		atomic_min(&result[0], minimum[0]);
+		atomic_max(&result[1], maximum[0]);
+	}
+}
+
+// counts has range entries and starts zeroed
+__kernel void Sort_CountingHistogram(const __global uint* data, __global uint* counts, const uint size, const uint range,
+	const uint lo, const uint hi)
+{
+	__local uint histogram[COUNTING_LOCAL_BINS];
+	const uint lid = get_local_id(0);
+	const bool inLocal = range <= COUNTING_LOCAL_BINS;
+
+	if (inLocal)
+		for (uint b = lid; b < range; b += get_local_size(0)) histogram[b] = 0;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (uint i = get_global_id(0); i < size; i += get_global_size(0)) {
+		uint bin = COUNTING_BIN(data[i], lo, hi);
+		if (inLocal) atomic_inc(&histogram[bin]);
+		else atomic_inc(&counts[bin]);
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+	if (inLocal)
+		for (uint b = lid; b < range; b += get_local_size(0))
+			if (histogram[b] > 0) atomic_add(&counts[b], histogram[b]);
+}
+
+// offsets is the exclusive scan of the counts. Every output key searches the last bin starting at or before it, which
+// keeps the work balanced however skewed the counts are, and neighbouring keys read the same offsets.
+__kernel void Sort_CountingWrite(const __global uint* offsets, __global uint* outArray, const uint size, const uint range,
+	const uint lo, const uint hi)
+{
+	const uint gid = get_global_id(0);
+	if (gid >= size) return;
+
+	uint first = 0, last = range;
+	while (first < last) {
+		uint mid = (first + last) / 2;
+		if (offsets[mid] <= gid) first = mid + 1;
+		else last = mid;
+	}
+	outArray[gid] = COUNTING_KEY(first - 1, lo, hi);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Incremental insert
+//
+// Merges a sorted batch into the sorted resident set with a single pass: every key goes to its own index plus its rank in
+// the other array, found by binary search. Neighbouring work-items search for neighbouring keys, so they walk the same
+// path and mostly hit the cache. Keys of the set go before equal keys of the batch, which keeps the ranks distinct.
+
+__kernel void Sort_MergeInsert(const __global uint* set, const uint setSize, const __global uint* batch, const uint batchSize,
+	__global uint* outArray)
+{
+	const uint gid = get_global_id(0);
+	if (gid < setSize) {
+		// number of batch keys before the key
+		uint key = set[gid];
+		uint lo = 0, hi = batchSize;
+		while (lo < hi) {
+			uint mid = (lo + hi) / 2;
+			if (SORT_LESS(batch[mid], key)) lo = mid + 1;
+			else hi = mid;
+		}
+		outArray[gid + lo] = key;
+	}
+	else if (gid < setSize + batchSize) {
+		// number of set keys not after the key
+		uint index = gid - setSize;
+		uint key = batch[index];
+		uint lo = 0, hi = setSize;
+		while (lo < hi) {
+			uint mid = (lo + hi) / 2;
+			if (!SORT_LESS(key, set[mid])) lo = mid + 1;
+			else hi = mid;
+		}
+		outArray[index + lo] = key;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Post-sort primitives
+//
+// Work on sorted keys, where the keys of a run (none KEY_LESS than another) are contiguous. A key is the head of a run if
+// its predecessor comes before it. The exclusive scan of the head flags (with a 0 appended) gives the run index of every
+// head and the number of runs in runs[size], so runs[i + 1] - 1 is the run of key i. The outputs hold one entry per run.
+
+//#define POST_ELEMENTS_PER_ITEM 16 //set via compile options
+#define POST_SUM 0
+#define POST_MIN 1
+#define POST_MAX 2
+
+#define RUN_HEAD(data, i) ((i) == 0 || KEY_LESS((data)[(i) - 1], (data)[i]))
+
+__kernel void Post_RunHeads(const __global uint* data, __global uint* heads, const uint size)
+{
+	const uint gid = get_global_id(0);
+	if (gid < size) heads[gid] = RUN_HEAD(data, gid);
+	else if (gid == size) heads[gid] = 0;
+}
+
+// first key and start index of every run
+__kernel void Post_Compact(const __global uint* data, const __global uint* runs, __global uint* runKeys, __global uint* runValues,
+	const uint size)
+{
+	const uint gid = get_global_id(0);
+	if (gid < size && RUN_HEAD(data, gid)) {
+		runKeys[runs[gid]] = data[gid];
+		runValues[runs[gid]] = gid;
+	}
+}
+
+// the last key of every run replaces the start index by the length, nobody else touches that entry
+__kernel void Post_RunLengths(const __global uint* data, const __global uint* runs, __global uint* runValues, const uint size)
+{
+	const uint gid = get_global_id(0);
+	if (gid < size && (gid + 1 == size || KEY_LESS(data[gid], data[gid + 1]))) {
+		uint run = runs[gid + 1] - 1;
+		runValues[run] = gid + 1 - runValues[run];
+	}
+}
+
+inline uint postCombine(uint a, uint b, uint op)
+{
+	return (op == POST_SUM) ? a + b : (op == POST_MIN) ? min(a, b) : max(a, b);
+}
+
+inline void postStore(__global uint* runValues, uint run, uint value, uint op, bool shared)
+{
+	if (!shared) runValues[run] = value;
+	else if (op == POST_SUM) atomic_add(&runValues[run], value);
+	else if (op == POST_MIN) atomic_min(&runValues[run], value);
+	else atomic_max(&runValues[run], value);
+}
+
+// Every work-item reduces POST_ELEMENTS_PER_ITEM consecutive keys in a register and stores once per run, so long runs do
+// not serialize on one address. Only the runs crossing the chunk boundaries are combined with atomics, their entries are
+// initialized with the neutral element of op by the host. gather: the payload is in input order, perm[i] is the input
+// index of key i.
+__kernel void Post_ReduceByKey(const __global uint* data, const __global uint* runs, const __global uint* perm,
+	const __global uint* payload, __global uint* runValues, const uint size, const uint op, const uint gather)
+{
+	const uint begin = get_global_id(0) * POST_ELEMENTS_PER_ITEM;
+	const uint end = min(begin + POST_ELEMENTS_PER_ITEM, size);
+	if (begin >= end) return;
+
+	bool shared = !RUN_HEAD(data, begin);
+	uint run = runs[begin + 1] - 1;
+	uint acc = gather ? payload[perm[begin]] : payload[begin];
+	for (uint i = begin + 1; i < end; i++) {
+		uint value = gather ? payload[perm[i]] : payload[i];
+		if (RUN_HEAD(data, i)) {
+			postStore(runValues, run, acc, op, shared);
+			shared = false;
+			run++;
+			acc = value;
+		}
+		else
+			acc = postCombine(acc, value, op);
+	}
+	postStore(runValues, run, acc, op, shared || (end < size && !RUN_HEAD(data, end)));
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Device-side validation
+//
+// Instead of comparing against a CPU reference sort, the output is checked for sortedness and compared to the input
+// (in KEY_LESS order) with an order-independent multiset hash: the sums (mod 2^32) of two independent seeded hashes of all keys.
+// result: [0] number of unsorted neighbours, [1] and [2] hash sums. Launched with a grid-stride loop.
+
+// seeded integer hashes (Thomas Wang and the murmur3 finalizer)
+uint validateHash1(uint key, uint seed)
+{
+	key ^= seed;
+	key = (key ^ 61) ^ (key >> 16);
+	key *= 9;
+	key = key ^ (key >> 4);
+	key *= 0x27d4eb2d;
+	return key ^ (key >> 15);
+}
+
+uint validateHash2(uint key, uint seed)
+{
+	key += seed * 0x9e3779b9;
+	key ^= key >> 16;
+	key *= 0x85ebca6b;
+	key ^= key >> 13;
+	key *= 0xc2b2ae35;
+	return key ^ (key >> 16);
+}
+
+__kernel void Validate_Fingerprint(const __global uint* data, __global uint* result, const index_t size, const uint seed)
+{
+	__local uint unsorted[MAX_LOCAL_SIZE];
+	__local uint hash1[MAX_LOCAL_SIZE];
+	__local uint hash2[MAX_LOCAL_SIZE];
+	uint lid = get_local_id(0);
+
+	uint u = 0, h1 = 0, h2 = 0;
+	for (index_t i = get_global_id(0); i < size; i += get_global_size(0)) {
+		uint key = data[i];
+		if (i + 1 < size && KEY_LESS(data[i + 1], key))
+			u++;
+		h1 += validateHash1(key, seed);
+		h2 += validateHash2(key, seed);
+	}
+	unsorted[lid] = u;
+	hash1[lid] = h1;
+	hash2[lid] = h2;
+
+	// reduce the work-group and add its partial results to the global ones
+	for (uint stride = get_local_size(0) / 2; stride > 0; stride >>= 1) {
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (lid < stride) {
+			unsorted[lid] += unsorted[lid + stride];
+			hash1[lid] += hash1[lid + stride];
+			hash2[lid] += hash2[lid + stride];
+		}
+	}
+	if (lid == 0) {
+		atomic_add(&result[0], unsorted[0]);
+		atomic_add(&result[1], hash1[0]);
+		atomic_add(&result[2], hash2[0]);
+	}
+}
+
+// stable key-value sorts: every key has to come from its index in the input and equal keys have to keep their
+// input order. Together with the multiset hash of the keys this also proves that perm is a permutation.
+__kernel void Validate_StablePermutation(const __global uint* keys, const __global uint* perm, const __global uint* input,
+	__global uint* result, const uint size)
+{
+	uint errors = 0;
+	for (uint i = get_global_id(0); i < size; i += get_global_size(0)) {
+		uint key = keys[i];
+		uint index = perm[i];
+		if (index >= size || input[index] != key)
+			errors++;
+		else if (i + 1 < size && !KEY_LESS(key, keys[i + 1]) && index >= perm[i + 1])
+			errors++;
+	}
+	if (errors > 0)
+		atomic_add(&result[0], errors);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Bandwidth calibration
+//
+// A plain copy with uint4 loads and stores reads and writes every key once, like every sort stage. Its throughput is the
+// peak the bandwidth report compares the sort kernels to.
+__kernel void Bandwidth_Copy(const __global uint4* inArray, __global uint4* outArray, const index_t size)
+{
+	index_t gid = get_global_id(0);
+	if (gid < size)
+		outArray[gid] = inArray[gid];
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -8,6 +8,8 @@ GPU Computing / GPGPU Praktikum source code.
 #include "CLUtil.h"
 #include "CTimer.h"
 
+#include <cctype>
+#include <cstdlib>
 #include <vector>
 
 using namespace std;
@@ -73,31 +75,87 @@ bool CAssignmentBase::InitCLContext()
 	V_RETURN_FALSE_CL(clGetPlatformIDs(c_MaxPlatforms, &platformIds[0], &countPlatforms), "Failed to get CL platform ID");
 	platformIds.resize(countPlatforms);
 
-	// 2. find all available GPU devices
+	// 2. find all available devices
 	std::vector<cl_device_id> deviceIds;
-	const int maxDevices = 16;
-	deviceIds.resize(maxDevices);
-	int countAllDevices = 0;
+	for (size_t i = 0; i < platformIds.size(); i++)
+	{
+		cl_uint countDevices = 0;
+		if (clGetDeviceIDs(platformIds[i], CL_DEVICE_TYPE_ALL, 0, NULL, &countDevices) != CL_SUCCESS || countDevices == 0)
+			continue;
+		size_t first = deviceIds.size();
+		deviceIds.resize(first + countDevices);
+		clGetDeviceIDs(platformIds[i], CL_DEVICE_TYPE_ALL, countDevices, &deviceIds[first], NULL);
+	}
 
+	if (deviceIds.empty())
+	{
+		std::cout << "No device with OpenCL support was found." << std::endl;
+		return false;
+	}
 
-	cl_device_type deviceType = CL_DEVICE_TYPE_GPU;
+	// 3. choose the device by type, index or name
+	std::string selection = m_DeviceSelection;
+	for (size_t i = 0; i < selection.size(); i++)
+		selection[i] = (char)tolower(selection[i]);
+
+	cl_device_type selectedType = 0;
+	if (selection.empty() || selection == "gpu")
+		selectedType = CL_DEVICE_TYPE_GPU;
+	else if (selection == "cpu")
+		selectedType = CL_DEVICE_TYPE_CPU;
+	else if (selection == "accelerator")
+		selectedType = CL_DEVICE_TYPE_ACCELERATOR;
+	else if (selection == "all")
+		selectedType = CL_DEVICE_TYPE_ALL;
+
+	int selected = -1;
+	for (size_t i = 0; i < deviceIds.size() && selected < 0; i++)
+	{
+		cl_device_type type = 0;
+		char name[256] = "";
+		clGetDeviceInfo(deviceIds[i], CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+		clGetDeviceInfo(deviceIds[i], CL_DEVICE_NAME, sizeof(name) - 1, name, NULL);
+		std::string lowerName = name;
+		for (size_t c = 0; c < lowerName.size(); c++)
+			lowerName[c] = (char)tolower(lowerName[c]);
+
+		if (selectedType != 0)
+		{
+			if (type & selectedType)
+				selected = (int)i;
+		}
+		else if (selection.find_first_not_of("0123456789") == std::string::npos)
+		{
+			if (atoi(selection.c_str()) == (int)i)
+				selected = (int)i;
+		}
+		else if (lowerName.find(selection) != std::string::npos)
+			selected = (int)i;
+	}
 
-	for (size_t i = 0; i < platformIds.size(); i++)
+	if (selected < 0 && selection.empty())
 	{
-		// Getting the available devices.
-		cl_uint countDevices;
-		clGetDeviceIDs(platformIds[i], deviceType, 1, &deviceIds[countAllDevices], &countDevices);
-		countAllDevices += countDevices;
+		std::cout << "No GPU with OpenCL support was found, using the first OpenCL device." << std::endl;
+		selected = 0;
 	}
-	deviceIds.resize(countAllDevices);
 
-	if (countAllDevices == 0)
+	if (selected < 0)
 	{
-		std::cout << "No device of the selected type with OpenCL support was found.";
+		std::cout << "No OpenCL device matches \"" << m_DeviceSelection << "\". Available devices:" << std::endl;
+		for (size_t i = 0; i < deviceIds.size(); i++)
+		{
+			cl_device_type type = 0;
+			char name[256] = "";
+			clGetDeviceInfo(deviceIds[i], CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+			clGetDeviceInfo(deviceIds[i], CL_DEVICE_NAME, sizeof(name) - 1, name, NULL);
+			std::cout << "  " << i << ": " << name << " ("
+				<< ((type & CL_DEVICE_TYPE_GPU) ? "GPU" : (type & CL_DEVICE_TYPE_CPU) ? "CPU" : (type & CL_DEVICE_TYPE_ACCELERATOR) ? "accelerator" : "other")
+				<< ")" << std::endl;
+		}
 		return false;
 	}
-	// Choosing the first available device.
-	m_CLDevice = deviceIds[0];
+
+	m_CLDevice = deviceIds[selected];
 	clGetDeviceInfo(m_CLDevice, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &m_CLPlatform, NULL);
 
 	// Printing platform and device data.
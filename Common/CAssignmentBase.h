@@ -24,6 +24,8 @@
 
 #include "CommonDefs.h"
 
+#include <string>
+
 //! Base class for all assignments
 /*! 
 	Inherit a new class for each specific assignment.
@@ -48,6 +50,11 @@ public:
 	//! You need to overload this to define a specific behavior for your assignments
 	virtual bool DoCompute() = 0;
 
+	//! Device to run on: "gpu", "cpu", "accelerator" or "all" for the first device of that type,
+	//! a number for the index in the list of all devices or a part of the device name.
+	//! Without a selection the first GPU is used, or the first device of any type if there is no GPU.
+	void SetDeviceSelection(const std::string& Selection) { m_DeviceSelection = Selection; }
+
 protected:	
 	virtual bool InitCLContext();
 
@@ -59,6 +66,8 @@ protected:
 	cl_device_id		m_CLDevice;
 	cl_context			m_CLContext;
 	cl_command_queue	m_CLCommandQueue;
+
+	std::string			m_DeviceSelection;
 };
 
 #endif // _CASSIGNMENT_BASE_H
@@ -0,0 +1,160 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CHostPool.h"
+
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#define HOST_POOL_LINE 64
+#define HOST_POOL_BIG (2 * 1024 * 1024)
+#define HOST_POOL_HUGE_PAGE (2 * 1024 * 1024)
+
+///////////////////////////////////////////////////////////////////////////////
+// CHostPool
+
+CHostPool::CHostPool()
+	: m_HugePages(HugePagesTransparent), m_Prefault(false)
+{
+}
+
+CHostPool::~CHostPool()
+{
+	Trim();
+	// buffers that were never freed go as well
+	for (map<void*, size_t>::iterator it = m_Allocated.begin(); it != m_Allocated.end(); ++it)
+		Release(it->first, it->second);
+	m_Allocated.clear();
+}
+
+void* CHostPool::Allocate(size_t Bytes)
+{
+	if (Bytes == 0)
+		Bytes = 1;
+	// big buffers in whole huge pages, so a pooled one fits every request of up to the same number of pages
+	size_t granule = Bytes < HOST_POOL_BIG ? HOST_POOL_LINE : HOST_POOL_HUGE_PAGE;
+	size_t capacity = (Bytes + granule - 1) / granule * granule;
+
+	lock_guard<mutex> lock(m_Mutex);
+	multimap<size_t, void*>::iterator pooled = m_Pooled.lower_bound(capacity);
+	if (pooled != m_Pooled.end() && pooled->first <= 2 * capacity) {
+		void* buffer = pooled->second;
+		m_Allocated[buffer] = pooled->first;
+		m_Pooled.erase(pooled);
+		return buffer;
+	}
+
+	void* buffer = NULL;
+	if (capacity >= HOST_POOL_BIG)
+		buffer = MapBig(capacity);
+	else {
+#ifdef _WIN32
+		buffer = _aligned_malloc(capacity, HOST_POOL_LINE);
+#else
+		if (posix_memalign(&buffer, HOST_POOL_LINE, capacity) != 0)
+			buffer = NULL;
+#endif
+	}
+	if (buffer == NULL)
+		throw bad_alloc();
+	m_Allocated[buffer] = capacity;
+	return buffer;
+}
+
+void* CHostPool::MapBig(size_t Bytes)
+{
+#ifdef _WIN32
+	void* buffer = _aligned_malloc(Bytes, HOST_POOL_HUGE_PAGE);
+	if (buffer != NULL && m_Prefault)
+		for (size_t i = 0; i < Bytes; i += 4096)
+			static_cast<volatile char*>(buffer)[i] = 0;
+	return buffer;
+#else
+	void* buffer = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	if (m_HugePages == HugePagesExplicit)
+		buffer = mmap(NULL, Bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+	if (buffer == MAP_FAILED) {
+		// map one huge page more and cut off the ends, so the buffer starts on a huge page boundary
+		size_t mapped = Bytes + HOST_POOL_HUGE_PAGE;
+		char* raw = static_cast<char*>(mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+		if (raw == MAP_FAILED)
+			return NULL;
+		char* aligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(raw) + HOST_POOL_HUGE_PAGE - 1) & ~(uintptr_t)(HOST_POOL_HUGE_PAGE - 1));
+		if (aligned > raw)
+			munmap(raw, aligned - raw);
+		if (raw + mapped > aligned + Bytes)
+			munmap(aligned + Bytes, raw + mapped - (aligned + Bytes));
+		buffer = aligned;
+#ifdef MADV_HUGEPAGE
+		if (m_HugePages != HugePagesOff)
+			madvise(buffer, Bytes, MADV_HUGEPAGE);
+#endif
+	}
+
+	// one write per small page faults in the whole buffer (one fault per huge page where they are used)
+	if (m_Prefault) {
+		long page = sysconf(_SC_PAGESIZE);
+		for (size_t i = 0; i < Bytes; i += (size_t)(page > 0 ? page : 4096))
+			static_cast<volatile char*>(buffer)[i] = 0;
+	}
+	return buffer;
+#endif
+}
+
+void CHostPool::Free(void* Buffer)
+{
+	if (Buffer == NULL)
+		return;
+	lock_guard<mutex> lock(m_Mutex);
+	map<void*, size_t>::iterator it = m_Allocated.find(Buffer);
+	if (it == m_Allocated.end())
+		return;
+	m_Pooled.insert(make_pair(it->second, Buffer));
+	m_Allocated.erase(it);
+}
+
+void CHostPool::Trim()
+{
+	lock_guard<mutex> lock(m_Mutex);
+	for (multimap<size_t, void*>::iterator it = m_Pooled.begin(); it != m_Pooled.end(); ++it)
+		Release(it->second, it->first);
+	m_Pooled.clear();
+}
+
+size_t CHostPool::GetPooledBytes() const
+{
+	lock_guard<mutex> lock(m_Mutex);
+	size_t bytes = 0;
+	for (multimap<size_t, void*>::const_iterator it = m_Pooled.begin(); it != m_Pooled.end(); ++it)
+		bytes += it->first;
+	return bytes;
+}
+
+void CHostPool::Release(void* Buffer, size_t Bytes)
+{
+#ifdef _WIN32
+	(void)Bytes;
+	_aligned_free(Buffer);
+#else
+	if (Bytes >= HOST_POOL_BIG)
+		munmap(Buffer, Bytes);
+	else
+		free(Buffer);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,89 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CHOSTPOOL_H
+#define _CHOSTPOOL_H
+
+//Pool of aligned HOST buffers. Big sort arrays are mapped with huge pages and can be pre-faulted, so the sorts do not
+//pay for page faults and TLB misses, and freed buffers are kept for the next allocation of a similar size.
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+
+//! Aligned host buffers, pooled until Trim() or destruction
+/*!
+	Buffers below HOST_POOL_BIG bytes are aligned to a cache line. Bigger ones get whole pages,
+	with huge pages aligned to the huge page size. Free() keeps a buffer in the pool, Allocate()
+	reuses the smallest pooled one that fits if it is at most twice the requested size.
+	All methods are thread-safe.
+*/
+class CHostPool
+{
+public:
+
+	enum HugePages {
+		HugePagesOff,
+		//! madvise(MADV_HUGEPAGE), the kernel backs the buffer with transparent huge pages when it can
+		HugePagesTransparent,
+		//! MAP_HUGETLB from the reserved huge pages (vm.nr_hugepages), transparent ones if there are not enough
+		HugePagesExplicit
+	};
+
+	CHostPool();
+
+	~CHostPool();
+
+	void SetHugePages(HugePages Mode) { m_HugePages = Mode; }
+
+	//! Touch every page of new big buffers, so the faults happen at allocation and not inside timed code
+	void SetPrefault(bool Prefault) { m_Prefault = Prefault; }
+
+	void* Allocate(size_t Bytes);
+
+	template <typename T> T* AllocateArray(size_t Count) { return static_cast<T*>(Allocate(Count * sizeof(T))); }
+
+	//! Returns the buffer to the pool, NULL is ignored
+	void Free(void* Buffer);
+
+	//! Releases all pooled (not allocated) buffers to the OS
+	void Trim();
+
+	size_t GetPooledBytes() const;
+
+protected:
+
+	CHostPool(const CHostPool&);
+	CHostPool& operator=(const CHostPool&);
+
+	void* MapBig(size_t Bytes);
+	void Release(void* Buffer, size_t Bytes);
+
+	HugePages						m_HugePages;
+	bool							m_Prefault;
+
+	// capacity of every allocated buffer, pooled buffers by capacity
+	std::map<void*, size_t>			m_Allocated;
+	std::multimap<size_t, void*>	m_Pooled;
+	mutable std::mutex				m_Mutex;
+};
+
+#define SAFE_POOL_FREE(pool, ptr) do {if(ptr){ (pool).Free(ptr); ptr = NULL; }} while(0)
+
+#endif // _CHOSTPOOL_H
@@ -0,0 +1,177 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CPerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdint.h>
+#endif
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// CPerfCounters
+
+CPerfCounters::CPerfCounters()
+	: m_Error("not opened")
+{
+	for (int i = 0; i < EventCount; i++)
+		m_Fds[i] = -1;
+}
+
+CPerfCounters::~CPerfCounters()
+{
+	Close();
+}
+
+bool CPerfCounters::Open()
+{
+	Close();
+#ifdef __linux__
+	static const uint32_t types[EventCount] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+		PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE };
+	static const uint64_t configs[EventCount] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+		PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) };
+
+	// every event on its own instead of a group, so a missing one does not take the others along
+	bool any = false;
+	for (int i = 0; i < EventCount; i++) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = types[i];
+		attr.config = configs[i];
+		// counting right away, the sections read the difference
+		attr.disabled = 0;
+		// user space only, which perf_event_paranoid 2 still allows
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		m_Fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		if (m_Fds[i] >= 0)
+			any = true;
+		else if (!any)
+			m_Error = (errno == EACCES || errno == EPERM) ? "not permitted (see /proc/sys/kernel/perf_event_paranoid)"
+				: (errno == ENOENT || errno == EOPNOTSUPP) ? "not supported by this CPU or VM" : strerror(errno);
+	}
+	if (any)
+		m_Error = NULL;
+	return any;
+#else
+	m_Error = "only available on Linux";
+	return false;
+#endif
+}
+
+void CPerfCounters::Close()
+{
+#ifdef __linux__
+	for (int i = 0; i < EventCount; i++)
+		if (m_Fds[i] >= 0)
+			close(m_Fds[i]);
+#endif
+	for (int i = 0; i < EventCount; i++)
+		m_Fds[i] = -1;
+}
+
+bool CPerfCounters::IsOpen() const
+{
+	for (int i = 0; i < EventCount; i++)
+		if (m_Fds[i] >= 0)
+			return true;
+	return false;
+}
+
+void CPerfCounters::Read(CReading& Reading) const
+{
+	for (int i = 0; i < EventCount; i++) {
+		Reading.Valid[i] = false;
+#ifdef __linux__
+		uint64_t values[3];
+		Reading.Valid[i] = m_Fds[i] >= 0 && read(m_Fds[i], values, sizeof(values)) == (ssize_t)sizeof(values);
+		for (int j = 0; j < 3; j++)
+			Reading.Values[i][j] = Reading.Valid[i] ? values[j] : 0;
+#endif
+	}
+}
+
+double CPerfCounters::Difference(const CReading& From, const CReading& To, Event E)
+{
+	if (!From.Valid[E] || !To.Valid[E])
+		return -1.0;
+	double count = (double)(To.Values[E][0] - From.Values[E][0]);
+	double enabled = (double)(To.Values[E][1] - From.Values[E][1]);
+	double running = (double)(To.Values[E][2] - From.Values[E][2]);
+	return running > 0 ? count * enabled / running : 0.0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CPerfSection
+
+CPerfSection::CPerfSection(const CPerfCounters& Counters)
+	: m_Counters(Counters), m_Started(false)
+{
+	Reset();
+}
+
+void CPerfSection::Reset()
+{
+	for (int i = 0; i < CPerfCounters::EventCount; i++)
+		m_Counts[i] = 0;
+}
+
+void CPerfSection::Start()
+{
+	m_Started = m_Counters.IsOpen();
+	if (m_Started)
+		m_Counters.Read(m_Start);
+}
+
+void CPerfSection::Stop()
+{
+	if (!m_Started)
+		return;
+	m_Started = false;
+	CPerfCounters::CReading end;
+	m_Counters.Read(end);
+	for (int i = 0; i < CPerfCounters::EventCount; i++) {
+		double count = CPerfCounters::Difference(m_Start, end, (CPerfCounters::Event)i);
+		if (count > 0)
+			m_Counts[i] += count;
+	}
+}
+
+double CPerfSection::Get(CPerfCounters::Event E) const
+{
+	return m_Counters.IsOpen(E) ? m_Counts[E] : -1.0;
+}
+
+void CPerfSection::Print(ostream& Out, size_t Elements) const
+{
+	static const char* names[CPerfCounters::EventCount] = { "cycles", "instructions", "LLC misses", "branch misses", "dTLB misses" };
+	double n = Elements > 0 ? (double)Elements : 1.0;
+
+	Out << "per element:";
+	for (int i = 0; i < CPerfCounters::EventCount; i++) {
+		if (i > 0)
+			Out << ",";
+		if (Get((CPerfCounters::Event)i) < 0)
+			Out << " n/a " << names[i];
+		else
+			Out << " " << Get((CPerfCounters::Event)i) / n << " " << names[i];
+	}
+	if (Get(CPerfCounters::Cycles) > 0 && Get(CPerfCounters::Instructions) >= 0)
+		Out << " (IPC " << Get(CPerfCounters::Instructions) / Get(CPerfCounters::Cycles) << ")";
+	Out << endl;
+}
+
+///////////////////////////////////////////////////////////////////////////////
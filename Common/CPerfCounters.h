@@ -0,0 +1,114 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CPERFCOUNTERS_H
+#define _CPERFCOUNTERS_H
+
+//Hardware performance counters of the calling thread (Linux perf_event_open), to tell whether cache misses, branch
+//mispredicts or TLB misses are behind the time of a HOST code section. Other systems have no counters.
+
+#include <iostream>
+#include <cstddef>
+
+//! One set of cycles, instructions, LLC misses, branch misses and dTLB misses of the calling thread
+/*!
+	The counters run from Open() to Close(), sections of code are measured by the difference of
+	two Read()s (see CPerfSection), so nested sections do not need counters of their own and the
+	PMU is not multiplexed any further than these five events require. Counters the CPU, the
+	kernel or the VM does not provide (or perf_event_paranoid forbids) are reported as n/a.
+*/
+class CPerfCounters
+{
+public:
+
+	enum Event { Cycles = 0, Instructions, LLCMisses, BranchMisses, DTLBMisses, EventCount };
+
+	//! Value, time enabled and time running of every counter
+	struct CReading
+	{
+		unsigned long long	Values[EventCount][3];
+		bool				Valid[EventCount];
+	};
+
+	CPerfCounters();
+
+	~CPerfCounters();
+
+	//! Opens and starts the counters, returns false if none is available
+	bool Open();
+
+	void Close();
+
+	bool IsOpen() const;
+
+	bool IsOpen(Event E) const { return m_Fds[E] >= 0; }
+
+	void Read(CReading& Reading) const;
+
+	//! Count of the event between two readings, scaled up if the counter had to share the PMU in between.
+	//! Negative if it was not read both times
+	static double Difference(const CReading& From, const CReading& To, Event E);
+
+	//! Reason why the last Open() failed
+	const char* GetError() const { return m_Error; }
+
+protected:
+
+	CPerfCounters(const CPerfCounters&);
+	CPerfCounters& operator=(const CPerfCounters&);
+
+	int					m_Fds[EventCount];
+	const char*			m_Error;
+};
+
+//! Counts of one set of counters between Start() and Stop()
+/*!
+	Counts accumulate over all Start()/Stop() pairs until Reset(). Start() and Stop() only take a
+	reading, and do nothing if the counters are not open, so sections can stay instrumented when
+	counting is disabled.
+*/
+class CPerfSection
+{
+public:
+
+	explicit CPerfSection(const CPerfCounters& Counters);
+
+	bool IsOpen() const { return m_Counters.IsOpen(); }
+
+	void Reset();
+
+	void Start();
+
+	void Stop();
+
+	//! Accumulated count of the event, negative if it is not available
+	double Get(CPerfCounters::Event E) const;
+
+	//! Prints all counters per element
+	void Print(std::ostream& Out, size_t Elements) const;
+
+protected:
+
+	const CPerfCounters&	m_Counters;
+	CPerfCounters::CReading	m_Start;
+	bool					m_Started;
+	double					m_Counts[CPerfCounters::EventCount];
+};
+
+#endif // _CPERFCOUNTERS_H